@@ -0,0 +1,223 @@
+//
+//  fixbin.cpp - fix logs to and from the compact binary format of fixsbe.h
+//
+//      USAGE fixbin --encode {-S=./spec/FIXnn.xml} < fix.log > fix.fsb
+//            fixbin --decode < fix.fsb > fix.log
+//
+//      lossless - decode gives back the log byte for byte, text between msgs included
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixsbe.h"
+
+
+enum { FLUSH_AT = 1<<20 };
+
+static long long nwritten = 0;
+
+static void write_out(string& out, bool bforce)
+{
+    if (out.size() < FLUSH_AT && !bforce)
+        return;
+
+    fwrite(out.data(), 1, out.size(), stdout);
+    nwritten += out.size();
+    out.clear();
+}
+
+int encode(MessageGenerator& MG)
+{
+    // framed as fixtr frames [SOH msgs], text between msgs copied across as X records
+
+    BinEncoder enc(MG);
+    string out;
+    out.reserve(FLUSH_AT*2);
+    out.append(FIXSBE_MAGIC, FIXSBE_MAGICLEN);
+
+    FixFramer framer;
+    long long done = 0;
+    long long nin = 0;
+    while (!framer.beof)
+    {
+        long long upto = framer.base+framer.s;
+        if (upto>done)
+        {
+            enc.text(framer.buf.data()+(done-framer.base), upto-done, out);
+            done = upto;
+        }
+
+        char* p = framer.space();
+        int r = read(0, p, framer.avail());
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            framer.beof = true;
+        else
+        {
+            framer.commit(r);
+            nin += r;
+        }
+
+        const char* q;
+        int len;
+        long long off;
+        while (framer.next(q, len, off))
+        {
+            if (off<done)
+                continue;                           // inside a msg run to end of line, already written
+
+            enc.text(framer.buf.data()+(done-framer.base), off-done, out);
+            enc.msg(q, len, out);
+            done = off+framer.rawlen;
+
+            write_out(out, false);
+        }
+    }
+
+    long long upto = framer.base+framer.e;
+    if (upto>done)
+        enc.text(framer.buf.data()+(done-framer.base), upto-done, out);
+
+    write_out(out, true);
+    fflush(stdout);
+    long long nout = nwritten;
+
+    fprintf(stderr, "fixbin encode : %lld msgs, %d templates, %lld kept as text", enc.nmsgs, (int)enc.templates.size(), enc.nraw);
+    if (nout>0)
+        fprintf(stderr, ", %lld => %lld bytes [%.2fx]", nin, nout, (double)nin/nout);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+int decode()
+{
+    BinDecoder dec;
+    string in;
+    string out;
+    out.reserve(FLUSH_AT*2);
+
+    int s = 0;
+    long long base = 0;
+    bool beof = false;
+    bool bmagic = false;
+    while (true)
+    {
+        // whole records from in[s..], then read more
+
+        while (true)
+        {
+            const char* p = in.data()+s;
+            int n = in.size()-s;
+
+            if (!bmagic)
+            {
+                if (n<FIXSBE_MAGICLEN)
+                    break;
+                if (memcmp(p, FIXSBE_MAGIC, FIXSBE_MAGICLEN))
+                    fprintf(stderr,"Not a fixbin file\n"), exit(-1);
+                bmagic = true;
+                s += FIXSBE_MAGICLEN;
+                continue;
+            }
+
+            int kind;
+            const char* data;
+            int dlen;
+            int r = dec.next(p, n, kind, data, dlen);
+            if (r==0)
+                break;
+            if (r<0)
+                fprintf(stderr,"Bad record at offset %lld\n", base+s), exit(-1);
+
+            if (kind=='M')
+                dec.to_text(out);
+            else if (kind=='R' || kind=='X')
+                out.append(data, dlen);
+
+            s += r;
+            write_out(out, false);
+        }
+
+        if (beof)
+            break;
+
+        // keep the part record, read behind it
+
+        in.erase(0, s);
+        base += s;
+        s = 0;
+
+        int n = in.size();
+        in.resize(n + (1<<20));
+        int r = read(0, &in[n], 1<<20);
+        if (r<0 && errno==EINTR)
+            r = 0;
+        if (r<=0)
+            beof = true;
+        in.resize(n + max(r, 0));
+    }
+
+    write_out(out, true);
+    fflush(stdout);
+
+    if (s<(int)in.size() || !bmagic)
+        fprintf(stderr,"Truncated fixbin file\n"), exit(-1);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // handle args
+
+    const char* szfile = "./spec/FIX44.xml";
+
+    mapss options;
+    for (int i=1;i<argc;i++)
+    {
+        const char* szopt=argv[i];
+
+        if (0==strncmp(szopt, "-S=", 3) && strlen(szopt)>3)
+            szfile = szopt+3;
+        else if (0==strcmp(szopt, "--encode"))
+            options["mode"] = "encode";
+        else if (0==strcmp(szopt, "--decode"))
+            options["mode"] = "decode";
+        else
+            options["mode"] = "";
+    }
+
+    if (options["mode"].empty())
+    {
+        fprintf(stderr,"USAGE: fixbin --encode {-S=./spec/FIXnn.xml} < fix_messages.fix > fix_messages.fsb\n");
+        fprintf(stderr,"       fixbin --decode < fix_messages.fsb > fix_messages.fix\n");
+        fprintf(stderr,"  encode : msgs laid out by templates from the spec field types, text between msgs kept\n");
+        fprintf(stderr,"  decode : back to the log exactly as it was, no spec needed\n");
+        exit(-1);
+    }
+
+    if (options["mode"]=="decode")
+        return decode();
+
+    if (access(szfile, R_OK))
+    {
+        fprintf(stderr,"Cant read file [%s]\n", szfile);
+        exit(-1);
+    }
+
+    XNode* ndfix = parse_fix_spec_xml(szfile);
+    if (!ndfix)
+        exit(-1);
+
+    MessageGenerator fixgen(ndfix);
+    return encode(fixgen);
+}
@@ -0,0 +1,495 @@
+//
+//  fixbook.cpp - price level order books from market data [see fixbook.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixbook.h"
+#include "fixcheckpoint.h"
+
+
+enum
+{
+    MDUPDATE_NEW = 0,
+    MDUPDATE_CHANGE,
+    MDUPDATE_DELETE,
+    MDUPDATE_DELETE_THRU,               // whole side
+    MDUPDATE_DELETE_FROM,               // from MDEntryPositionNo down
+    MDUPDATE_OVERLAY                    // level at MDEntryPositionNo replaced
+};
+
+
+FixBooks::FixBooks(MessageGenerator& mg, OutBuf& o, int d, long long ival)
+    : MG(mg)
+    , out(o)
+    , depth(d)
+    , interval(ival)
+    , last(NULL)
+    , tnext(0)
+    , nmsgs(0)
+    , nentries(0)
+    , nbad(0)
+{
+    stime[0] = 0;
+}
+
+FixBooks::~FixBooks()
+{
+    for (int i=0;i<(int)books.size();i++)
+        delete books[i];
+}
+
+static unsigned symbol_hash(const char* sym, int n)
+{
+    unsigned h = 2166136261u;
+    for (int i=0;i<n;i++)
+        h = (h ^ (unsigned char)sym[i]) * 16777619u;
+    return h;
+}
+
+Book* FixBooks::book(const char* sym, int n)
+{
+    if (last && (int)last->symbol.length()==n && 0==memcmp(last->symbol.data(), sym, n))
+        return last;
+
+    if (2*(books.size()+1) > hash.size())
+    {
+        // rehash at twice the size
+
+        hash.assign(max(64, (int)hash.size()*2), (Book*)NULL);
+        unsigned mask = hash.size()-1;
+        for (int i=0;i<(int)books.size();i++)
+        {
+            unsigned k = symbol_hash(books[i]->symbol.data(), books[i]->symbol.length()) & mask;
+            while (hash[k])
+                k = (k+1) & mask;
+            hash[k] = books[i];
+        }
+    }
+
+    unsigned mask = hash.size()-1;
+    unsigned k = symbol_hash(sym, n) & mask;
+    for (; hash[k]; k=(k+1) & mask)
+    {
+        Book* B = hash[k];
+        if ((int)B->symbol.length()==n && 0==memcmp(B->symbol.data(), sym, n))
+            return last = B;
+    }
+
+    Book* B = new Book(sym, n);
+    books.push_back(B);
+    hash[k] = B;
+    return last = B;
+}
+
+static bool key_less(const BookLevel& L, long long key)
+{
+    return L.key < key;
+}
+
+void FixBooks::apply(Book* B, int action, int side, long long px, bool bpx, long long qty, int pos)
+{
+    // price level book : levels by price where theres a price, by position [1 is best] where not
+
+    vector<BookLevel>& levels = B->sides[side];
+    long long key = side ? px : -px;
+
+    vector<BookLevel>::iterator at = lower_bound(levels.begin(), levels.end(), key, key_less);
+    bool bfound = at!=levels.end() && at->key==key;
+
+    int ipos = pos-1;
+    bool bpos = ipos>=0 && ipos<(int)levels.size();
+
+    switch (action)
+    {
+    case MDUPDATE_OVERLAY:
+        if (bpos)
+            levels.erase(levels.begin()+ipos);
+        // fall through - the new level goes in by price
+
+    case MDUPDATE_NEW:
+    case MDUPDATE_CHANGE:
+        if (!bpx)
+        {
+            if (bpos && action==MDUPDATE_CHANGE)
+                levels[ipos].qty = qty;
+            break;
+        }
+        if (action==MDUPDATE_OVERLAY)
+        {
+            at = lower_bound(levels.begin(), levels.end(), key, key_less);
+            bfound = at!=levels.end() && at->key==key;
+        }
+        if (qty<=0)
+        {
+            if (bfound)
+                levels.erase(at);
+        }
+        else if (bfound)
+            at->qty = qty;
+        else
+        {
+            BookLevel L = { key, qty };
+            levels.insert(at, L);
+        }
+        break;
+
+    case MDUPDATE_DELETE:
+        if (bpx)
+        {
+            if (bfound)
+                levels.erase(at);
+        }
+        else if (bpos)
+            levels.erase(levels.begin()+ipos);
+        break;
+
+    case MDUPDATE_DELETE_THRU:
+        levels.clear();
+        break;
+
+    case MDUPDATE_DELETE_FROM:
+        if (ipos<0)
+            ipos = 0;
+        if (ipos<(int)levels.size())
+            levels.resize(ipos);
+        break;
+
+    default:
+        return;
+    }
+
+    nentries++;
+
+    if (!B->bdirty)
+    {
+        B->bdirty = true;
+        dirty.push_back(B);
+    }
+}
+
+static void put_scaled(OutBuf& out, long long v)
+{
+    // fixed point at PXPLACES back to the shortest decimal
+
+    const long long SCALE = 100000000LL;
+
+    if (v<0)
+    {
+        out.put('-');
+        v = -v;
+    }
+    out.put_int(v/SCALE);
+
+    long long frac = v%SCALE;
+    if (!frac)
+        return;
+
+    char sz[16];
+    int n = sprintf(sz, ".%08lld", frac);
+    while (sz[n-1]=='0')
+        n--;
+    out.put(sz, n);
+}
+
+void FixBooks::snapshot(Book* B)
+{
+    int nb = min(depth, (int)B->sides[0].size());
+    int na = min(depth, (int)B->sides[1].size());
+    int nrows = max(1, max(nb, na));
+
+    for (int i=0;i<nrows;i++)
+    {
+        out.put(stime);
+        out.put(' ');
+        out.put(B->symbol);
+        out.put(' ');
+        out.put_int(i+1);
+
+        if (i<nb)
+        {
+            const BookLevel& L = B->sides[0][i];
+            out.put(' ');
+            put_scaled(out, L.qty);
+            out.put(' ');
+            put_scaled(out, -L.key);
+        }
+        else
+            out.put(" - -");
+
+        if (i<na)
+        {
+            const BookLevel& L = B->sides[1][i];
+            out.put(' ');
+            put_scaled(out, L.key);
+            out.put(' ');
+            put_scaled(out, L.qty);
+        }
+        else
+            out.put(" - -");
+
+        out.put('\n');
+    }
+    out.end_record();
+}
+
+void FixBooks::flush()
+{
+    for (int i=0;i<(int)dirty.size();i++)
+    {
+        snapshot(dirty[i]);
+        dirty[i]->bdirty = false;
+    }
+    dirty.clear();
+}
+
+void FixBooks::msg(const char* p, int len)
+{
+    if (MG.msg_bad(p, len, false))
+    {
+        nbad++;
+        return;
+    }
+
+    view.parse(p, len);
+
+    const char* v;
+    int vlen;
+    if (!view.get(35, v, vlen) || vlen!=1 || (*v!='W' && *v!='X'))
+        return;
+
+    bool bsnap = *v=='W';
+    nmsgs++;
+
+    // snapshots due before this msg go out under the time of the msg before
+
+    const char* st;
+    int nst;
+    if (!view.get(52, st, nst))
+        nst = 0;
+
+    if (interval)
+    {
+        long long t;
+        if (nst && fix_parse_timestamp(st, nst, t))
+        {
+            if (t>=tnext)
+            {
+                if (tnext)
+                    flush();
+                tnext = (t/interval+1)*interval;
+            }
+        }
+    }
+
+    nst = min(nst, (int)sizeof(stime)-1);
+    memcpy(stime, st, nst);
+    stime[nst] = 0;
+
+    // symbol for the whole msg [W, and X from venues that send it in the body], or per entry
+
+    Book* B = NULL;
+    int i268 = view.find(268);
+    int i55 = view.find(55);
+    if (i55>=0 && (i268<0 || i55<i268))
+        B = book(view.value(i55), view.flds[i55].vlen);
+
+    if (bsnap && B)
+    {
+        B->sides[0].clear();
+        B->sides[1].clear();
+        if (!B->bdirty)
+        {
+            B->bdirty = true;
+            dirty.push_back(B);
+        }
+    }
+
+    int nreps = view.group_reps(i268, starts);
+    for (int r=0;r<nreps;r++)
+    {
+        int iend = r+1<nreps ? starts[r+1] : view.nflds-1;
+
+        int action = bsnap ? MDUPDATE_NEW : MDUPDATE_CHANGE;
+        int side = -1;
+        FixDecimal d;
+        long long px = 0, qty = 0, pos = 0;
+        bool bpx = false, bqty = false;
+
+        for (int i=starts[r]; i<iend; i++)
+        {
+            const char* fv = view.value(i);
+            int fn = view.flds[i].vlen;
+
+            switch (view.flds[i].tag)
+            {
+            case 279:
+                if (!bsnap && fn==1)
+                    action = *fv-'0';
+                break;
+            case 269:
+                if (fn==1 && (*fv=='0' || *fv=='1'))
+                    side = *fv-'0';
+                break;
+            case 270:
+                if (!bpx && (bpx = fix_parse_decimal(fv, fn, d)))
+                    px = d.at_scale(PXPLACES);
+                break;
+            case 271:
+                if (!bqty && (bqty = fix_parse_decimal(fv, fn, d)))
+                    qty = d.at_scale(PXPLACES);
+                break;
+            case 290:
+                fix_parse_int(fv, fn, pos);
+                break;
+            case 55:
+                if (!bsnap)
+                    B = book(fv, fn);
+                break;
+            }
+        }
+
+        // entries without their own symbol are for the one before [first of each field counts]
+
+        if (side<0 || !B)
+            continue;
+
+        apply(B, action, side, px, bpx, qty, (int)pos);
+    }
+
+    if (!interval)
+        flush();
+}
+
+void FixBooks::save(FixCheckpoint& ck)
+{
+    // counts and window, each book with its levels, and the books not yet snapshot in order
+
+    ck.clear();
+    ck.line("counts");
+    ck.add(nmsgs);
+    ck.add(nentries);
+    ck.add(nbad);
+    ck.add(tnext);
+    ck.add(stime, strlen(stime));
+
+    for (int i=0;i<(int)books.size();i++)
+    {
+        Book* B = books[i];
+        ck.line("book");
+        ck.add(B->symbol);
+
+        for (int s=0;s<2;s++)
+        {
+            ck.line(s ? "offers" : "bids");
+            for (int l=0;l<(int)B->sides[s].size();l++)
+            {
+                ck.add(B->sides[s][l].key);
+                ck.add(B->sides[s][l].qty);
+            }
+        }
+    }
+
+    ck.line("dirty");
+    for (int i=0;i<(int)dirty.size();i++)
+        ck.add(dirty[i]->symbol);
+}
+
+bool FixBooks::restore(FixCheckpoint& ck)
+{
+    Book* B = NULL;
+    while (ck.next_line())
+    {
+        if (ck.is("counts"))
+        {
+            nmsgs    = ck.get_int(1);
+            nentries = ck.get_int(2);
+            nbad     = ck.get_int(3);
+            tnext    = ck.get_int(4);
+
+            int n = min((int)ck.get(5).length(), (int)sizeof(stime)-1);
+            memcpy(stime, ck.get(5).data(), n);
+            stime[n] = 0;
+        }
+        else if (ck.is("book"))
+            B = book(ck.get(1).data(), ck.get(1).length());
+        else if ((ck.is("bids") || ck.is("offers")) && B)
+        {
+            vector<BookLevel>& side = B->sides[ck.is("offers")];
+            for (int i=1;i+1<(int)ck.toks.size();i+=2)
+            {
+                BookLevel L = { ck.get_int(i), ck.get_int(i+1) };
+                side.push_back(L);
+            }
+        }
+        else if (ck.is("dirty"))
+        {
+            for (int i=1;i<(int)ck.toks.size();i++)
+            {
+                Book* D = book(ck.get(i).data(), ck.get(i).length());
+                D->bdirty = true;
+                dirty.push_back(D);
+            }
+        }
+        else
+            return false;
+    }
+    last = NULL;
+    return true;
+}
+
+void FixBooks::run(int fd, int delims, FixCheckpoint* ck)
+{
+    FixFramer framer;
+    framer.delims = delims;
+    framer.base = ck ? ck->offset : 0;
+    while (!framer.beof)
+    {
+        {
+            FIX_STAGE(STAGE_READ);
+            char* p = framer.space();
+            int r = read(fd, p, framer.avail());
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+                framer.beof = true;
+            else
+                framer.commit(r);
+            FIX_COUNT(COUNT_BYTES_IN, r>0 ? r : 0);
+        }
+
+        const char* p;
+        int len;
+        long long off;
+        while (true)
+        {
+            {
+                FIX_STAGE(STAGE_FIND);
+                if (!framer.next(p, len, off))
+                    break;
+            }
+            FIX_COUNT(COUNT_MSGS, 1);
+            FIX_COUNT(COUNT_MSG_BYTES, len);
+            msg(p, len);
+
+            if (ck && ck->tick())
+            {
+                save(*ck);
+                ck->save(off+framer.rawlen, out);
+            }
+        }
+    }
+
+    flush();
+    out.flush();
+}
@@ -0,0 +1,86 @@
+//
+//  fixbook.h - price level order books from market data : W snapshots and X incremental refreshes
+//
+//      each NoMDEntries repeat [MDUpdateAction 279, MDEntryType 269, MDEntryPx 270, MDEntrySize 271,
+//      MDEntryPositionNo 290, Symbol 55] is applied to its symbols book - bids [269=0] and offers [269=1],
+//      other entry types are skipped
+//
+//      a side is a sorted array of levels, best first - lookups by binary search, inserts and deletes move
+//      the levels below, which near the top of the book is a short memmove
+//
+//      books touched since the last snapshot are written as one line per level, best first, to the depth asked -
+//
+//          time symbol level bidqty bid ask askqty         [- for an empty side]
+//
+//      after each msg, or every interval of SendingTime
+//
+#ifndef _FIXBOOK_H_
+#define _FIXBOOK_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+struct FixCheckpoint;
+
+
+struct BookLevel
+{
+    long long       key;                // price at PXPLACES, negated for bids so both sides sort ascending
+    long long       qty;                // at PXPLACES
+};
+
+
+struct Book
+{
+    string              symbol;
+    vector<BookLevel>   sides[2];       // bids, offers
+    bool                bdirty;         // on the dirty list
+
+    Book(const char* sym, int n)
+        : symbol(sym, n)
+        , bdirty(false)
+    {
+    }
+};
+
+
+struct FixBooks
+{
+    enum { PXPLACES = 8 };
+
+    MessageGenerator&       MG;
+    OutBuf&                 out;
+    int                     depth;      // levels written per side
+    long long               interval;   // ns of SendingTime between snapshots, 0 after every msg
+
+    vector<Book*>           books;
+    vector<Book*>           hash;       // by symbol, open addressing [power of 2, at most half full]
+    Book*                   last;       // last book looked up [entries mostly run by symbol]
+    vector<Book*>           dirty;      // touched since the last snapshot
+
+    FixMessageView          view;
+    veci                    starts;
+    long long               tnext;      // next snapshot due [SendingTime ns]
+    char                    stime[32];  // SendingTime of the last msg applied, to label snapshots
+
+    long long               nmsgs;      // W and X msgs
+    long long               nentries;   // bid / offer entries applied
+    long long               nbad;       // bad msgs skipped
+
+    FixBooks(MessageGenerator& mg, OutBuf& o, int d, long long ival);
+    ~FixBooks();
+
+    Book*   book(const char* sym, int n);
+    void    apply(Book* B, int action, int side, long long px, bool bpx, long long qty, int pos);
+    void    snapshot(Book* B);
+    void    flush();                                        // snapshot the dirty books
+
+    void    msg(const char* p, int len);
+    void    run(int fd, int delims, FixCheckpoint* ck=NULL);    // msgs from fd, flush at the end
+
+    void    save(FixCheckpoint& ck);                        // state for a checkpoint [fixcheckpoint.h]
+    bool    restore(FixCheckpoint& ck);                     // .. back from one, false if it doesnt parse
+};
+
+#endif //_FIXBOOK_H_
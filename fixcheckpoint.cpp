@@ -0,0 +1,239 @@
+//
+//  fixcheckpoint.cpp - checkpoint and resume for long runs over a log [see fixcheckpoint.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixcheckpoint.h"
+
+
+FixCheckpoint::FixCheckpoint(const char* szfile, long long n, const string& smode)
+    : file(szfile)
+    , every(n)
+    , nnext(n)
+    , mode(smode)
+    , offset(0)
+    , outlen(0)
+    , nmsgs(0)
+    , rpos(0)
+{
+}
+
+void FixCheckpoint::line(const char* key)
+{
+    if (state.size())
+        state.push_back('\n');
+    state.append(key);
+}
+
+void FixCheckpoint::add(long long v)
+{
+    char sz[24];
+    state.push_back(' ');
+    state.append(sz, sprintf(sz, "%lld", v));
+}
+
+void FixCheckpoint::add(const char* v, int n)
+{
+    // tokens are space separated : escape spaces, controls, % and high bytes
+
+    static const char* HEX = "0123456789ABCDEF";
+
+    state.push_back(' ');
+    if (!n)
+        state.append("%-");
+
+    for (int i=0;i<n;i++)
+    {
+        unsigned char c = v[i];
+        if (c<=' ' || c=='%' || c>=127)
+        {
+            state.push_back('%');
+            state.push_back(HEX[c>>4]);
+            state.push_back(HEX[c&15]);
+        }
+        else
+            state.push_back(c);
+    }
+}
+
+static int hex_digit(char c)
+{
+    if (c>='0' && c<='9')
+        return c-'0';
+    if (c>='A' && c<='F')
+        return c-'A'+10;
+    return 0;
+}
+
+bool FixCheckpoint::next_line()
+{
+    toks.clear();
+    while (rpos<state.size() && toks.empty())
+    {
+        size_t e = state.find('\n', rpos);
+        if (e==string::npos)
+            e = state.size();
+
+        for (size_t a=rpos; a<e; )
+        {
+            size_t b = state.find(' ', a);
+            if (b==string::npos || b>e)
+                b = e;
+
+            if (b>a)
+            {
+                toks.push_back("");
+                string& t = toks.back();
+                for (size_t i=a; i<b; i++)
+                {
+                    if (state[i]=='%' && i+1<b && state[i+1]=='-')
+                        i++;
+                    else if (state[i]=='%' && i+2<b)
+                    {
+                        t.push_back((char)(hex_digit(state[i+1])<<4 | hex_digit(state[i+2])));
+                        i += 2;
+                    }
+                    else
+                        t.push_back(state[i]);
+                }
+            }
+            a = b+1;
+        }
+        rpos = e+1;
+    }
+    return toks.size()>0;
+}
+
+const string& FixCheckpoint::get(int i) const
+{
+    static const string none;
+    return i<(int)toks.size() ? toks[i] : none;
+}
+
+bool FixCheckpoint::save(long long upto, OutBuf& out)
+{
+    // everything before upto is in the output before the checkpoint says so
+
+    out.flush();
+    fflush(stdout);
+
+    struct stat st;
+    outlen = -1;
+    if (0==fstat(1, &st) && S_ISREG(st.st_mode))
+        outlen = ftello(stdout);
+
+    offset = upto;
+    nnext = nmsgs + every;
+
+    string tmp = file + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Cant write checkpoint [%s]\n", tmp.c_str());
+        return false;
+    }
+
+    fprintf(fp, "fixtr checkpoint 1\n");
+    fprintf(fp, "mode %s\n", mode.c_str());
+    fprintf(fp, "offset %lld\n", offset);
+    fprintf(fp, "outlen %lld\n", outlen);
+    fprintf(fp, "msgs %lld\n", nmsgs);
+    fprintf(fp, "state\n");
+    fwrite(state.data(), 1, state.size(), fp);
+    fprintf(fp, "\n");
+
+    bool bok = 0==fflush(fp) && 0==fsync(fileno(fp));
+    bok = 0==fclose(fp) && bok;
+    if (!bok || rename(tmp.c_str(), file.c_str()))
+    {
+        fprintf(stderr, "Cant write checkpoint [%s]\n", file.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FixCheckpoint::load()
+{
+    FILE* fp = fopen(file.c_str(), "r");
+    if (!fp)
+        return false;
+
+    string s;
+    char buf[1<<16];
+    int n;
+    while ((n=fread(buf, 1, sizeof(buf), fp))>0)
+        s.append(buf, n);
+    fclose(fp);
+
+    // header lines, up to state
+
+    map<string, string> hdr;
+    size_t a = 0;
+    while (a<s.size())
+    {
+        size_t e = s.find('\n', a);
+        if (e==string::npos)
+            e = s.size();
+
+        string ln = s.substr(a, e-a);
+        a = e+1;
+        if (ln=="state")
+            break;
+
+        size_t sp = ln.find(' ');
+        hdr[ln.substr(0, sp)] = sp==string::npos ? "" : ln.substr(sp+1);
+    }
+
+    if (hdr["fixtr"]!="checkpoint 1" || hdr["offset"].empty() || hdr["msgs"].empty())
+        fprintf(stderr, "Not a fixtr checkpoint [%s]\n", file.c_str()), exit(-1);
+
+    if (hdr["mode"]!=mode)
+        fprintf(stderr, "Checkpoint [%s] is for another run [%s]\n", file.c_str(), hdr["mode"].c_str()), exit(-1);
+
+    offset = atoll(hdr["offset"].c_str());
+    outlen = atoll(hdr["outlen"].c_str());
+    nmsgs  = atoll(hdr["msgs"].c_str());
+    nnext  = nmsgs + every;
+
+    state = a<s.size() ? s.substr(a) : "";
+    rpos = 0;
+    return true;
+}
+
+void FixCheckpoint::resume(int fdin)
+{
+    if (lseek(fdin, offset, SEEK_SET)!=offset)
+        fprintf(stderr, "Cant resume, input doesnt seek to %lld [use --input=file or < file]\n", offset), exit(-1);
+
+    // output written since the checkpoint is written again, so cut it off
+
+    struct stat st;
+    if (outlen>=0 && 0==fstat(1, &st) && S_ISREG(st.st_mode))
+    {
+        if (st.st_size < outlen)
+            fprintf(stderr, "Resuming, output has %lld bytes of the %lld before the checkpoint [append to it with >>]\n",
+                (long long)st.st_size, outlen);
+        else if (ftruncate(1, outlen) || lseek(1, outlen, SEEK_SET)<0)
+            fprintf(stderr, "Cant cut output back to %lld bytes\n", outlen), exit(-1);
+    }
+
+    fprintf(stderr, "Resuming from [%s] at offset %lld, %lld msgs\n", file.c_str(), offset, nmsgs);
+}
+
+void FixCheckpoint::done()
+{
+    unlink(file.c_str());
+}
@@ -0,0 +1,69 @@
+//
+//  fixcheckpoint.h - checkpoint and resume for long runs over a log : where the input was up to, and the state built from it
+//
+//      every N msgs the run flushes its output and writes the checkpoint - input offset [at a msg boundary], output
+//      length, and the state of the mode as lines of tokens - to file.tmp, then renames it over file, so a checkpoint
+//      is always whole
+//
+//          fixtr checkpoint 1
+//          mode <options of the run>
+//          offset 123456789
+//          outlen 456789012                [-1 output not a file]
+//          msgs 1000000
+//          state
+//          <mode lines : key value ..>     [values escaped %XX, empty as %-]
+//
+//      resume seeks the input to the offset, cuts the output back to its length then [output should be opened >>],
+//      and the mode restores its state - a resumed run writes what the whole run would have
+//
+//      the checkpoint is removed once the run completes
+//
+#ifndef _FIXCHECKPOINT_H_
+#define _FIXCHECKPOINT_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+struct FixCheckpoint
+{
+    string          file;
+    long long       every;              // msgs between checkpoints
+    long long       nnext;              // msgs at the next one
+
+    // as of the last checkpoint saved or loaded
+
+    string          mode;               // options of the run, a resume must match
+    long long       offset;             // input consumed
+    long long       outlen;             // output written, -1 if not a file
+    long long       nmsgs;              // msgs framed
+
+    // state lines of the mode - written a line at a time, read back a line at a time
+
+    string          state;
+    size_t          rpos;
+    vector<string>  toks;               // the line read
+
+    FixCheckpoint(const char* szfile, long long n, const string& smode);
+
+    bool    tick()                      { return ++nmsgs >= nnext; }    // one more msg framed - true when one is due
+
+    void    line(const char* key);
+    void    add(long long v);
+    void    add(const char* v, int n);
+    void    add(const string& v)        { add(v.data(), v.length()); }
+
+    bool    next_line();                // the next state line into toks, false at the end
+    bool    is(const char* key) const   { return toks.size() && toks[0]==key; }
+    long long get_int(int i) const      { return i<(int)toks.size() ? atoll(toks[i].c_str()) : 0; }
+    const string& get(int i) const;
+
+    bool    save(long long upto, OutBuf& out);          // with state as filled since clear() - flushes out and stdout first
+    void    clear()                     { state.clear(); }
+
+    bool    load();                     // false if there is no checkpoint, exits if it doesnt parse or is for another run
+    void    resume(int fdin);           // seek fdin to offset, cut stdout back to outlen - exits if the input cant seek
+    void    done();                     // run complete, remove the checkpoint
+};
+
+#endif //_FIXCHECKPOINT_H_
@@ -7,14 +7,21 @@
 //      trace & validate FIX messages based on metadata from FIXn.n.xml spec read in
 //
 #include <stdlib.h>
+#include <ctype.h>
 #include <cstring>
+#include <time.h>
+#include <climits>
 #include <cassert>
 #include <vector>
 #include <map>
 #include <string>
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <libxml/parser.h>
 #include "fixcore.h"
@@ -22,15 +29,10 @@
 
 string fix_time_now()
 {
-    char buff[64];
+    static thread_local FixClock clock(3);
 
-    time_t t = time(NULL);
-    struct tm now;
-    localtime_r(&t, &now);
-    
-    strftime(buff, 64, "%Y%m%d-%H:%M:%S", &now);
-
-    return string(buff);
+    char buff[32];
+    return string(buff, clock.stamp(buff));
 }
 
 string fix_checksum(const char* sz, int len)
@@ -46,29 +48,808 @@ string fix_checksum(const char* sz, int len)
     return string(buf);
 }
 
-string int_to_string(int n)
+string int_to_string(int n)
+{
+    char buff[12];
+    snprintf(buff, 12, "%d", n);
+    return string(buff);
+}
+
+void trace_raw_fix(const char* sz, const char* msg, int len)
+{
+    // len -1 for the rest of a nul terminated line
+
+    const int BUFLEN=4096;
+
+    char buf[BUFLEN];
+    if (len<0 || len>=BUFLEN)
+        len = BUFLEN-1;
+    strncpy(buf, sz, len);
+    buf[len]=0;
+    
+    int n = strlen(buf);
+    for(int i=0;i<n;i++)
+        if (buf[i]==0x01)
+            buf[i]='|';
+
+    fprintf(stderr, "%s%s\n", msg, buf);
+}
+
+int fix_msg_length(const char* sz, int len)
+{
+    // length of the fix msg starting at sz, from BeginString and BodyLength :
+    //      8=FIX.n.n^9=nnn^ <nnn bytes of body> 10=nnn^
+    // no scan of the body, we jump straight to the trailer and check it is there
+    // returns 0 if more bytes are needed, -1 if sz doesnt start a well formed msg
+
+    const int MAXHEAD = 40;                 // "8=FIXT.1.1^9=nnnnnnnn^" and then some
+    const int MAXBODY = 1<<24;
+
+    if (len<2)
+        return (len==0 || sz[0]=='8') ? 0 : -1;
+    if (sz[0]!='8' || sz[1]!='=')
+        return -1;
+
+    const char* pend = sz + min(len, MAXHEAD);
+
+    const char* p = (const char*)memchr(sz+2, 0x01, pend-(sz+2));
+    if (!p)
+        return len<MAXHEAD ? 0 : -1;
+    p++;
+
+    if (p+2 > pend)
+        return len<MAXHEAD ? 0 : -1;
+    if (p[0]!='9' || p[1]!='=')
+        return -1;
+    p+=2;
+
+    int nbody = 0;
+    for (;p<pend && *p>='0' && *p<='9';p++)
+    {
+        nbody = nbody*10 + (*p-'0');
+        if (nbody>MAXBODY)
+            return -1;
+    }
+    if (p==pend)
+        return len<MAXHEAD ? 0 : -1;
+    if (*p!=0x01)
+        return -1;
+    p++;
+
+    int total = (p-sz) + nbody + 7;
+    if (total > len)
+        return 0;
+
+    const char* ptrl = sz+total-7;
+    if (0!=memcmp(ptrl, "10=", 3) || ptrl[6]!=0x01)
+        return -1;
+
+    return total;
+}
+
+const char* fix_find_start(const char* p, const char* pend)
+{
+    // next "8=FIX" in p..pend : test 16 positions a step for '8' followed by '=', only then look for FIX
+    // non fix text goes by at memchr speed
+
+#ifdef __SSE2__
+    const __m128i v8  = _mm_set1_epi8('8');
+    const __m128i veq = _mm_set1_epi8('=');
+
+    while (pend-p >= 17)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p+1));
+        unsigned m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, v8), _mm_cmpeq_epi8(b, veq)));
+
+        while (m)
+        {
+            const char* q = p + __builtin_ctz(m);
+            if (pend-q >= 5 && q[2]=='F' && q[3]=='I' && q[4]=='X')
+                return q;
+            m &= m-1;
+        }
+        p += 16;
+    }
+#endif
+
+    while (p < pend && NULL != (p = (const char*)memchr(p, '8', pend-p)))
+    {
+        if (pend-p >= 5 && 0==memcmp(p, "8=FIX", 5))
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+int fix_delim_kind(const char* sz, int len)
+{
+    // what ends BeginString in 8=FIX.n.n? - SOH, or a rendered | or ^A
+
+    const int MAXHEAD = 40;
+
+    for (int i=5;i<len && i<MAXHEAD;i++)
+    {
+        char c = sz[i];
+        if (c==0x01)
+            return FIXDELIM_SOH;
+        if (c=='|')
+            return FIXDELIM_PIPE;
+        if (c=='^')
+            return i+1==len ? 0 : (sz[i+1]=='A' ? FIXDELIM_CARET : -1);
+        if (!isalnum(c) && c!='.')
+            return -1;
+    }
+    return len<MAXHEAD ? 0 : -1;
+}
+
+static int fix_rendered_length(const char* sz, int len, int kind)
+{
+    // as fix_msg_length, with | or ^A for SOH - BodyLength counts each as one byte, so ^A needs the body walked
+
+    const int MAXHEAD = 40;
+    const int MAXBODY = 1<<24;
+
+    const char* d  = kind==FIXDELIM_PIPE ? "|" : "^A";
+    int         nd = kind==FIXDELIM_PIPE ? 1 : 2;
+
+    const char* pend = sz+len;
+    const char* phead = sz + min(len, MAXHEAD);
+
+    const char* p = sz+5;
+    while (p<phead && *p!=d[0])
+        p++;
+    if (p+nd+2 > phead)
+        return len<MAXHEAD ? 0 : -1;
+    p += nd;
+    if (p[0]!='9' || p[1]!='=')
+        return -1;
+    p += 2;
+
+    int nbody = 0;
+    for (;p<phead && *p>='0' && *p<='9';p++)
+    {
+        nbody = nbody*10 + (*p-'0');
+        if (nbody>MAXBODY)
+            return -1;
+    }
+    if (p+nd > phead)
+        return len<MAXHEAD ? 0 : -1;
+    if (0!=memcmp(p, d, nd))
+        return -1;
+    p += nd;
+
+    if (nd==1)
+        p += nbody;
+    else
+    {
+        for (int i=0;i<nbody && p<pend;i++)
+            p += (p+1<pend && p[0]=='^' && p[1]=='A') ? 2 : 1;
+    }
+
+    if (p+6+nd > pend)
+        return 0;
+    if (0!=memcmp(p, "10=", 3) || 0!=memcmp(p+6, d, nd))
+        return -1;
+
+    return p+6+nd - sz;
+}
+
+int fix_candidate_length(const char* sz, int len, int delims, int& kind)
+{
+    // fix_msg_length of the candidate at sz, for whichever of the delimiters in delims it uses
+
+    kind = FIXDELIM_SOH;
+    if (delims==FIXDELIM_SOH)
+        return fix_msg_length(sz, len);
+
+    kind = fix_delim_kind(sz, len);
+    if (kind<=0)
+        return kind;
+    if (!(kind & delims))
+        return -1;
+
+    return kind==FIXDELIM_SOH ? fix_msg_length(sz, len) : fix_rendered_length(sz, len, kind);
+}
+
+int fix_normalize(char* sz, int len, int kind)
+{
+    // rendered delimiters back to SOH in place, so the checksum and tracing see the msg as sent
+    // ^A shrinks the msg, the bytes freed at the end are blanked
+
+    if (kind==FIXDELIM_PIPE)
+    {
+        for (int i=0;i<len;i++)
+            if (sz[i]=='|')
+                sz[i]=0x01;
+        return len;
+    }
+
+    if (kind!=FIXDELIM_CARET)
+        return len;
+
+    int j=0;
+    for (int i=0;i<len;i++)
+    {
+        if (sz[i]=='^' && i+1<len && sz[i+1]=='A')
+        {
+            sz[j++]=0x01;
+            i++;
+        }
+        else
+            sz[j++]=sz[i];
+    }
+    memset(sz+j, ' ', len-j);
+    return j;
+}
+
+int fix_frame_next(const char* p, int n, bool beof, bool blines, int& off, int& len, int& used, int delims)
+{
+    // next msg in p[0..n) : from 8=FIX jump to the trailer by BodyLength, bytes before it [log text, newlines] are skipped
+    // returns the FIXDELIM_x kind of the msg at p+off for len bytes [normalize it first if not SOH],
+    // or 0 if more bytes are needed [beof : none left] - either way p[0..used) is done with
+    //
+    // blines : text logs - if BodyLength doesnt lead to a trailer [hand edited, | delimiters] the candidate is the
+    //          rest of the line as it always was, msg_bad has the last word, and we only move on past the 8=FIX
+
+    const int MAXLINE = 1<<24;
+
+    int s = 0;
+    while (true)
+    {
+        const char* q = fix_find_start(p+s, p+n);
+        if (!q)
+        {
+            used = beof ? n : max(s, n-4);              // keep a tail that could start "8=FIX"
+            return 0;
+        }
+        s = q-p;
+
+        int kind;
+        int nmsg = fix_candidate_length(q, n-s, delims, kind);
+        if (nmsg>0)
+        {
+            off  = s;
+            len  = nmsg;
+            used = s+nmsg;
+            return kind;
+        }
+
+        if (nmsg==0 && !beof)
+        {
+            used = s;
+            return 0;
+        }
+
+        if (!blines)
+        {
+            s++;                                        // resync
+            continue;
+        }
+
+        const char* nl = (const char*)memchr(q, '\n', n-s);
+        if (!nl && !beof && n-s < MAXLINE)
+        {
+            used = s;
+            return 0;
+        }
+
+        off  = s;
+        len  = strnlen(q, (nl ? nl : p+n) - q);
+        used = s+5;
+        return (kind>0 && (kind & delims)) ? kind : FIXDELIM_SOH;
+    }
+}
+
+
+// FixMessageView
+
+
+int FixMessageView::parse(const char* z, int n)
+{
+    // one pass : <tag>=<value>^ ... stopping at anything that isnt a field [as FixReader::next]
+
+    FIX_STAGE(STAGE_TOKENIZE);
+
+    for (int i=0;i<nflds;i++)
+        if (flds[i].tag>=0 && flds[i].tag<NTAGS)
+            first[flds[i].tag] = -1;
+
+    sz    = z;
+    len   = n;
+    nflds = 0;
+    nend  = 0;
+
+    const char* pmax = z+n;
+    const char* p    = z;
+
+    while (pmax-p > 2)
+    {
+        const char* peqs = (const char*)memchr(p, '=', pmax-p);
+        if (!peqs)
+            break;
+        const char* psoh = (const char*)memchr(peqs+1, 0x01, pmax-(peqs+1));
+        if (!psoh)
+            break;
+
+        if (nflds == (int)flds.size())
+            flds.resize(flds.size()*2 + 64);
+
+        FixField& f = flds[nflds];
+        f.toff = p-z;
+        f.tlen = peqs-p;
+        f.voff = peqs+1-z;
+        f.vlen = psoh-(peqs+1);
+
+        int tag = 0;
+        for (const char* t=p; t<peqs; t++)
+        {
+            if (*t<'0' || *t>'9' || tag>=100000000)
+            {
+                tag = -1;
+                break;
+            }
+            tag = tag*10 + (*t-'0');
+        }
+        if (f.tlen==0 || (f.tlen>1 && *p=='0'))
+            tag = -1;                               // only the text a spec id could match
+        f.tag = tag;
+
+        if (tag>=0 && tag<NTAGS && first[tag]<0)
+            first[tag] = nflds;
+
+        nflds++;
+        p = psoh+1;
+    }
+
+    nend = p-z;
+    FIX_COUNT(COUNT_FIELDS, nflds);
+    return nflds;
+}
+
+int FixMessageView::find(int tag, int from) const
+{
+    if (tag>=0 && tag<NTAGS)
+    {
+        int i = first[tag];
+        if (i<0)
+            return -1;
+        if (i>=from)
+            return i;
+        from = i+1;
+    }
+
+    for (int i=from;i<nflds;i++)
+        if (flds[i].tag==tag)
+            return i;
+    return -1;
+}
+
+bool FixMessageView::get(int tag, const char*& val, int& vlen) const
+{
+    int i = find(tag);
+    if (i<0)
+        return false;
+
+    val  = sz+flds[i].voff;
+    vlen = flds[i].vlen;
+    return true;
+}
+
+string FixMessageView::get(int tag) const
+{
+    int i = find(tag);
+    return i<0 ? "" : string(sz+flds[i].voff, flds[i].vlen);
+}
+
+int FixMessageView::group_reps(int icount, veci& starts) const
+{
+    // each repeat starts with the same tag as the field after the count, up to count repeats
+    // without the spec we cant say where the last one ends - the tracer knows, from the spec
+
+    starts.clear();
+
+    if (icount<0 || icount+1>=nflds)
+        return 0;
+
+    int nreps = atoi(sz+flds[icount].voff);
+    int delim = flds[icount+1].tag;
+
+    for (int i=icount+1; i<nflds && (int)starts.size()<nreps; i++)
+        if (flds[i].tag==delim)
+            starts.push_back(i);
+
+    return starts.size();
+}
+
+
+// rewriting
+
+
+static inline unsigned byte_sum(const char* p, int n)
+{
+    unsigned sum = 0;
+    for (int i=0;i<n;i++)
+        sum += (unsigned char)p[i];
+    return sum;
+}
+
+int fix_rewrite(const FixMessageView& V, const FixEdit* edits, int nedits, string& out)
+{
+    // copy the msg across field by field, swapping in edited values -
+    // new BodyLength and CheckSum are the old ones plus what changed, nothing else is re-summed
+
+    int n = V.nflds;
+    if (n<3 || V.flds[0].tag!=8 || V.flds[1].tag!=9 || V.flds[n-1].tag!=10 || V.nend!=V.len)
+        return -1;
+
+    long long cks;
+    if (!fix_parse_int(V.value(n-1), V.flds[n-1].vlen, cks))
+        return -1;
+
+    int nstart = out.length();
+    unsigned sum = cks;
+
+    // 8= as is, 9= filled in once the body is done
+
+    const FixField& f9 = V.flds[1];
+    out.append(V.sz, f9.voff);
+    sum -= byte_sum(V.value(1), f9.vlen);
+
+    int nlen = out.length();
+    out.append(10, '0');                            // room for the widest BodyLength
+    out.push_back(0x01);
+
+    int nbody = out.length();
+    int ie = 0;
+    for (int i=2;i<n-1;i++)
+    {
+        const FixField& f = V.flds[i];
+
+        if (ie<nedits && edits[ie].ifld==i)
+        {
+            const FixEdit& E = edits[ie++];
+            if (!E.val)
+            {
+                sum -= byte_sum(V.sz+f.toff, f.voff+f.vlen+1-f.toff);
+                continue;
+            }
+
+            out.append(V.sz+f.toff, f.voff-f.toff);
+            out.append(E.val, E.vlen);
+            out.push_back(0x01);
+
+            sum -= byte_sum(V.value(i), f.vlen);
+            sum += byte_sum(E.val, E.vlen);
+            continue;
+        }
+
+        out.append(V.sz+f.toff, f.voff+f.vlen+1-f.toff);
+    }
+
+    // BodyLength into its slot, shifting the body back over the unused room
+
+    char sz[16];
+    int nd = snprintf(sz, sizeof(sz), "%d", (int)(out.length()-nbody));
+    sum += byte_sum(sz, nd);
+
+    out.replace(nlen, 10, sz, nd);
+
+    char sck[8];
+    snprintf(sck, sizeof(sck), "10=%03u", sum%256);
+    out.append(sck, 6);
+    out.push_back(0x01);
+
+    return out.length()-nstart;
+}
+
+
+// FixClock
+
+
+static inline long long clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+FixClock::FixClock(int ndigits)
+    : digits(ndigits)
+    , base_real(0)
+    , base_mono(0)
+    , last(0)
+    , minute(-1)
+{
+    prefix[0] = 0;
+}
+
+long long FixClock::now()
+{
+    long long mono = clock_ns(CLOCK_MONOTONIC);
+
+    if (!base_mono || mono-base_mono >= RESYNC_NS)
+    {
+        base_real = clock_ns(CLOCK_REALTIME);
+        base_mono = mono;
+    }
+
+    long long t = base_real + (mono-base_mono);
+    if (t < last)
+        t = last;                                   // realtime stepped back at a resync - hold until it catches up
+    last = t;
+    return t;
+}
+
+int FixClock::format(long long ns, char* p)
+{
+    // YYYYMMDD-HH:MM:SS[.fff[fff[fff]]]
+
+    long long secs = ns/1000000000;
+    long long frac = ns%1000000000;
+
+    if (ns < minute || ns >= minute + 60*1000000000LL)
+    {
+        time_t t = secs - secs%60;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(prefix, sizeof(prefix), "%Y%m%d-%H:%M:", &tm);
+        minute = (long long)t*1000000000;
+    }
+
+    memcpy(p, prefix, 15);
+
+    int s = secs%60;
+    p[15] = '0' + s/10;
+    p[16] = '0' + s%10;
+
+    if (!digits)
+        return 17;
+
+    p[17] = '.';
+    for (int i=9;i>digits;i--)
+        frac /= 10;
+    for (int i=digits;i>0;i--)
+    {
+        p[17+i] = '0' + frac%10;
+        frac /= 10;
+    }
+    return 18+digits;
+}
+
+
+// typed values
+
+
+int fix_value_type(const char* sztype)
+{
+    static const char* ints[]   = { "INT", "LENGTH", "NUMINGROUP", "SEQNUM", "TAGNUM", "DAYOFMONTH", NULL };
+    static const char* floats[] = { "FLOAT", "PRICE", "QTY", "AMT", "PRICEOFFSET", "PERCENTAGE", NULL };
+
+    if (!sztype)
+        return VTYPE_ANY;
+
+    for (int i=0;ints[i];i++)
+        if (0==strcmp(sztype, ints[i]))
+            return VTYPE_INT;
+    for (int i=0;floats[i];i++)
+        if (0==strcmp(sztype, floats[i]))
+            return VTYPE_FLOAT;
+    if (0==strcmp(sztype, "CHAR"))
+        return VTYPE_CHAR;
+    if (0==strcmp(sztype, "BOOLEAN"))
+        return VTYPE_BOOL;
+    if (0==strcmp(sztype, "UTCTIMESTAMP"))
+        return VTYPE_TIMESTAMP;
+
+    return VTYPE_ANY;
+}
+
+bool fix_parse_int(const char* v, int n, long long& val)
+{
+    // [-]digits, up to 19 of them [no overflow in unsigned], then in range of a long long
+
+    bool bneg = n>0 && v[0]=='-';
+    int i = bneg ? 1 : 0;
+    if (i==n || n-i>19)
+        return false;
+
+    unsigned long long x = 0;
+    for (;i<n;i++)
+    {
+        unsigned d = v[i]-'0';
+        if (d>9)
+            return false;
+        x = x*10 + d;
+    }
+
+    if (x > (unsigned long long)LLONG_MAX + bneg)
+        return false;
+
+    val = bneg ? -(long long)(x-1)-1 : (long long)x;
+    return true;
+}
+
+bool fix_parse_decimal(const char* v, int n, FixDecimal& val)
+{
+    // [-]digits[.digits] - the digits as one integer, scale is the places after the point
+
+    int i = (n>0 && v[0]=='-') ? 1 : 0;
+
+    long long x = 0;
+    int ndigits = 0;
+    int scale = -1;
+    for (;i<n;i++)
+    {
+        unsigned d = v[i]-'0';
+        if (d<=9)
+        {
+            if (x==0 && d==0 && scale<0)
+                continue;                           // leading zeros dont count against the 18
+            if (++ndigits>18)
+                return false;
+            x = x*10 + d;
+            if (scale>=0)
+                scale++;
+        }
+        else if (v[i]=='.' && scale<0)
+            scale = 0;
+        else
+            return false;
+    }
+
+    // at least one digit [leading zeros were digits too]
+
+    if (ndigits==0 && (n==0 || !memchr(v, '0', n)))
+        return false;
+
+    val.mant  = v[0]=='-' ? -x : x;
+    val.scale = scale<0 ? 0 : scale;
+    return true;
+}
+
+long long FixDecimal::at_scale(int places) const
+{
+    static const long long pow10[] = { 1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL,
+        1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL, 100000000000000LL,
+        1000000000000000LL, 10000000000000000LL, 100000000000000000LL, 1000000000000000000LL };
+
+    // saturates rather than wrap, if mant wont fit at that many places
+
+    int k = places-scale;
+    if (k<0)
+        return -k<=18 ? mant/pow10[-k] : 0;
+
+    if (mant==0)
+        return 0;
+    if (k>18 || (mant<0 ? -mant : mant) > LLONG_MAX/pow10[k])
+        return mant<0 ? LLONG_MIN : LLONG_MAX;
+    return mant*pow10[k];
+}
+
+static inline bool digits(const char* p, int n, int& val)
+{
+    val = 0;
+    for (int i=0;i<n;i++)
+    {
+        unsigned d = p[i]-'0';
+        if (d>9)
+            return false;
+        val = val*10 + d;
+    }
+    return true;
+}
+
+static long long days_from_civil(int y, int m, int d)
+{
+    // days since 1970-01-01 of a proleptic gregorian date [H. Hinnant's algorithm]
+
+    y -= m<=2;
+    int era = (y>=0 ? y : y-399)/400;
+    int yoe = y - era*400;
+    int doy = (153*(m + (m>2 ? -3 : 9)) + 2)/5 + d-1;
+    int doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return (long long)era*146097 + doe - 719468;
+}
+
+bool fix_parse_timestamp(const char* v, int n, long long& nanos)
+{
+    // YYYYMMDD-HH:MM:SS then optional .fraction [ms, us, ns, or ps truncated to ns]
+
+    int Y, M, D, h, m, s;
+    if (n<17 || v[8]!='-' || v[11]!=':' || v[14]!=':')
+        return false;
+    if (!digits(v, 4, Y) || !digits(v+4, 2, M) || !digits(v+6, 2, D) ||
+        !digits(v+9, 2, h) || !digits(v+12, 2, m) || !digits(v+15, 2, s))
+        return false;
+    if (M<1 || M>12 || D<1 || h>23 || m>59 || s>60)
+        return false;
+
+    static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool bleap = (Y%4==0 && Y%100!=0) || Y%400==0;
+    if (D > mdays[M-1] + (M==2 && bleap))
+        return false;
+
+    long long ns = 0;
+    if (n>17)
+    {
+        int nfrac = n-18;
+        if (v[17]!='.' || nfrac<1 || nfrac>12)
+            return false;
+
+        for (int i=0;i<nfrac;i++)
+        {
+            unsigned d = v[18+i]-'0';
+            if (d>9)
+                return false;
+            if (i<9)
+                ns = ns*10 + d;
+        }
+        for (int i=nfrac;i<9;i++)
+            ns *= 10;
+    }
+
+    nanos = ((days_from_civil(Y, M, D)*24 + h)*60 + m)*60LL + s;
+    nanos = nanos*1000000000LL + ns;
+    return true;
+}
+
+bool fix_decode(int type, const char* v, int n, FixValue& val)
+{
+    val.type = type;
+    switch(type)
+    {
+        case VTYPE_INT:         return fix_parse_int(v, n, val.i);
+        case VTYPE_FLOAT:       return fix_parse_decimal(v, n, val.d);
+        case VTYPE_TIMESTAMP:   return fix_parse_timestamp(v, n, val.i);
+        case VTYPE_CHAR:        val.i = n ? (unsigned char)v[0] : 0; return n==1;
+        case VTYPE_BOOL:        val.i = n ? v[0] : 0; return n==1 && (v[0]=='Y' || v[0]=='N');
+    }
+    return true;
+}
+
+
+// FixFramer
+
+
+char* FixFramer::space(int nmin)
 {
-    char buff[12];
-    snprintf(buff, 12, "%d", n);
-    return string(buff);
+    // move the unframed tail to the front, grow if still short of room
+
+    if (s>0 && (s==e || e+nmin > (int)buf.size()))
+    {
+        memmove(&buf[0], &buf[s], e-s);
+        base += s;
+        e -= s;
+        s = 0;
+    }
+
+    if (e+nmin > (int)buf.size())
+        buf.resize(max((int)buf.size()*2, e+nmin));
+
+    return &buf[e];
 }
 
-void trace_raw_fix(const char* sz, const char* msg="")
+int FixFramer::next(const char*& sz, int& len, long long& offset)
 {
-    const int BUFLEN=4096;
+    int off, used;
+    int ret = fix_frame_next(buf.data()+s, e-s, beof, blines, off, len, used, delims);
 
-    char buf[BUFLEN];
-    strncpy(buf, sz, BUFLEN);
-    buf[BUFLEN-1]=0;
-    
-    int n = strlen(buf);
-    for(int i=0;i<n;i++)
-        if (buf[i]==0x01)
-            buf[i]='|';
+    if (ret)
+    {
+        kind   = ret;
+        rawlen = len;
+        if (ret!=FIXDELIM_SOH)
+            len = fix_normalize(&buf[s+off], len, ret);
 
-    fprintf(stderr, "%s%s\n", msg, buf);
+        sz     = buf.data()+s+off;
+        offset = base+s+off;
+    }
+    s += used;
+    return ret;
 }
 
+
 void print_node_xml(XNode* N, int nindent)
 {
     string sindent(nindent*2, ' ');
@@ -253,19 +1034,38 @@ void spec_parser_end_element(void * ctx, const xmlChar *name)
     pstack->pop_back(); 
 }
 
-XNode* parse_fix_spec_xml(const char* szfile)
+static void spec_parser_quiet(void* ctx, const char* msg, ...)
+{
+}
+
+XNode* parse_fix_spec_xml(const char* szfile, bool bverbose)
 {
+    if (!bverbose)
+    {
+        FILE* fp = fopen(szfile, "r");          // libxml2 reports a missing file on stderr, past the sax handler
+        if (!fp)
+            return NULL;
+        fclose(fp);
+    }
+
     xmlSAXHandlerPtr handler = (xmlSAXHandlerPtr)calloc(1, sizeof(xmlSAXHandler));
     handler->startElement   = spec_parser_start_element;
     handler->endElement     = spec_parser_end_element;
+    if (!bverbose)
+    {
+        handler->warning    = spec_parser_quiet;            // libxml2 would print to stderr
+        handler->error      = spec_parser_quiet;
+        handler->fatalError = spec_parser_quiet;
+    }
 
     vecx    stack;
     XNode*  root = new XNode();
     stack.push_back(root);
 
-    if (xmlSAXUserParseFile(handler, &stack, szfile) < 0) 
+    if (xmlSAXUserParseFile(handler, &stack, szfile) != 0)         // libxml2 errors are > 0, a missing file < 0
     {
-        fprintf(stderr, "ERROR parsing fix spec : %s\n", szfile);
+        if (bverbose)
+            fprintf(stderr, "ERROR parsing fix spec : %s\n", szfile);
         delete root;
         free(handler);
         return NULL;
@@ -273,7 +1073,8 @@ XNode* parse_fix_spec_xml(const char* szfile)
 
     if (0==root->nods.size())
     {
-        fprintf(stderr, "ERROR empty fix spec : %s\n", szfile);
+        if (bverbose)
+            fprintf(stderr, "ERROR empty fix spec : %s\n", szfile);
         delete root;
         free(handler);
         return NULL;
@@ -282,7 +1083,8 @@ XNode* parse_fix_spec_xml(const char* szfile)
     XNode* ndfix = root->nods[0];
 
     string prelude = "FIX." + ndfix->atts["major"] + "." + ndfix->atts["minor"];
-    fprintf(stderr,"%s\n", prelude.c_str());
+    if (bverbose)
+        fprintf(stderr,"%s\n", prelude.c_str());
 
     // unhook from top node, and cleanup
 
@@ -304,6 +1106,13 @@ MessageGenerator::MessageGenerator(XNode* fix)
     : ndfix(fix)
     , nsent(2000)
     , soh(1, 0x01)
+    , xheader(NULL)
+    , xtrailer(NULL)
+    , xmsgs(NULL)
+    , nseenwords(0)
+    , nscopedepth(0)
+    , vheader(NULL)
+    , vtrailer(NULL)
 {
     ndheader = ndfix->child("header");
     ndtrailer= ndfix->child("trailer");
@@ -313,6 +1122,12 @@ MessageGenerator::MessageGenerator(XNode* fix)
 
     prelude = "FIX." + ndfix->atts["major"] + "." + ndfix->atts["minor"];
 
+    // SendingTime ms from FIX 4.2, us from FIX 5
+
+    int major = atoi(ndfix->atts["major"].c_str());
+    int minor = atoi(ndfix->atts["minor"].c_str());
+    clock.digits = major>=5 ? 6 : (major==4 && minor>=2) ? 3 : 0;
+
 
     //ndheader->xtrace();
     //ndtrailer->xtrace();
@@ -364,6 +1179,20 @@ MessageGenerator::MessageGenerator(XNode* fix)
 
 }
 
+MessageGenerator::~MessageGenerator()
+{
+    // expanded specs are ours, ndfix belongs to the caller
+
+    delete xheader;
+    delete xtrailer;
+    delete xmsgs;
+
+    for (int i=0;i<(int)vscopes.size();i++)
+        delete vscopes[i];
+    for (map<string,ValidEnums*>::iterator p=venums.begin();p!=venums.end();p++)
+        delete p->second;
+}
+
 
 int MessageGenerator::gen_spec(XNode* spec, mapss& msg_atts, string& result)
 {
@@ -436,7 +1265,9 @@ int MessageGenerator::gen_msg(string msg_type, mapss& body_atts, string ssource,
     head_atts["SenderCompID"]   = ssource;
     head_atts["TargetCompID"]   = starget;
     head_atts["MsgSeqNum"]      = int_to_string(nsent++);
-    head_atts["SendingTime"]    = fix_time_now();
+
+    char stime[32];
+    head_atts["SendingTime"].assign(stime, clock.stamp(stime));
 
     string shead;
     if (gen_spec(ndheader, head_atts, shead))
@@ -463,21 +1294,27 @@ int MessageGenerator::gen_msg(string msg_type, mapss& body_atts, string ssource,
 }
 
 
-int MessageGenerator::msg_bad(const char* sz, int len)
+int MessageGenerator::msg_bad(const char* sz, int len, bool bverbose)
 {
-    string lhs = "8=" + prelude;
-    if (0!=strncmp(sz, lhs.c_str(), lhs.length()))
-        return printf("FIX msg, but bad FIX version : expecting %s\n", lhs.c_str()), -1;
+    // 8=FIX.n.n^ ... 10=nnn^    [runs on every candidate msg, so compare in place - no temp strings]
+
+    int nprelude = prelude.length();
+
+    if (len<3+nprelude || 0!=strncmp(sz, "8=", 2) || 0!=strncmp(sz+2, prelude.c_str(), nprelude))
+        return bverbose && printf("FIX msg, but bad FIX version : expecting 8=%s\n", prelude.c_str()), -1;
+
+    if (sz[2+nprelude]!=0x01)
+        return bverbose && printf("FIX msg, but bad delimiter\n"), -1;
 
-    lhs = "8=" + prelude + soh;
-    if (0!=strncmp(sz, lhs.c_str(), lhs.length()))
-        return printf("FIX msg, but bad delimiter\n"), -1;
+    unsigned int cks=0;
+    for (int idx=0; idx<len-7; cks+=(unsigned int)sz[idx++]);
+    cks%=256;
 
-    string ssum = fix_checksum(sz, len-7);
+    char ssum[4] = { (char)('0'+cks/100), (char)('0'+cks/10%10), (char)('0'+cks%10), 0 };
 
-    string rhs = "10=" + ssum + soh;
-    if (0!=strncmp(sz+len-rhs.length(), rhs.c_str(), rhs.length()))
-        return printf("FIX msg, but bad checksum : expecting %s\n", ssum.c_str()), -1;
+    const char* prhs = sz+len-7;
+    if (len<7 || 0!=strncmp(prhs, "10=", 3) || 0!=strncmp(prhs+3, ssum, 3) || prhs[6]!=0x01)
+        return bverbose && printf("FIX msg, but bad checksum : expecting %s\n", ssum), -1;
 
     return 0;
 }
@@ -517,6 +1354,14 @@ XNode* MessageGenerator::load_expanded(XNode* src_spec)
         XNode* ch = load_expanded(src_ch);
         spec->nods.push_back(ch);
 
+        // position in parent is the bit for this child in the seen bitset of the parent scope
+
+        ch->slot = spec->nods.size()-1;
+        if (ch->slot/64 >= (int)spec->reqmask.size())
+            spec->reqmask.push_back(0);
+        if (ch->isrequired())
+            spec->reqmask[ch->slot/64] |= 1ULL<<(ch->slot%64);
+
         if (ch->ismessage())
         {
             spec->nodmap[ch->atts["msgtype"]] = ch;
@@ -544,6 +1389,194 @@ XNode* MessageGenerator::load_expanded(XNode* src_spec)
 }
 
 
+static int scope_words(XNode* xspec)
+{
+    // words of seen bitset stack needed by this scope and its deepest nested group
+
+    int nmax = 0;
+    for (vecx::iterator pc=xspec->nods.begin();pc!=xspec->nods.end();pc++)
+        if ((*pc)->isgroup())
+            nmax = max(nmax, scope_words(*pc));
+
+    return 2*xspec->reqmask.size() + nmax;
+}
+
+static int scope_depth(XNode* xspec)
+{
+    // frames needed for this scope and its deepest nested group
+
+    int nmax = 0;
+    for (vecx::iterator pc=xspec->nods.begin();pc!=xspec->nods.end();pc++)
+        if ((*pc)->isgroup())
+            nmax = max(nmax, scope_depth(*pc));
+
+    return 1 + nmax;
+}
+
+void MessageGenerator::expand_specs()
+{
+    // expand header, trailer, and each msg type [replacing components inline, to support misordering of fields]
+
+    if (xmsgs)
+        return;
+
+    xheader  = load_expanded(ndheader);
+    xtrailer = load_expanded(ndtrailer);
+    xmsgs    = load_expanded(ndmsgs);
+
+    xheader->atts["name"]="StandardHeader";
+    xtrailer->atts["name"]="StandardTrailer";
+
+    // tracing needs a frame and seen + repeated bits for each nested scope on the deepest path
+
+    nseenwords  = max(scope_words(xheader), scope_words(xtrailer));
+    nscopedepth = max(scope_depth(xheader), scope_depth(xtrailer));
+    for (vecx::iterator pc=xmsgs->nods.begin();pc!=xmsgs->nods.end();pc++)
+    {
+        nseenwords  = max(nseenwords, scope_words(*pc));
+        nscopedepth = max(nscopedepth, scope_depth(*pc));
+    }
+
+    // and compiled, so the walk doesnt look anything up by name
+
+    vheader  = compile_scope(xheader);
+    vtrailer = compile_scope(xtrailer);
+    for (vecx::iterator pc=xmsgs->nods.begin();pc!=xmsgs->nods.end();pc++)
+        vbodies[(*pc)->att("msgtype")] = compile_scope(*pc);
+}
+
+
+static int tag_number(const char* szid)
+{
+    // spec id as a tag, -1 unless plain decimal [as FixMessageView]
+
+    if (!szid || !*szid || (szid[0]=='0' && szid[1]) || strlen(szid)>9)
+        return -1;
+
+    int tag = 0;
+    for (const char* p=szid;*p;p++)
+    {
+        if (*p<'0' || *p>'9')
+            return -1;
+        tag = tag*10 + (*p-'0');
+    }
+    return tag;
+}
+
+ValidEnums* MessageGenerator::compile_enums(const char* szid, int type)
+{
+    // enum values of a field, shared by every scope its in [NULL if any value goes]
+
+    XNode* xdef = fields[szid];
+    if (!xdef || xdef->nods.empty())
+        return NULL;
+
+    const char* sztype = xdef->att("type");
+    if (sztype && 0==strncmp(sztype, "MULTIPLE", 8))
+        return NULL;                                // space separated lists of enums, not checked
+
+    ValidEnums*& E = venums[szid];
+    if (E)
+        return E;
+
+    E = new ValidEnums();
+    for (vecx::iterator pc=xdef->nods.begin();pc!=xdef->nods.end();pc++)
+    {
+        const char* v = (*pc)->att("enum");
+        if (!v)
+            continue;
+        if (strlen(v)==1)
+            E->chars[(unsigned char)v[0]/64] |= 1ULL<<((unsigned char)v[0]%64);
+        else
+            E->strs.push_back(v);
+    }
+    sort(E->strs.begin(), E->strs.end());
+    return E;
+}
+
+ValidScope* MessageGenerator::compile_scope(XNode* xspec)
+{
+    // the walk program for one expanded scope : a slot per child in spec order [type, enums, nested group],
+    // required mask, and a tag to slot hash with exactly the mapping of xspec->lookup
+
+    ValidScope* vs = new ValidScope();
+    vscopes.push_back(vs);
+
+    vs->xspec   = xspec;
+    vs->bgroup  = xspec->isgroup();
+    vs->reqmask = xspec->reqmask;
+
+    for (vecx::iterator pc=xspec->nods.begin();pc!=xspec->nods.end();pc++)
+    {
+        XNode* ch = *pc;
+
+        ValidSlot s;
+        s.xnode = ch;
+        s.tag   = tag_number(ch->att("id"));
+        s.type  = VTYPE_ANY;
+        s.enums = NULL;
+        s.group = NULL;
+
+        if (ch->isfield() || ch->isgroup())
+        {
+            XNode* xdef = fields[ch->atts["id"]];
+            s.type  = fix_value_type(xdef ? xdef->att("type") : NULL);
+            s.enums = compile_enums(ch->att("id"), s.type);
+        }
+        if (ch->isgroup())
+            s.group = compile_scope(ch);
+
+        vs->slots.push_back(s);
+    }
+
+    // hash at most half full
+
+    unsigned n = 8;
+    while (n < 2*xspec->nodmap.size())
+        n <<= 1;
+
+    ValidHash empty = { -1, -1 };
+    vs->hash.assign(n, empty);
+    vs->hmask = n-1;
+
+    for (mapsx::iterator p=xspec->nodmap.begin();p!=xspec->nodmap.end();p++)
+    {
+        int tag = tag_number(p->first.c_str());
+        if (tag<0)
+            continue;
+
+        unsigned h = ((unsigned)tag*2654435761u)>>16;
+        while (vs->hash[h & vs->hmask].tag>=0)
+            h++;
+
+        vs->hash[h & vs->hmask].tag  = tag;
+        vs->hash[h & vs->hmask].slot = p->second->slot;
+    }
+
+    return vs;
+}
+
+bool ValidEnums::has(const char* v, int n) const
+{
+    if (n==1)
+        return chars[(unsigned char)v[0]/64] & (1ULL<<((unsigned char)v[0]%64));
+
+    int lo=0, hi=strs.size();
+    while (lo<hi)
+    {
+        int mid = (lo+hi)/2;
+        int cmp = strs[mid].compare(0, string::npos, v, n);
+        if (cmp==0)
+            return true;
+        if (cmp<0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+
 void expand_components(mapsx& components, XNode* xmsg)
 {
     // walk the tree, inserting children for field values
@@ -661,139 +1694,340 @@ int MessageGenerator::show_expanded_spec(const char* szmsgtype, mapss& options)
 }
 
 
-void MessageGenerator::trace_fix_xspec(FixReader& fix, XNode* xspec)
+TraceContext::TraceContext(MessageGenerator& MG)
+    : ipos(0)
+    , bstrict(false)
+    , ntop(0)
+    , nframes(0)
 {
-    // trace through the fix fields, comparing with the spec as we go
-    // recurse down through groups and handle group repeats
+    size_for(MG);
+}
+
+void TraceContext::size_for(MessageGenerator& MG)
+{
+    MG.expand_specs();
+
+    words.resize(MG.nseenwords);
+    frames.resize(MG.nscopedepth);
+}
+
+static int last_msgtype(const FixMessageView& view, int nread)
+{
+    // the last 35 of the first nread fields, as FixReader kept the last it read [a header can repeat it]
+
+    for (int i=min(nread, view.nflds)-1;i>=0;i--)
+        if (view.flds[i].tag==35)
+            return i;
+    return -1;
+}
+
+int MessageGenerator::trace_msg(const char* sz, int len, TraceSink& sink, TraceContext& ctx, bool bvalues)
+{
+    // trace one complete fix message : header, body by msg type, trailer
 
-    assert(xspec && xspec->bexpanded);
+    assert(xmsgs);
 
-    mapsi seen;   // we mark each field as seen when it appears in the message [used for checking repeats and missing reqd fields]
+    FIX_STAGE(STAGE_WALK);
 
-    // if a group, we need first group field at start of each repeat
+    ctx.view.parse(sz, len);
+    ctx.ipos = 0;
+    ctx.msgtype.clear();
 
-    string sfirst_in_group;
-    if (xspec->isgroup())
     {
-        sfirst_in_group = xspec->nods[0]->att("id");         // this groups first child has to come first on the fix group repeat
+        FIX_STAGE(STAGE_FORMAT);
+        sink.begin_msg(sz, len);
+    }
 
-        //printf("group starter field %s\n", sfirst_in_group.c_str());
+    sink.begin_scope("header", xheader);
+    walk_xspec(vheader, sink, ctx, bvalues);
+    sink.end_scope(xheader);
 
-        fix.next();
+    // msg type from the header [the field that ended the header was read too]
 
-        if (0!=fix.fld.compare(sfirst_in_group))
+    int i35 = last_msgtype(ctx.view, ctx.ipos+1);
+    if (i35>=0)
+        ctx.msgtype.assign(ctx.view.value(i35), ctx.view.flds[i35].vlen);
+
+    if (!ctx.msgtype.empty())
+    {
+        map<string,ValidScope*>::iterator pb = vbodies.find(ctx.msgtype);
+
+        if (pb!=vbodies.end())
         {
-            // expecting a repeat, saw sthing else
+            XNode* xbody = pb->second->xspec;
 
-            printf("bailing... no group starter field %s\n", sfirst_in_group.c_str());
-            fix.rewind();
-            return;
+            sink.begin_scope("body", xbody);
+            walk_xspec(pb->second, sink, ctx, bvalues);
+            sink.end_scope(xbody);
         }
+        else
+            sink.error(TRACE_BAD_MSGTYPE, NULL, ctx.msgtype);
 
-        printf("\n%s\n", xspec->att("name"));
-
-        XNode* xfield = xspec->lookup(fix.fld.c_str());
-        trace_field_value(xfield, fix.val);
+        sink.begin_scope("trailer", xtrailer);
+        walk_xspec(vtrailer, sink, ctx, bvalues);
+        sink.end_scope(xtrailer);
+    }
 
-        seen[fix.fld]++;
-        //printf("seen %s n=%d\n", fix.fld.c_str(), seen[fix.fld]);
+    {
+        FIX_STAGE(STAGE_FORMAT);
+        sink.end_msg();
     }
 
-    // trace all fields from this xspec as they are read from the fix message [in any order]
+    return ctx.view.end_offset(ctx.ipos);
+}
+
+void MessageGenerator::trace_fix_xspec(FixReader& fix, XNode* xspec, TraceSink* sink)
+{
+    // trace the fix fields of one scope [xspec from expand_specs], human readable by default
+
+    TextTraceSink text(*this);
+    TraceContext ctx(*this);
+
+    ValidScope* vs = NULL;
+    for (int i=0;i<(int)vscopes.size() && !vs;i++)
+        if (vscopes[i]->xspec==xspec)
+            vs = vscopes[i];
+    assert(vs);
+
+    ctx.view.parse(fix.sz+fix.npos, fix.nlen-fix.npos);
+    walk_xspec(vs, sink ? *sink : text, ctx, true);
+
+    // msg type for the caller to pick the body, as FixReader::next would have set it
+
+    int i35 = last_msgtype(ctx.view, ctx.ipos);
+    if (i35>=0)
+        fix.msgtype.assign(ctx.view.value(i35), ctx.view.flds[i35].vlen);
+
+    fix.npos += ctx.view.end_offset(ctx.ipos);
+}
+
+static inline bool next_field(TraceContext& ctx)
+{
+    // step to the next field of the msg view
+
+    if (ctx.ipos >= ctx.view.nflds)
+        return false;
+
+    ctx.ipos++;
+    return true;
+}
+
+static inline const string& field_tag(TraceContext& ctx)
+{
+    // tag text of the current field, for error events
+
+    FixField& f = ctx.view.flds[ctx.ipos-1];
+    ctx.fld.assign(ctx.view.sz+f.toff, f.tlen);
+    return ctx.fld;
+}
+
+static inline const string& field_value(TraceContext& ctx)
+{
+    // value of the current field, copied only when a sink wants it
+
+    FixField& f = ctx.view.flds[ctx.ipos-1];
+    ctx.val.assign(ctx.view.sz+f.voff, f.vlen);
+    return ctx.val;
+}
+
+static inline void check_value(const ValidSlot& s, TraceSink& sink, TraceContext& ctx)
+{
+    // strict mode : type, then enums
+
+    FixField& f = ctx.view.flds[ctx.ipos-1];
+    const char* v = ctx.view.sz+f.voff;
+
+    FixValue val;
+    if (!fix_decode(s.type, v, f.vlen, val))
+        sink.error(TRACE_BAD_TYPE, s.xnode, field_tag(ctx));
+    else if (s.enums && !s.enums->has(v, f.vlen))
+        sink.error(TRACE_BAD_VALUE, s.xnode, field_tag(ctx));
+}
+
+static inline void mark_seen(bits64* seen, bits64* rep, int slot)
+{
+    // set seen bit, and repeated bit if it was already seen
+
+    int w = slot/64;
+    bits64 b = 1ULL<<(slot%64);
+
+    rep[w]  |= seen[w] & b;
+    seen[w] |= b;
+}
+
+void MessageGenerator::walk_xspec(ValidScope* vtop, TraceSink& sink, TraceContext& ctx, bool bvalues)
+{
+    // trace through the fix fields, comparing with the spec as we go
+    //
+    // state machine rather than recursion : each group nesting level is a frame on ctx.frames,
+    // reused for each repeat, so cost and stack are flat however deep or long the groups are
+    //
+    // fields find their slot in the compiled scope by tag [see compile_scope], seen fields are bits by slot,
+    // missing fields are one AND against the required mask per word
+
+    assert(vtop);
 
-    while(fix.next())
+    int nbase = ctx.nframes;
+    ctx.push_frame(vtop, 0);
+
+    while(ctx.nframes > nbase)
     {
-        XNode* xfield = xspec->lookup(fix.fld.c_str());
+        TraceFrame& fr  = ctx.frames[ctx.nframes-1];
+        ValidScope* vs  = fr.vs;
+        XNode* xspec    = vs->xspec;
+        bits64* seen    = &ctx.words[fr.woff];
+        bits64* rep     = seen+fr.nwords;
 
-        if (!xfield)
+        if (fr.bstart && vs->bgroup)
         {
-            // unrecognised field - in the fix msg, not in the current spec / schema
-            
-            if ( 0!=xspec->atts["name"].compare("StandardTrailer") &&
-                 (0==fix.fld.compare("93") || 0==fix.fld.compare("89") || 0==fix.fld.compare("10")) )
-            {
-                // not in trailer, but we hit a trailer field, then exit this scope
+            // group repeat : the groups first field has to come first
 
-                //printf("bailing... hit a trailer field  in spec [%s]\n", xspec->att("name"));
-                
-                fix.rewind();
-                check_seen(seen, xspec);
-                return;
-            }
+            fr.bstart = false;
 
-            if (0==xspec->atts["name"].compare("StandardHeader") || xspec->isgroup())
+            bool bnext = next_field(ctx);
+
+            if (!bnext || vs->find(ctx.view.flds[ctx.ipos-1].tag)!=0)
             {
-                // if in a group, we exit the group, its probably a field in an enclosing block
+                // expecting a repeat, saw sthing else - the rest of the repeats would bail the same way, so skip them
 
-                //printf("bailing... no field in spec [%s] for [%s]\n", xspec->att("name"), fix.fld.c_str());
-                fix.rewind();
-                check_seen(seen, xspec);
-                return;
+                sink.error(TRACE_NO_GROUP_START, xspec, vs->slots[0].xnode->att("id"));
+                if (bnext)
+                    ctx.ipos--;
+
+                ctx.pop_frame();
+                sink.end_group(xspec);
+                continue;
             }
 
-            // just a bad field, skip it
+            if (bvalues)
+            {
+                FIX_STAGE(STAGE_FORMAT);
+                sink.begin_repeat(xspec);
+                sink.field(vs->slots[0].xnode, field_value(ctx));
+            }
+            else
+                sink.begin_repeat(xspec);
 
-            printf("%3s                           << bad field, not in spec\n", fix.fld.c_str());
+            if (ctx.bstrict)
+                check_value(vs->slots[0], sink, ctx);
 
-            continue;       // skip this one
+            mark_seen(seen, rep, 0);
         }
+        fr.bstart = false;
+
+        // trace fields of this scope as they are read from the fix message [in any order], until a nested group opens
 
-        // special case : first field in group means repeat
+        ValidScope* vgroup = NULL;
+        int nreps = 0;
 
-        if (!sfirst_in_group.empty() && 0==fix.fld.compare(sfirst_in_group))
+        while(!vgroup && next_field(ctx))
         {
-            //printf("bailing... seen start of next group repeat\n");
-            fix.rewind();
-            check_seen(seen, xspec);
-            return;
-        }
-            
-        seen[fix.fld]++;
-        //printf("seen %s n=%d\n", fix.fld.c_str(), seen[fix.fld]);
+            int tag  = ctx.view.flds[ctx.ipos-1].tag;
+            int slot = vs->find(tag);
+
+            if (slot<0)
+            {
+                // unrecognised field - in the fix msg, not in the current spec / schema
 
-        // normal handling
+                if ( vs!=vtrailer && (tag==93 || tag==89 || tag==10) )
+                {
+                    // not in trailer, but we hit a trailer field, then exit this scope
 
-        if (xfield->isfield())
-        {
-            trace_field_value(xfield, fix.val);
+                    ctx.ipos--;
+                    break;
+                }
+
+                if (vs==vheader || vs->bgroup)
+                {
+                    // if in a group, we exit the group, its probably a field in an enclosing block
+
+                    ctx.ipos--;
+                    break;
+                }
+
+                // just a bad field, skip it
+
+                sink.error(TRACE_BAD_FIELD, NULL, field_tag(ctx));
+                continue;
+            }
+
+            // special case : first field in group means next repeat
+
+            if (slot==0 && vs->bgroup)
+            {
+                ctx.ipos--;
+                break;
+            }
+
+            const ValidSlot& s = vs->slots[slot];
+
+            mark_seen(seen, rep, slot);
+
+            if (s.group)
+            {
+                nreps = atoi(ctx.view.value(ctx.ipos-1));
+
+                sink.begin_group(s.xnode, nreps);
+
+                if (nreps>0)
+                    vgroup = s.group;
+                else
+                    sink.end_group(s.xnode);
+            }
+            else if (bvalues)
+            {
+                FIX_STAGE(STAGE_FORMAT);
+                sink.field(s.xnode, field_value(ctx));
+            }
+
+            if (ctx.bstrict)
+                check_value(s, sink, ctx);
         }
-        else if (xfield->isgroup())
+
+        if (vgroup)
         {
+            ctx.push_frame(vgroup, nreps);          // fr is not used past here
+            continue;
+        }
 
-            int nreps = atoi(fix.val.c_str());
-            //printf("group %s expecting %d repeats\n", xfield->att("name"), nreps);
+        // end of scope : report missing and repeated fields in spec order
 
-            while(nreps--)
+        for (int w=0;w<fr.nwords;w++)
+        {
+            bits64 missing = vs->reqmask[w] & ~seen[w];
+            bits64 bad     = missing | rep[w];
+
+            while(bad)
             {
-                //printf("recurse into group %s nrep=%d\n", xfield->att("name"), nreps);
-    
-                trace_fix_xspec(fix, xfield);
+                int n = __builtin_ctzll(bad);
+                bits64 b = 1ULL<<n;
+                bad &= ~b;
+
+                XNode* xfield = vs->slots[w*64+n].xnode;
+
+                if (missing & b)
+                    sink.error(TRACE_MISSING, xfield, xfield->att("id"));
+                if (rep[w] & b)
+                    sink.error(TRACE_REPEATED, xfield, xfield->att("id"));
             }
         }
-    }
-            
-    check_seen(seen, xspec);
-}
 
-void MessageGenerator::check_seen(mapsi& seen, XNode* xspec)
-{
-    for (int i=0;i<(int)xspec->nods.size();i++)
-    {
-        XNode* xfield = xspec->nods[i];
-        string sid = xfield->att("id");
-        int nseen = seen[sid];
+        if (!vs->bgroup)
+        {
+            ctx.pop_frame();
+            continue;
+        }
 
-        //if (nseen)
-        //    printf("seen : %3d %s\n", nseen, sid.c_str());
+        sink.end_repeat(xspec);
 
-        if (xfield->isrequired() && nseen<1)
+        if (--fr.nreps > 0)
         {
-            xfield->trace("<< missing field");
-            //xspec->trace("  within spec");
+            ctx.restart_frame();
+            continue;
         }
 
-        if (nseen>1)
-            xfield->trace("<< repeated field");
+        ctx.pop_frame();
+        sink.end_group(xspec);
     }
 }
 
@@ -808,7 +2042,8 @@ void MessageGenerator::trace_field_value(XNode* xfield, string val)
     string field_name   = xfield->att("name");
 
     string slongval;
-    XNode* field_spec = fields[field_id];
+    mapsx::iterator pf = fields.find(field_id);                 // find, not [] - the spec may be shared
+    XNode* field_spec = pf!=fields.end() ? pf->second : NULL;
 
     if (field_spec && field_spec->nods.size())
     {
@@ -832,5 +2067,89 @@ void MessageGenerator::trace_field_value(XNode* xfield, string val)
 }
 
 
+// TextTraceSink
+
+
+const char* trace_error_name(int code)
+{
+    switch(code)
+    {
+        case TRACE_BAD_FIELD:       return "bad field";
+        case TRACE_MISSING:         return "missing field";
+        case TRACE_REPEATED:        return "repeated field";
+        case TRACE_NO_GROUP_START:  return "no group starter";
+        case TRACE_BAD_MSGTYPE:     return "bad msg type";
+        case TRACE_BAD_TYPE:        return "bad type";
+        case TRACE_BAD_VALUE:       return "bad value";
+    }
+    return "error";
+}
+
+void ErrorTextSink::error(int code, XNode* xfield, const string& fld)
+{
+    XNode* xscope = scope[depth];
+
+    printf("%6d %s%-3s %-20s %3s %-25s << %s\n", nmsg, info.c_str(), msgtype,
+        xscope && xscope->att("name") ? xscope->att("name") : "",
+        fld.c_str(), xfield && xfield->att("name") ? xfield->att("name") : "",
+        trace_error_name(code));
+}
+
+void TextTraceSink::msg_info(const char* skey, const char* sval)
+{
+    fprintf(stderr, "\n%s : %s", skey, sval);
+}
+
+void TextTraceSink::begin_msg(const char* sz, int len)
+{
+    trace_raw_fix(sz, "\nMSG = ", len);
+}
+
+void TextTraceSink::begin_scope(const char* skey, XNode* xspec)
+{
+    // header and trailer by key, msg body by its name eg. NewOrderSingle
+
+    printf("\n%s\n", 0==strcmp(skey, "body") ? xspec->att("name") : skey);
+}
+
+void TextTraceSink::begin_repeat(XNode* xgroup)
+{
+    printf("\n%s\n", xgroup->att("name"));
+}
+
+void TextTraceSink::field(XNode* xfield, const string& val)
+{
+    MG->trace_field_value(xfield, val);
+}
+
+void TextTraceSink::error(int code, XNode* xfield, const string& fld)
+{
+    switch(code)
+    {
+        case TRACE_BAD_FIELD:
+            printf("%3s                           << bad field, not in spec\n", fld.c_str());
+            break;
+        case TRACE_MISSING:
+            xfield->trace("<< missing field");
+            break;
+        case TRACE_REPEATED:
+            xfield->trace("<< repeated field");
+            break;
+        case TRACE_NO_GROUP_START:
+            printf("bailing... no group starter field %s\n", fld.c_str());
+            break;
+        case TRACE_BAD_MSGTYPE:
+            printf("%3s                           << unknown msg type\n", fld.c_str());
+            break;
+        case TRACE_BAD_TYPE:
+            xfield->trace("<< bad value for type");
+            break;
+        case TRACE_BAD_VALUE:
+            xfield->trace("<< value not in enums");
+            break;
+    }
+}
+
+
 ///////////////////
 
@@ -10,23 +10,107 @@
 #define _FIXTR_H_
 using namespace std;
 
+#include "fixstats.h"
+
 
 struct XNode;
+struct ValidScope;
 
 typedef map< string, int >          mapsi;
 typedef map< string, string >       mapss;
 typedef map< string, XNode* >       mapsx;
 typedef vector< int >               veci;
 typedef vector< XNode* >            vecx;
+typedef unsigned long long          bits64;
+typedef vector< bits64 >            vecbits;
 
 
-XNode*      parse_fix_spec_xml(const char* szfile); 
-string      fix_time_now();
+XNode*      parse_fix_spec_xml(const char* szfile, bool bverbose=true);      // bverbose : version and errors to stderr 
+string      fix_time_now();                                     // UTC to ms, see FixClock
 string      fix_checksum(const char* sz, int len);
 string      int_to_string(int n);
-void        trace_raw_fix(const char* sz, const char* msg);
+void        trace_raw_fix(const char* sz, const char* msg="", int len=-1);
+int         fix_msg_length(const char* sz, int len);           // framed length of msg at sz by BodyLength, 0 need more, -1 not a msg
+
+enum FixDelim
+{
+    // delimiter after BeginString : SOH, or rendered in a log as | or ^A [accepted kinds are a mask]
+
+    FIXDELIM_SOH    = 1,
+    FIXDELIM_PIPE   = 2,
+    FIXDELIM_CARET  = 4,
+    FIXDELIM_ANY    = 7
+};
+
+const char* fix_find_start(const char* p, const char* pend);   // next 8=FIX, 16 bytes a step
+int         fix_delim_kind(const char* sz, int len);            // FIXDELIM_x after BeginString, 0 need more, -1 none
+int         fix_candidate_length(const char* sz, int len, int delims, int& kind);  // fix_msg_length for any accepted delimiter
+int         fix_normalize(char* sz, int len, int kind);         // rendered delimiters to SOH in place, returns new length
+int         fix_frame_next(const char* p, int n, bool beof, bool blines, int& off, int& len, int& used, int delims=FIXDELIM_SOH);
 void        print_node_xml(XNode* N, int nindent=0);
 
+struct FixClock
+{
+    // UTC timestamps for SendingTime / TransactTime .. written straight into the callers buffer
+    //
+    // realtime is read once a second and carried forward by the monotonic clock, so stamps never step back,
+    // and the YYYYMMDD-HH:MM: text is cached per minute - a stamp only writes the seconds and fraction
+
+    enum { RESYNC_NS = 1000000000 };
+
+    int         digits;                 // fraction digits : 0, 3 ms, 6 us or 9 ns
+    long long   base_real;              // realtime ns at base_mono
+    long long   base_mono;
+    long long   last;                   // last time handed out
+    long long   minute;                 // start of the cached minute, ns since epoch
+    char        prefix[16];             // YYYYMMDD-HH:MM: of minute
+
+    FixClock(int ndigits=3);
+
+    long long   now();                                  // ns since epoch
+    int         format(long long ns, char* p);          // writes length() chars, no terminator
+    int         stamp(char* p)          { return format(now(), p); }
+    int         length() const          { return 17 + (digits ? 1+digits : 0); }
+};
+
+
+enum ValueType
+{
+    // value decoding by the spec field type [see fix_value_type]
+
+    VTYPE_ANY = 0,                      // STRING, DATA, dates .. left as text
+    VTYPE_INT,                          // INT LENGTH NUMINGROUP SEQNUM TAGNUM DAYOFMONTH
+    VTYPE_FLOAT,                        // FLOAT PRICE QTY AMT PRICEOFFSET PERCENTAGE, as a FixDecimal
+    VTYPE_CHAR,                         // one character
+    VTYPE_BOOL,                         // Y or N
+    VTYPE_TIMESTAMP                     // UTCTIMESTAMP, as ns since epoch
+};
+
+struct FixDecimal
+{
+    // fixed point : mant / 10^scale exactly as sent, eg. 101.250 is 101250 scale 3
+
+    long long   mant;
+    int         scale;
+
+    long long   at_scale(int places) const;     // mant at a fixed number of places [extra places truncated, saturates on overflow]
+};
+
+struct FixValue
+{
+    int         type;                   // ValueType
+    long long   i;                      // VTYPE_INT the value, VTYPE_TIMESTAMP ns since epoch, VTYPE_CHAR / BOOL the byte
+    FixDecimal  d;                      // VTYPE_FLOAT
+};
+
+// typed values decoded in place from the msg text - no allocation, no strtod, false if the text doesnt parse as the type
+
+int         fix_value_type(const char* sztype);                                 // spec type attribute to ValueType
+bool        fix_parse_int(const char* v, int n, long long& val);                // [-]digits in range of a long long
+bool        fix_parse_decimal(const char* v, int n, FixDecimal& val);           // up to 18 significant digits
+bool        fix_parse_timestamp(const char* v, int n, long long& nanos);        // YYYYMMDD-HH:MM:SS[.s to .sssssssss], a real date
+bool        fix_decode(int type, const char* v, int n, FixValue& val);          // by ValueType [VTYPE_ANY always true]
+
 
 ///
 
@@ -53,9 +137,13 @@ struct XNode
     bool                    bexpanded;  // if true the components are inserted inline [groups remain as nested Nodes]
     mapsx                   nodmap;     // for expanded nodes, map fld id => child node
 
+    int                     slot;       // for expanded nodes, index in parents nods == bit in parents seen bitset
+    vecbits                 reqmask;    // for expanded nodes, bit set for each required child
+
     XNode()
         : parent(NULL)
         , bexpanded(false)
+        , slot(-1)
     {
     }
 
@@ -63,6 +151,7 @@ struct XNode
         : elt(name) 
         , parent(par)
         , bexpanded(false)
+        , slot(-1)
     {
         while(zatts && *zatts)
         {
@@ -117,6 +206,9 @@ struct XNode
 
     XNode* lookup(const char* szid)
     {
+        FIX_STAGE(STAGE_LOOKUP);
+        FIX_COUNT(COUNT_LOOKUPS, 1);
+
         if (!szid)   
             return NULL;
 
@@ -375,18 +467,26 @@ struct FixReader
     {
         // parse next FIX attribute <fld>=<val>^ [starting from npos'th position in sz]
 
+        FIX_STAGE(STAGE_TOKENIZE);
+
         fld.clear();
         val.clear();
 
         if (npos+2 >= nlen)
             return 0;
 
+        FIX_COUNT(COUNT_FIELDS, 1);
+
         const char* pbeg = sz+npos;
-        const char* peqs = strchr(pbeg, '=');
+        const char* pmax = sz+nlen;
+        const char* peqs = (const char*)memchr(pbeg, '=', pmax-pbeg);
+        if (!peqs)
+            return 0;
         const char* pval = peqs+1; 
-        const char* psoh = strchr(pval, (char)0x01); 
+        const char* psoh = (const char*)memchr(pval, 0x01, pmax-pval); 
+        if (!psoh)
+            return 0;
         const char* pnxt = psoh+1;
-        const char* pmax = sz+nlen;
 
         assert(pbeg<pmax);
         assert(pval<pmax);
@@ -406,6 +506,18 @@ struct FixReader
         return nchunk;
     }
 
+    void reset(const char* z, int n)
+    {
+        // reuse for the next message [keeps string buffers, so no allocation once warmed up]
+
+        sz   = z;
+        npos = 0;
+        nlen = n;
+        fld.clear();
+        val.clear();
+        msgtype.clear();
+    }
+
     void rewind()
     {
         // go back to previous chunk in FIX msg [after which, next() will restore current state]
@@ -424,6 +536,360 @@ struct FixReader
 };
 
 
+struct FixField
+{
+    int         tag;                    // numeric tag, -1 if not a number
+    int         toff;                   // tag text at sz+toff for tlen bytes
+    int         tlen;
+    int         voff;                   // value at sz+voff for vlen bytes [always followed by SOH]
+    int         vlen;
+};
+
+
+struct FixMessageView
+{
+    // a fix msg tokenized once into a flat array of fields - random access by index, by tag, and over group repeats
+    // reused from msg to msg [vectors keep their capacity, the tag table is cleared only where it was set]
+
+    enum { NTAGS = 1<<14 };             // tags below this find their first field in O(1), higher tags by scan
+
+    const char*         sz;
+    int                 len;
+    vector<FixField>    flds;
+    int                 nflds;
+    int                 nend;           // bytes tokenized, up to the end of the last good field
+    vector<int>         first;          // first field index by tag, -1 none
+
+    FixMessageView()
+        : sz(NULL)
+        , len(0)
+        , nflds(0)
+        , nend(0)
+        , first(NTAGS, -1)
+    {
+    }
+
+    int         parse(const char* z, int n);                    // returns number of fields [stops at the first malformed one]
+
+    int         find(int tag, int from=0) const;                // index of first field with tag at or after from, -1 none
+    bool        get(int tag, const char*& val, int& vlen) const;
+    string      get(int tag) const;                             // value of first tag, "" if none
+
+    const char* tag_text(int i) const   { return sz+flds[i].toff; }
+    const char* value(int i) const      { return sz+flds[i].voff; }
+    int         end_offset(int i) const { return i>0 ? flds[i-1].voff+flds[i-1].vlen+1 : 0; }     // msg bytes up to field i
+
+    int         group_reps(int icount, veci& starts) const;     // repeat starts of the group counted at field icount
+
+    // typed value of field i, decoded in place
+
+    bool        get_int(int i, long long& val) const        { return fix_parse_int(value(i), flds[i].vlen, val); }
+    bool        get_decimal(int i, FixDecimal& val) const   { return fix_parse_decimal(value(i), flds[i].vlen, val); }
+    bool        get_timestamp(int i, long long& ns) const   { return fix_parse_timestamp(value(i), flds[i].vlen, ns); }
+    char        get_char(int i) const                       { return flds[i].vlen==1 ? *value(i) : 0; }
+};
+
+
+struct FixEdit
+{
+    // a change to one field of a msg view, for fix_rewrite
+
+    int         ifld;                   // field index in the view
+    const char* val;                    // new value, NULL drops the field
+    int         vlen;
+};
+
+// msg in V with edits applied [sorted by ifld, not 8 9 or 10] appended to out - returns its length, -1 if V isnt a whole msg
+// BodyLength and CheckSum are patched from the bytes removed and added, so the msg should have passed msg_bad
+
+int         fix_rewrite(const FixMessageView& V, const FixEdit* edits, int nedits, string& out);
+
+
+struct FixFramer
+{
+    // fix msgs out of a byte stream whatever the read boundaries, by fix_frame_next
+    //      read into space() / commit() [or append()], then next() until it returns 0
+    // only the unframed tail is moved up when the buffer is refilled, so framing is O(1) per msg
+
+    enum { MINREAD = 1<<16 };
+
+    string      buf;
+    int         s;                      // next unframed byte
+    int         e;                      // end of data
+    long long   base;                   // stream offset of buf[0]
+    bool        blines;                 // text input : msgs with a bad BodyLength run to end of line
+    bool        beof;                   // no more input, frame whatever is left
+    int         delims;                 // FIXDELIM_x accepted [rendered msgs are normalized to SOH in place]
+    int         kind;                   // last msg from next() : its FIXDELIM_x as read, and length before normalizing
+    int         rawlen;
+
+    FixFramer(bool lines=true)
+        : s(0)
+        , e(0)
+        , base(0)
+        , blines(lines)
+        , beof(false)
+        , delims(FIXDELIM_SOH)
+        , kind(0)
+        , rawlen(0)
+    {
+    }
+
+    char*   space(int nmin=MINREAD);    // room for at least nmin more bytes
+    int     avail()                     { return buf.size()-e; }
+    void    commit(int n)               { e+=n; }
+    void    append(const char* p, int n){ memcpy(space(n), p, n); commit(n); }
+    void    reset()                     { base+=e; s=e=0; }
+
+    int     next(const char*& sz, int& len, long long& offset);
+};
+
+
+enum TraceError
+{
+    TRACE_BAD_FIELD = 1,                // field in the fix msg, not in the spec
+    TRACE_MISSING,                      // required field not seen
+    TRACE_REPEATED,                     // field seen more than once in scope
+    TRACE_NO_GROUP_START,               // group repeat doesnt start with the groups first field
+    TRACE_BAD_MSGTYPE,                  // msg type not in spec
+    TRACE_BAD_TYPE,                     // value doesnt parse as the fields type [strict only]
+    TRACE_BAD_VALUE                     // value not one of the fields enums [strict only]
+};
+
+const char* trace_error_name(int code);
+
+
+struct MessageGenerator;
+
+struct TraceSink
+{
+    // receives the events of trace_fix_xspec as it walks a fix message against the expanded spec
+    // default TextTraceSink gives the human readable trace, see fixfmt.h for json / csv output
+
+    virtual ~TraceSink() {}
+
+    virtual void msg_info(const char* skey, const char* sval) {}      // before begin_msg : where the msg came from eg. capture time, flow
+    virtual void begin_msg(const char* sz, int len) {}
+    virtual void end_msg() {}
+
+    virtual void begin_scope(const char* skey, XNode* xspec) {}        // skey is "header", "body" or "trailer"
+    virtual void end_scope(XNode* xspec) {}
+
+    virtual void begin_group(XNode* xgroup, int nreps) {}
+    virtual void end_group(XNode* xgroup) {}
+    virtual void begin_repeat(XNode* xgroup) {}
+    virtual void end_repeat(XNode* xgroup) {}
+
+    virtual void field(XNode* xfield, const string& val) {}
+    virtual void error(int code, XNode* xfield, const string& fld) {}  // code is TraceError, xfield may be NULL
+
+    virtual void spec_changed(MessageGenerator& MG) {}                 // between msgs, spec reloaded [fixreload.h]
+    virtual void skip_msgs(int n) {}                                    // resumed after n msgs [fixcheckpoint.h], numbering carries on
+};
+
+
+struct ValidEnums
+{
+    // allowed values of one field : single characters as a bitmap, longer values sorted
+
+    bits64          chars[4];
+    vector<string>  strs;
+
+    ValidEnums()
+    {
+        memset(chars, 0, sizeof(chars));
+    }
+
+    bool has(const char* v, int n) const;
+};
+
+
+struct ValidSlot
+{
+    // one child of a compiled scope, at its slot [bit in the seen bitsets]
+
+    XNode*          xnode;              // field or group in the expanded spec, for sink events
+    int             tag;
+    int             type;               // ValueType
+    ValidEnums*     enums;              // NULL any value
+    ValidScope*     group;              // for a group, the scope of its repeats
+};
+
+
+struct ValidHash
+{
+    int             tag;                // -1 empty
+    int             slot;
+};
+
+
+struct ValidScope
+{
+    // an expanded scope compiled for the trace walk : header, trailer, msg body or group
+    // tag to slot by open addressing, so a field costs a multiply and a probe or two rather than a map lookup on its text
+
+    XNode*              xspec;
+    bool                bgroup;         // repeats start with slot 0
+    vecbits             reqmask;        // as xspec->reqmask
+    vector<ValidSlot>   slots;          // xspec->nods in order
+    vector<ValidHash>   hash;
+    unsigned            hmask;
+
+    int find(int tag) const
+    {
+        FIX_STAGE(STAGE_LOOKUP);
+        FIX_COUNT(COUNT_LOOKUPS, 1);
+
+        if (tag<0)
+            return -1;
+
+        for (unsigned h=((unsigned)tag*2654435761u)>>16;;h++)
+        {
+            const ValidHash& e = hash[h & hmask];
+            if (e.tag==tag)
+                return e.slot;
+            if (e.tag<0)
+                return -1;
+        }
+    }
+};
+
+
+struct TraceFrame
+{
+    // one scope of the trace walk : msg header / body / trailer, or a group [reused for each repeat]
+
+    ValidScope* vs;
+    int         woff;                   // offset of seen bits in TraceContext::words [then repeated bits]
+    int         nwords;
+    int         nreps;                  // group repeats left, including this one
+    bool        bstart;                 // repeat not started yet
+};
+
+
+struct TraceContext
+{
+    // per thread state for trace_msg - msg view and cursor, scope frames and seen bitsets
+    // sized once from the spec and reused for each msg, so tracing doesnt allocate or recurse
+
+    FixMessageView      view;
+    int                 ipos;           // next field in view
+    string              fld;            // tag text of the current field [for spec lookup]
+    string              val;            // value of the current field, filled only for sinks that want values
+    string              msgtype;        // 35 from the header
+    bool                bstrict;        // also check values against the field type and enums
+
+    vecbits             words;
+    int                 ntop;
+    vector<TraceFrame>  frames;
+    int                 nframes;
+
+    TraceContext(MessageGenerator& MG);
+
+    void size_for(MessageGenerator& MG);                            // frames and bitsets for the deepest scope of MG
+
+    void push_frame(ValidScope* vs, int nreps)
+    {
+        assert(nframes < (int)frames.size());
+
+        TraceFrame& fr = frames[nframes++];
+        fr.vs     = vs;
+        fr.nwords = vs->reqmask.size();
+        fr.woff   = ntop;
+        fr.nreps  = nreps;
+
+        ntop += 2*fr.nwords;
+        assert(ntop <= (int)words.size());
+
+        restart_frame();
+    }
+
+    void restart_frame()
+    {
+        TraceFrame& fr = frames[nframes-1];
+        memset(&words[fr.woff], 0, 2*fr.nwords*sizeof(bits64));
+        fr.bstart = true;
+    }
+
+    void pop_frame()
+    {
+        ntop -= 2*frames[--nframes].nwords;
+    }
+};
+
+
+struct TextTraceSink : TraceSink
+{
+    // original human readable trace : field values on stderr, structure and errors on stdout
+
+    MessageGenerator* MG;
+
+    TextTraceSink(MessageGenerator& gen)
+        : MG(&gen)
+    {
+    }
+
+    virtual void spec_changed(MessageGenerator& gen)            { MG = &gen; }
+
+    virtual void msg_info(const char* skey, const char* sval);
+    virtual void begin_msg(const char* sz, int len);
+    virtual void begin_scope(const char* skey, XNode* xspec);
+    virtual void begin_repeat(XNode* xgroup);
+    virtual void field(XNode* xfield, const string& val);
+    virtual void error(int code, XNode* xfield, const string& fld);
+};
+
+
+struct ErrorTextSink : TraceSink
+{
+    // validate mode : one line per error, no field values
+    //  <msg no> <msgtype> <scope> <tag> <name> << <error>
+
+    enum { MAXDEPTH = 64 };
+
+    int         nmsg;
+    int         depth;
+    const char* msgtype;
+    XNode*      scope[MAXDEPTH];
+    string      info;                   // msg_info values, shown after the msg number
+
+    ErrorTextSink()
+        : nmsg(0)
+        , depth(0)
+        , msgtype("")
+    {
+    }
+
+    void push(XNode* xspec)
+    {
+        if (depth+1<MAXDEPTH)
+            depth++;
+        scope[depth]=xspec;
+    }
+
+    void pop()
+    {
+        if (depth>0)
+            depth--;
+    }
+
+    virtual void msg_info(const char* skey, const char* sval)   { info.append(sval); info.push_back(' '); }
+    virtual void begin_msg(const char* sz, int len)             { nmsg++; depth=0; scope[0]=NULL; msgtype=""; }
+    virtual void skip_msgs(int n)                               { nmsg = n; }
+    virtual void end_msg()                                      { info.clear(); }
+    virtual void begin_scope(const char* skey, XNode* xspec)
+    {
+        if (0==strcmp(skey, "body"))
+            msgtype = xspec->att("msgtype");
+        push(xspec);
+    }
+    virtual void end_scope(XNode* xspec)                        { pop(); }
+    virtual void begin_repeat(XNode* xgroup)                    { push(xgroup); }
+    virtual void end_repeat(XNode* xgroup)                      { pop(); }
+    virtual void error(int code, XNode* xfield, const string& fld);
+};
+
+
 struct MessageGenerator
 {
     XNode*  ndfix;
@@ -440,25 +906,48 @@ struct MessageGenerator
     mapss   fields_by_name;         // map name -> id
 
     int     nsent;
+    FixClock clock;                 // SendingTime, to the precision the FIX version allows
 
     string  prelude;                // FIX message prelude eg. FIX.4.n
     string  soh;                    // FIX field delimiter ascii 01 as a string
 
+    XNode*  xheader;                // expanded specs [components inlined], see expand_specs()
+    XNode*  xtrailer;
+    XNode*  xmsgs;
+    int     nseenwords;             // deepest stack of seen bitset words, to size TraceContext
+    int     nscopedepth;            // deepest nesting of groups [+1 for the msg]
+
+    ValidScope*             vheader;    // expanded specs compiled for the trace walk, see compile_scope()
+    ValidScope*             vtrailer;
+    map<string,ValidScope*> vbodies;    // by msg type
+    vector<ValidScope*>     vscopes;    // all of them, owned
+    map<string,ValidEnums*> venums;     // by field id, owned
+
     MessageGenerator(XNode* fix);
+    ~MessageGenerator();
 
     int     gen_spec(XNode* spec, mapss& msg_atts, string& result);
     int     gen_msg(string msg_type, mapss& body_atts, string ssource, string starget, string& result);
 
-    int     msg_bad(const char* sz, int len);               // checks sanity of prelude and checksum
+    int     msg_bad(const char* sz, int len, bool bverbose=true);   // checks sanity of prelude and checksum
 
     // analyze fix messages in any order [except for some specific constrains for header, group repeats etc ]
 
     XNode*  load_expanded(XNode* src_spec);
+    void    expand_specs();                                     // load expanded header, trailer and messages
+    ValidScope* compile_scope(XNode* xspec);                    // compile an expanded scope and its groups
+    ValidEnums* compile_enums(const char* szid, int type);
     int     show_expanded_spec(const char* szmsgtype, mapss& options);
 
-    void    check_seen(mapsi& seen, XNode* xspec);
     void    trace_field_value(XNode* xfield, string val);
-    void    trace_fix_xspec(FixReader& fix, XNode* xspec);      // trace the fix message according to xspec schema
+    void    trace_fix_xspec(FixReader& fix, XNode* xspec, TraceSink* sink=NULL);   // trace the fix message according to xspec schema [from where fix is up to]
+
+    // trace header, body, trailer - returns bytes consumed
+    // bvalues false is validate only : same diagnostics, but only error events reach the sink
+
+    void    walk_xspec(ValidScope* vs, TraceSink& sink, TraceContext& ctx, bool bvalues);
+    int     trace_msg(const char* sz, int len, TraceSink& sink, TraceContext& ctx, bool bvalues=true);
+    int     validate_msg(const char* sz, int len, TraceSink& sink, TraceContext& ctx) { return trace_msg(sz, len, sink, ctx, false); }
 
 };
 
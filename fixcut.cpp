@@ -0,0 +1,295 @@
+//
+//  fixcut.cpp - project chosen tags of each msg to tab separated rows [see fixcut.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixcut.h"
+#include "fixcheckpoint.h"
+
+
+FixCut::FixCut(MessageGenerator& mg, OutBuf& o)
+    : MG(mg)
+    , out(o)
+    , col(FixMessageView::NTAGS, 0)
+    , group(0)
+    , member(FixMessageView::NTAGS, 0)
+    , nreps(0)
+    , nmsgs(0)
+    , nrows(0)
+{
+}
+
+int FixCut::tag_of(const char* sztag, string& name)
+{
+    string id = sztag;
+    if (MG.fields_by_name.count(id))
+        id = MG.fields_by_name[id];
+
+    int tag = atoi(id.c_str());
+    if (tag<=0 || tag>=FixMessageView::NTAGS || id!=int_to_string(tag))
+        return 0;
+
+    mapsx::iterator p = MG.fields.find(id);
+    name = p!=MG.fields.end() && p->second->att("name") ? p->second->att("name") : id;
+    return tag;
+}
+
+bool FixCut::add_tag(const char* sztag)
+{
+    string name;
+    int tag = tag_of(sztag, name);
+    if (!tag || col[tag])
+        return false;
+
+    tags.push_back(tag);
+    names.push_back(name);
+    col[tag] = tags.size();
+    row.resize(tags.size());
+    return true;
+}
+
+static void group_members(XNode* nd, const string& id, bool bin, vector<char>& member)
+{
+    // tags of every field under the group id, wherever it is in the spec [expanded, so components are inline]
+
+    for (int i=0;i<(int)nd->nods.size();i++)
+    {
+        XNode* ch = nd->nods[i];
+        bool bgroup = ch->isgroup() && ch->att("id") && id==ch->att("id");
+
+        if (bin && (ch->isfield() || ch->isgroup()) && ch->att("id"))
+        {
+            int tag = atoi(ch->att("id"));
+            if (tag>0 && tag<(int)member.size())
+                member[tag] = 1;
+        }
+        group_members(ch, id, bin || bgroup, member);
+    }
+}
+
+bool FixCut::set_group(const char* sztag)
+{
+    string name;
+    group = tag_of(sztag, name);
+    if (!group)
+        return false;
+
+    MG.expand_specs();
+
+    string id = int_to_string(group);
+    group_members(MG.xheader, id, false, member);
+    group_members(MG.xmsgs, id, false, member);
+    group_members(MG.xtrailer, id, false, member);
+
+    bool bany = false;
+    for (int i=0;i<(int)member.size();i++)
+        bany = bany || member[i];
+    return bany;
+}
+
+void FixCut::header()
+{
+    for (int c=0;c<(int)names.size();c++)
+    {
+        if (c)
+            out.put('\t');
+        out.put(names[c]);
+    }
+    out.put('\n');
+}
+
+void FixCut::put_row(const CutSpan* rep)
+{
+    for (int c=0;c<(int)tags.size();c++)
+    {
+        if (c)
+            out.put('\t');
+
+        const CutSpan& s = rep && rep[c].v ? rep[c] : row[c];
+        if (!s.v)
+            continue;
+
+        // a value with tabs or line ends would break the row
+
+        const char* v = s.v;
+        const char* e = v+s.n;
+        while (v<e)
+        {
+            const char* q = v;
+            while (q<e && *q!='\t' && *q!='\n' && *q!='\r')
+                q++;
+            out.put(v, q-v);
+            if (q<e)
+            {
+                out.put(' ');
+                q++;
+            }
+            v = q;
+        }
+    }
+    out.put('\n');
+    nrows++;
+}
+
+void FixCut::msg(const char* p, int len)
+{
+    const char* e = p+len;
+    int ncols = tags.size();
+    int nfilled = 0;
+
+    for (int c=0;c<ncols;c++)
+        row[c].v = NULL;
+    nreps = 0;
+
+    int first = 0;                      // tag that starts each repeat, once seen
+    bool bin = false;                   // in the group
+
+    while (p<e)
+    {
+        // tag digits up to =
+
+        int tag = 0;
+        const char* q = p;
+        while (q<e && *q>='0' && *q<='9')
+            tag = tag*10 + (*q++ - '0');
+        if (q==p || q>=e || *q!='=' || tag>=FixMessageView::NTAGS)
+            break;
+
+        const char* v = q+1;
+        const char* s = (const char*)memchr(v, '\001', e-v);
+        if (!s)
+            s = e;
+        p = s+1;
+
+        if (group)
+        {
+            if (tag==group)
+            {
+                bin = true;
+                first = 0;
+            }
+            else if (bin && member[tag])
+            {
+                if (!first)
+                    first = tag;
+                if (tag==first)
+                {
+                    nreps++;
+                    reps.resize(nreps*ncols);
+                    for (int c=0;c<ncols;c++)
+                        reps[(nreps-1)*ncols+c].v = NULL;
+                }
+
+                int c = col[tag]-1;
+                if (c>=0 && !reps[(nreps-1)*ncols+c].v)
+                {
+                    CutSpan& r = reps[(nreps-1)*ncols+c];
+                    r.v = v;
+                    r.n = s-v;
+                }
+                continue;
+            }
+            else
+                bin = false;
+        }
+
+        int c = col[tag]-1;
+        if (c>=0 && !row[c].v)
+        {
+            row[c].v = v;
+            row[c].n = s-v;
+
+            // all there : the rest of the msg neednt be read [with a group, the repeats may still come]
+
+            if (++nfilled==ncols && !group)
+                break;
+        }
+    }
+
+    nmsgs++;
+    if (!nreps)
+        put_row(NULL);
+    for (int r=0;r<nreps;r++)
+        put_row(&reps[r*ncols]);
+    out.end_record();
+}
+
+void FixCut::save(FixCheckpoint& ck)
+{
+    ck.clear();
+    ck.line("counts");
+    ck.add(nmsgs);
+    ck.add(nrows);
+}
+
+bool FixCut::restore(FixCheckpoint& ck)
+{
+    while (ck.next_line())
+    {
+        if (!ck.is("counts"))
+            return false;
+        nmsgs = ck.get_int(1);
+        nrows = ck.get_int(2);
+    }
+    return true;
+}
+
+void FixCut::run(int fd, int delims, FixCheckpoint* ck)
+{
+    FixFramer framer;
+    framer.delims = delims;
+    framer.base = ck ? ck->offset : 0;
+
+    if (!ck || !ck->nmsgs)
+        header();
+
+    while (!framer.beof)
+    {
+        {
+            FIX_STAGE(STAGE_READ);
+            char* p = framer.space();
+            int r = read(fd, p, framer.avail());
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+                framer.beof = true;
+            else
+                framer.commit(r);
+            FIX_COUNT(COUNT_BYTES_IN, r>0 ? r : 0);
+        }
+
+        const char* p;
+        int len;
+        long long off;
+        while (true)
+        {
+            {
+                FIX_STAGE(STAGE_FIND);
+                if (!framer.next(p, len, off))
+                    break;
+            }
+            FIX_COUNT(COUNT_MSGS, 1);
+            FIX_COUNT(COUNT_MSG_BYTES, len);
+            msg(p, len);
+
+            if (ck && ck->tick())
+            {
+                save(*ck);
+                ck->save(off+framer.rawlen, out);
+            }
+        }
+    }
+
+    out.flush();
+}
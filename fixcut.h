@@ -0,0 +1,69 @@
+//
+//  fixcut.h - project chosen tags of each msg to tab separated rows, straight off the raw msg bytes
+//
+//      no spec walk per msg : each field's tag is read and looked up in a table of the wanted tags, values found by
+//      memchr for the SOH after them - a msg is done once every column has its value
+//
+//      one row per msg, the first value of each tag [empty if none] in the order asked, under a row of field names -
+//
+//          SendingTime     MsgType     ClOrdID     OrdStatus   CumQty
+//
+//      with a group [its NoXxx count tag], one row per repeat instead : tags in the group from that repeat,
+//      the others from the msg - the group's member tags are taken from the spec once, before the first msg
+//
+//      msgs are framed by BodyLength as fixtr frames them, and cut as they are [CheckSum not checked]
+//      tabs and line ends in values are written as spaces
+//
+#ifndef _FIXCUT_H_
+#define _FIXCUT_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+struct FixCheckpoint;
+
+
+struct CutSpan
+{
+    const char*     v;                  // NULL none
+    int             n;
+};
+
+
+struct FixCut
+{
+    MessageGenerator&       MG;
+    OutBuf&                 out;
+
+    vector<int>             tags;       // columns
+    vector<string>          names;
+    vector<int>             col;        // column+1 by tag, 0 not cut [tags below FixMessageView::NTAGS]
+    int                     group;      // NoXxx tag of the group rows are per repeat of, 0 none
+    vector<char>            member;     // by tag, in the group [nested groups too]
+
+    vector<CutSpan>         row;        // msg values by column
+    vector<CutSpan>         reps;       // .. and by repeat, a row of columns each
+    int                     nreps;
+
+    long long               nmsgs;
+    long long               nrows;
+
+    FixCut(MessageGenerator& mg, OutBuf& o);
+
+    bool    add_tag(const char* sztag);                             // tag number or field name
+    bool    set_group(const char* sztag);                           // NoXxx tag number or name, false if not a group in the spec
+    void    header();
+    void    msg(const char* p, int len);
+    void    run(int fd, int delims, FixCheckpoint* ck=NULL);        // msgs from fd, rows to out
+
+    void    save(FixCheckpoint& ck);                                // state for a checkpoint [fixcheckpoint.h]
+    bool    restore(FixCheckpoint& ck);                             // .. back from one, false if it doesnt parse
+
+    // internal
+
+    int     tag_of(const char* sztag, string& name);                // by number or name, 0 none
+    void    put_row(const CutSpan* rep);
+};
+
+#endif //_FIXCUT_H_
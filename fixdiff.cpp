@@ -0,0 +1,710 @@
+//
+//  fixdiff.cpp - compare two fix logs msg by msg, matched on a business key rather than by line
+//
+//      USAGE fixdiff [options] expected.log actual.log
+//
+//      msgs are keyed by the values of the key tags [default MsgType 35, ClOrdID 11, ExecID 17 - those present],
+//      msgs with the same key pair up in the order they come
+//
+//      both logs are read in step, framed as fixtr frames them : a msg waits in a hash table until its match turns up
+//      on the other side, so memory goes with how far apart the logs drift, not their size - past --window msgs
+//      waiting, the oldest is given up on and reported unmatched
+//
+//      matched msgs are compared field by field, by tag and occurrence [so group repeats compare in turn],
+//      skipping the ignored tags - by default the session fields that always differ between runs
+//
+//      output, one block per difference -
+//
+//          missing <key> [expected @offset]               only in expected
+//          extra   <key> [actual @offset]                 only in actual
+//          differs <key> [@offset @offset]                then a line per field  :  tag  expected => actual   [- for none]
+//
+//      exit status 0 if the logs match, 1 if not
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+static unsigned long long key_hash(const char* p, int n)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    for (int i=0;i<n;i++)
+        h = (h ^ (unsigned char)p[i]) * 1099511628211ULL;
+    return h ^ (h >> 29);
+}
+
+
+struct DiffInput
+{
+    // one log, a msg at a time
+
+    int             fd;
+    FixFramer       framer;
+    long long       nmsgs;
+
+    DiffInput()
+        : fd(-1)
+        , nmsgs(0)
+    {
+    }
+
+    bool next(const char*& p, int& len, long long& off)
+    {
+        while (true)
+        {
+            if (framer.next(p, len, off))
+            {
+                nmsgs++;
+                return true;
+            }
+            if (framer.beof)
+                return false;
+
+            char* q = framer.space();
+            int r = read(fd, q, framer.avail());
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+                framer.beof = true;
+            else
+                framer.commit(r);
+        }
+    }
+};
+
+
+struct DiffWait
+{
+    // a msg waiting for its match - on a FIFO per key, and on the age list of all that wait
+
+    string          key;
+    unsigned long long hash;
+    string          msg;                // kept capacity, reused from the free list
+    long long       offset;
+    int             side;               // 0 expected, 1 actual
+
+    int             next;               // same key, later
+    int             older;              // age list
+    int             newer;
+};
+
+
+struct DiffField
+{
+    int             tag;
+    int             occ;                // nth of the tag in the msg
+    const char*     v;
+    int             vlen;
+
+    bool operator<(const DiffField& f) const
+    {
+        return tag!=f.tag ? tag<f.tag : occ<f.occ;
+    }
+};
+
+
+struct FixDiff
+{
+    vector<int>             keytags;
+    vector<char>            ignore;                 // by tag, all msg types
+    map<string, vector<char> > ignore_by_type;      // by msg type, as well
+    int                     window;                 // msgs waiting at most
+
+    // waiting msgs : open addressing on the key, the head of its FIFO
+
+    vector<DiffWait>        waits;
+    vector<int>             table;                  // head wait+1, 0 empty [at most half full, grows]
+    int                     nfree;                  // free list through next
+    int                     oldest;
+    int                     newest;
+    int                     nwaiting;
+    int                     nkeys;                  // in the table
+
+    FixMessageView          va;
+    FixMessageView          vb;
+    vector<int>             tagocc;                 // occurrences per tag, while listing a msg
+    vector<DiffField>       fa;
+    vector<DiffField>       fb;
+    string                  key;
+    OutBuf&                 out;
+
+    long long               nmatched;
+    long long               ndiffer;
+    long long               nmissing;
+    long long               nextra;
+    long long               nevicted;
+
+    FixDiff(OutBuf& o, int win);
+
+    void    add_ignore(const string& s);
+    void    msg(int side, const char* p, int len, long long off);
+    void    finish();
+
+    // internal
+
+    int     lookup(unsigned long long h, const string& k) const;
+    void    unlink_slot(int slot);
+    void    grow();
+    int     take(int slot);                         // head of the FIFO at slot off the table, returns its wait
+    void    put(int side, unsigned long long h, const char* p, int len, long long off);
+    void    release(int w);
+    void    unmatched(const DiffWait& W);
+    void    evict();
+    void    compare(long long offa, long long offb);           // the pair parsed in va and vb
+    bool    ignored(int tag, const vector<char>* bytype) const;
+    bool    same(const vector<char>* bytype) const;      // va and vb have the same fields in the same order, ignoring those ignored
+    void    list_fields(const FixMessageView& v, const vector<char>* bytype, vector<DiffField>& fl);
+    void    put_value(const DiffField* f);
+};
+
+
+FixDiff::FixDiff(OutBuf& o, int win)
+    : ignore(FixMessageView::NTAGS, 0)
+    , window(win)
+    , nfree(-1)
+    , oldest(-1)
+    , newest(-1)
+    , nwaiting(0)
+    , nkeys(0)
+    , tagocc(FixMessageView::NTAGS, 0)
+    , out(o)
+    , nmatched(0)
+    , ndiffer(0)
+    , nmissing(0)
+    , nextra(0)
+    , nevicted(0)
+{
+    table.assign(1024, 0);
+}
+
+void FixDiff::add_ignore(const string& s)
+{
+    // tag, or msgtype:tag
+
+    size_t c = s.find(':');
+    int tag = atoi(s.c_str() + (c==string::npos ? 0 : c+1));
+    if (tag<=0 || tag>=FixMessageView::NTAGS)
+        fprintf(stderr,"Bad option --ignore [%s]\n", s.c_str()), exit(-1);
+
+    if (c==string::npos)
+        ignore[tag] = 1;
+    else
+    {
+        vector<char>& ig = ignore_by_type[s.substr(0, c)];
+        ig.resize(FixMessageView::NTAGS, 0);
+        ig[tag] = 1;
+    }
+}
+
+int FixDiff::lookup(unsigned long long h, const string& k) const
+{
+    unsigned mask = table.size()-1;
+    unsigned i = (unsigned)h & mask;
+    for (; table[i]; i=(i+1) & mask)
+    {
+        const DiffWait& W = waits[table[i]-1];
+        if (W.hash==h && W.key==k)
+            break;
+    }
+    return i;
+}
+
+void FixDiff::grow()
+{
+    // double the table, and put back the FIFO heads
+
+    vector<int> old(table.size()*2, 0);
+    old.swap(table);
+
+    unsigned mask = table.size()-1;
+    for (int i=0;i<(int)old.size();i++)
+    {
+        if (!old[i])
+            continue;
+        unsigned k = (unsigned)waits[old[i]-1].hash & mask;
+        while (table[k])
+            k = (k+1) & mask;
+        table[k] = old[i];
+    }
+}
+
+void FixDiff::unlink_slot(int slot)
+{
+    // backward shift delete, as fixtop
+
+    unsigned mask = table.size()-1;
+    unsigned i = slot;
+    unsigned j = slot;
+    table[i] = 0;
+
+    while (true)
+    {
+        j = (j+1) & mask;
+        if (!table[j])
+            break;
+
+        unsigned k = (unsigned)waits[table[j]-1].hash & mask;
+        bool bstays = i<=j ? (i<k && k<=j) : (i<k || k<=j);
+        if (bstays)
+            continue;
+
+        table[i] = table[j];
+        table[j] = 0;
+        i = j;
+    }
+}
+
+int FixDiff::take(int slot)
+{
+    int w = table[slot]-1;
+    int nx = waits[w].next;
+    if (nx>=0)
+        table[slot] = nx+1;
+    else
+    {
+        unlink_slot(slot);
+        nkeys--;
+    }
+
+    // off the age list
+
+    DiffWait& W = waits[w];
+    if (W.older>=0)
+        waits[W.older].newer = W.newer;
+    else
+        oldest = W.newer;
+    if (W.newer>=0)
+        waits[W.newer].older = W.older;
+    else
+        newest = W.older;
+
+    nwaiting--;
+    return w;
+}
+
+void FixDiff::release(int w)
+{
+    waits[w].next = nfree;
+    nfree = w;
+}
+
+void FixDiff::put(int side, unsigned long long h, const char* p, int len, long long off)
+{
+    int w = nfree;
+    if (w>=0)
+        nfree = waits[w].next;
+    else
+    {
+        w = waits.size();
+        waits.push_back(DiffWait());
+    }
+
+    DiffWait& W = waits[w];
+    W.key    = key;
+    W.hash   = h;
+    W.msg.assign(p, len);
+    W.offset = off;
+    W.side   = side;
+    W.next   = -1;
+
+    W.older = newest;
+    W.newer = -1;
+    if (newest>=0)
+        waits[newest].newer = w;
+    else
+        oldest = w;
+    newest = w;
+    nwaiting++;
+
+    // to the tail of its keys FIFO
+
+    int slot = lookup(h, key);
+    if (!table[slot])
+    {
+        if (2*(nkeys+1) > (int)table.size())
+        {
+            grow();
+            slot = lookup(h, key);
+        }
+        table[slot] = w+1;
+        nkeys++;
+    }
+    else
+    {
+        int t = table[slot]-1;
+        while (waits[t].next>=0)
+            t = waits[t].next;
+        waits[t].next = w;
+    }
+}
+
+void FixDiff::unmatched(const DiffWait& W)
+{
+    if (W.side==0)
+    {
+        nmissing++;
+        out.put("missing ");
+    }
+    else
+    {
+        nextra++;
+        out.put("extra   ");
+    }
+    out.put(W.key);
+    out.put(W.side ? " [actual @" : " [expected @");
+    out.put_int(W.offset);
+    out.put("]\n");
+    out.end_record();
+}
+
+void FixDiff::evict()
+{
+    // give up on the oldest waiting msg
+
+    DiffWait& W = waits[oldest];
+    int slot = lookup(W.hash, W.key);
+
+    // the oldest is always the head of its keys FIFO [later ones with the key came later]
+
+    assert(table[slot]-1==oldest);
+
+    int w = take(slot);
+    unmatched(waits[w]);
+    release(w);
+    nevicted++;
+}
+
+void FixDiff::msg(int side, const char* p, int len, long long off)
+{
+    FixMessageView& v = side ? vb : va;
+    v.parse(p, len);
+
+    // key from the key tags that are there
+
+    key.clear();
+    for (int k=0;k<(int)keytags.size();k++)
+    {
+        int i = v.find(keytags[k]);
+        if (i<0)
+            continue;
+        if (!key.empty())
+            key.push_back(' ');
+        key.append(v.tag_text(i), v.flds[i].tlen);
+        key.push_back('=');
+        key.append(v.value(i), v.flds[i].vlen);
+    }
+
+    unsigned long long h = key_hash(key.data(), key.length());
+    int slot = lookup(h, key);
+
+    if (table[slot] && waits[table[slot]-1].side!=side)
+    {
+        int w = take(slot);
+        DiffWait& W = waits[w];
+        nmatched++;
+        FixMessageView& vw = side ? va : vb;
+        vw.parse(W.msg.data(), W.msg.length());
+        if (side)
+            compare(W.offset, off);
+        else
+            compare(off, W.offset);
+        release(w);
+        return;
+    }
+
+    put(side, h, p, len, off);
+    if (nwaiting > window)
+        evict();
+}
+
+void FixDiff::list_fields(const FixMessageView& v, const vector<char>* bytype, vector<DiffField>& fl)
+{
+    fl.clear();
+    for (int i=0;i<v.nflds;i++)
+    {
+        int tag = v.flds[i].tag;
+        if (ignored(tag, bytype))
+            continue;
+
+        DiffField f = { tag, 0, v.value(i), v.flds[i].vlen };
+        if (tag>=0 && tag<FixMessageView::NTAGS)
+            f.occ = tagocc[tag]++;
+        fl.push_back(f);
+    }
+    for (int i=0;i<(int)fl.size();i++)
+        if (fl[i].tag>=0 && fl[i].tag<FixMessageView::NTAGS)
+            tagocc[fl[i].tag] = 0;
+}
+
+bool FixDiff::ignored(int tag, const vector<char>* bytype) const
+{
+    return tag>=0 && tag<FixMessageView::NTAGS && (ignore[tag] || (bytype && (*bytype)[tag]));
+}
+
+bool FixDiff::same(const vector<char>* bytype) const
+{
+    int ia = 0, ib = 0;
+    while (true)
+    {
+        while (ia<va.nflds && ignored(va.flds[ia].tag, bytype))
+            ia++;
+        while (ib<vb.nflds && ignored(vb.flds[ib].tag, bytype))
+            ib++;
+        if (ia==va.nflds || ib==vb.nflds)
+            return ia==va.nflds && ib==vb.nflds;
+
+        const FixField& a = va.flds[ia++];
+        const FixField& b = vb.flds[ib++];
+        if (a.tag!=b.tag || a.vlen!=b.vlen || memcmp(va.sz+a.voff, vb.sz+b.voff, a.vlen))
+            return false;
+    }
+}
+
+void FixDiff::put_value(const DiffField* f)
+{
+    if (f)
+        out.put(f->v, f->vlen);
+    else
+        out.put('-');
+}
+
+void FixDiff::compare(long long offa, long long offb)
+{
+    const vector<char>* bytype = NULL;
+    if (!ignore_by_type.empty())
+    {
+        const char* mt;
+        int nmt;
+        if (va.get(35, mt, nmt))
+        {
+            map<string, vector<char> >::iterator p = ignore_by_type.find(string(mt, nmt));
+            if (p!=ignore_by_type.end())
+                bytype = &p->second;
+        }
+    }
+
+    // same fields in the same order - the common case, straight off the views
+
+    if (same(bytype))
+        return;
+
+    // by tag and occurrence
+
+    list_fields(va, bytype, fa);
+    list_fields(vb, bytype, fb);
+    stable_sort(fa.begin(), fa.end());
+    stable_sort(fb.begin(), fb.end());
+
+    int ndiffs = 0;
+    int ia = 0, ib = 0;
+    while (ia<(int)fa.size() || ib<(int)fb.size())
+    {
+        const DiffField* a = ia<(int)fa.size() ? &fa[ia] : NULL;
+        const DiffField* b = ib<(int)fb.size() ? &fb[ib] : NULL;
+
+        if (a && b && !(*a<*b) && !(*b<*a))
+        {
+            ia++, ib++;
+            if (a->vlen==b->vlen && 0==memcmp(a->v, b->v, a->vlen))
+                continue;
+        }
+        else if (a && (!b || *a<*b))
+        {
+            ia++;
+            b = NULL;
+        }
+        else
+        {
+            ib++;
+            a = NULL;
+        }
+
+        if (!ndiffs++)
+        {
+            out.put("differs ");
+            out.put(key);
+            out.put(" [@");
+            out.put_int(offa);
+            out.put(" @");
+            out.put_int(offb);
+            out.put("]\n");
+        }
+
+        out.put("    ");
+        out.put_int(a ? a->tag : b->tag);
+        out.put("  ");
+        put_value(a);
+        out.put(" => ");
+        put_value(b);
+        out.put('\n');
+    }
+
+    if (!ndiffs)
+    {
+        // same fields, another order
+
+        out.put("differs ");
+        out.put(key);
+        out.put(" [@");
+        out.put_int(offa);
+        out.put(" @");
+        out.put_int(offb);
+        out.put("]\n    field order\n");
+        ndiffs++;
+    }
+
+    out.end_record();
+    ndiffer++;
+}
+
+void FixDiff::finish()
+{
+    // what still waits has no match
+
+    while (oldest>=0)
+    {
+        int w = oldest;
+        int slot = lookup(waits[w].hash, waits[w].key);
+        take(slot);
+        unmatched(waits[w]);
+        release(w);
+    }
+    out.flush();
+}
+
+
+static void split_tags(const string& s, vector<string>& parts)
+{
+    for (size_t a=0; a<s.length(); )
+    {
+        size_t b = s.find(',', a);
+        if (b==string::npos)
+            b = s.length();
+        if (b>a)
+            parts.push_back(s.substr(a, b-a));
+        a = b+1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // handle args
+
+    mapss options;
+    options["key"]    = "35,11,17";
+    options["ignore"] = "9,10,34,52,122";
+    options["window"] = "1000000";
+
+    vector<const char*> files;
+    for (int i=1;i<argc;i++)
+    {
+        const char* szopt=argv[i];
+
+        if (0==strncmp(szopt, "--key=", 6) && strlen(szopt)>6)
+            options["key"] = szopt+6;
+        else if (0==strncmp(szopt, "--ignore=", 9))
+            options["ignore"] = szopt+9;
+        else if (0==strncmp(szopt, "--ignore+=", 10))
+            options["ignore"] += string(",") + (szopt+10);
+        else if (0==strncmp(szopt, "--window=", 9) && atoi(szopt+9)>0)
+            options["window"] = szopt+9;
+        else if (0==strncmp(szopt, "--delim=", 8))
+        {
+            options["delim"] = szopt+8;
+            if (options["delim"].compare("|") && options["delim"].compare("^A") && options["delim"].compare("any"))
+                fprintf(stderr,"Bad option --delim, use | ^A or any\n"), exit(-1);
+        }
+        else if (szopt[0]!='-' && files.size()<2)
+            files.push_back(szopt);
+        else
+            files.clear(), i=argc;
+    }
+
+    if (files.size()!=2)
+    {
+        fprintf(stderr,"USAGE: fixdiff [options] expected.log actual.log\n");
+        fprintf(stderr,"  option --key=35,11,17         : tags whose values key a msg [those present], default MsgType ClOrdID ExecID\n");
+        fprintf(stderr,"  option --ignore=9,10,34,52,122 : tags not compared, or msgtype:tag for one msg type only [this is the default]\n");
+        fprintf(stderr,"  option --ignore+=8:60,D:21    : .. ignore these as well\n");
+        fprintf(stderr,"  option --window=N             : msgs waiting for a match at most, then the oldest is unmatched [default 1000000]\n");
+        fprintf(stderr,"  option --delim=|  --delim=^A  : also take msgs from logs that render SOH as | or ^A [--delim=any for both]\n");
+        exit(-1);
+    }
+
+    OutBuf out(stdout);
+    FixDiff D(out, atoi(options["window"].c_str()));
+
+    vector<string> parts;
+    split_tags(options["key"], parts);
+    for (int i=0;i<(int)parts.size();i++)
+    {
+        int tag = atoi(parts[i].c_str());
+        if (tag<=0)
+            fprintf(stderr,"Bad option --key [%s]\n", parts[i].c_str()), exit(-1);
+        D.keytags.push_back(tag);
+    }
+
+    parts.clear();
+    split_tags(options["ignore"], parts);
+    for (int i=0;i<(int)parts.size();i++)
+        D.add_ignore(parts[i]);
+
+    DiffInput in[2];
+    for (int s=0;s<2;s++)
+    {
+        in[s].fd = open(files[s], O_RDONLY);
+        if (in[s].fd<0)
+            fprintf(stderr,"Cant read file [%s]\n", files[s]), exit(-1);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(in[s].fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        if (0==options["delim"].compare("|"))
+            in[s].framer.delims |= FIXDELIM_PIPE;
+        else if (0==options["delim"].compare("^A"))
+            in[s].framer.delims |= FIXDELIM_CARET;
+        else if (0==options["delim"].compare("any"))
+            in[s].framer.delims = FIXDELIM_ANY;
+    }
+
+    // in step by msg count, so matching msgs meet with little waiting
+
+    bool bdone[2] = { false, false };
+    while (!bdone[0] || !bdone[1])
+    {
+        int s = bdone[0] ? 1 : bdone[1] ? 0 : (in[0].nmsgs <= in[1].nmsgs ? 0 : 1);
+
+        const char* p;
+        int len;
+        long long off;
+        if (!in[s].next(p, len, off))
+        {
+            bdone[s] = true;
+            continue;
+        }
+        D.msg(s, p, len, off);
+    }
+
+    D.finish();
+    fflush(stdout);
+
+    fprintf(stderr, "fixdiff : %lld / %lld msgs, %lld matched, %lld differ, %lld missing, %lld extra",
+        in[0].nmsgs, in[1].nmsgs, D.nmatched, D.ndiffer, D.nmissing, D.nextra);
+    if (D.nevicted)
+        fprintf(stderr, " [%lld past the window]", D.nevicted);
+    fprintf(stderr, "\n");
+
+    return D.ndiffer || D.nmissing || D.nextra ? 1 : 0;
+}
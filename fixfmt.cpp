@@ -0,0 +1,395 @@
+//
+//  fixfmt.cpp - structured output formats for the fix tracer [json, csv]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+// OutBuf
+
+
+void OutBuf::put_int(long n)
+{
+    char tmp[24];
+    int i=sizeof(tmp);
+
+    bool bneg = n<0;
+    unsigned long u = bneg ? -(unsigned long)n : n;
+
+    do { tmp[--i] = '0' + u%10; u/=10; } while(u);
+    if (bneg)
+        tmp[--i] = '-';
+
+    buf.append(tmp+i, sizeof(tmp)-i);
+}
+
+void OutBuf::put_json(const char* sz, int len)
+{
+    // copy runs of plain chars in one go, escape the rest
+
+    static const char* hex = "0123456789abcdef";
+
+    buf.push_back('"');
+
+    const char* p    = sz;
+    const char* pend = sz+len;
+    const char* prun = p;
+
+    for (;p<pend;p++)
+    {
+        unsigned char c = *p;
+        if (c>=0x20 && c!='"' && c!='\\')
+            continue;
+
+        buf.append(prun, p-prun);
+        prun = p+1;
+
+        switch(c)
+        {
+            case '"':   buf.append("\\\"", 2); break;
+            case '\\':  buf.append("\\\\", 2); break;
+            case '\n':  buf.append("\\n", 2);  break;
+            case '\r':  buf.append("\\r", 2);  break;
+            case '\t':  buf.append("\\t", 2);  break;
+            default:
+                buf.append("\\u00", 4);
+                buf.push_back(hex[c>>4]);
+                buf.push_back(hex[c&15]);
+        }
+    }
+    buf.append(prun, p-prun);
+
+    buf.push_back('"');
+}
+
+void OutBuf::put_csv(const char* sz, int len)
+{
+    // rfc4180 : quote if value has a comma, quote or line break, and double the quotes
+
+    const char* pend = sz+len;
+    const char* p;
+
+    for (p=sz;p<pend;p++)
+        if (*p==',' || *p=='"' || *p=='\n' || *p=='\r')
+            break;
+
+    if (p==pend)
+    {
+        buf.append(sz, len);
+        return;
+    }
+
+    buf.push_back('"');
+    for (p=sz;p<pend;p++)
+    {
+        if (*p=='"')
+            buf.push_back('"');
+        buf.push_back(*p);
+    }
+    buf.push_back('"');
+}
+
+
+// JsonTraceSink
+
+
+void JsonTraceSink::msg_info(const char* skey, const char* sval)
+{
+    info.put(',');
+    info.put_json(skey);
+    info.put(':');
+    info.put_json(sval);
+}
+
+void JsonTraceSink::begin_msg(const char* sz, int len)
+{
+    nmsg++;
+    depth=0;
+    first[0]=true;
+    scope[0]=NULL;
+    msgtype="";
+    errs.buf.clear();
+
+    if (berrors_only)
+        return;
+
+    out.put("{\"msg\":");
+    out.put_int(nmsg);
+    out.put(info.buf);
+    info.buf.clear();
+    first[0]=false;
+}
+
+void JsonTraceSink::end_msg()
+{
+    if (berrors_only)
+    {
+        info.buf.clear();
+        out.end_record();
+        return;
+    }
+
+    if (errs.buf.size())
+    {
+        out.put(",\"errors\":[");
+        out.put(errs.buf);
+        out.put(']');
+    }
+    out.put("}\n");
+    out.end_record();
+}
+
+void JsonTraceSink::begin_scope(const char* skey, XNode* xspec)
+{
+    if (0==strcmp(skey, "body"))
+        msgtype = xspec->att("msgtype");
+
+    if (berrors_only)
+    {
+        push(xspec);
+        return;
+    }
+
+    sep();
+
+    if (0==strcmp(skey, "body"))
+    {
+        out.put("\"msgtype\":");
+        out.put_json(xspec->att("msgtype"));
+        out.put(",\"name\":");
+        out.put_json(xspec->att("name"));
+        out.put(',');
+    }
+
+    out.put('"');
+    out.put(skey);
+    out.put("\":{");
+    push(xspec);
+}
+
+void JsonTraceSink::end_scope(XNode* xspec)
+{
+    if (!berrors_only)
+        out.put('}');
+    pop();
+}
+
+void JsonTraceSink::begin_group(XNode* xgroup, int nreps)
+{
+    if (berrors_only)
+    {
+        push(xgroup);
+        return;
+    }
+
+    sep();
+    out.put_json(xgroup->att("name"));
+    out.put(":[");
+    push(xgroup);
+}
+
+void JsonTraceSink::end_group(XNode* xgroup)
+{
+    if (!berrors_only)
+        out.put(']');
+    pop();
+}
+
+void JsonTraceSink::begin_repeat(XNode* xgroup)
+{
+    if (berrors_only)
+    {
+        push(xgroup);
+        return;
+    }
+
+    sep();
+    out.put('{');
+    push(xgroup);
+}
+
+void JsonTraceSink::end_repeat(XNode* xgroup)
+{
+    if (!berrors_only)
+        out.put('}');
+    pop();
+}
+
+void JsonTraceSink::field(XNode* xfield, const string& val)
+{
+    if (berrors_only)
+        return;
+
+    sep();
+    out.put_json(xfield->att("name"));
+    out.put(':');
+    out.put_json(val);
+}
+
+void JsonTraceSink::error(int code, XNode* xfield, const string& fld)
+{
+    // {"error":"missing field","scope":"NewOrderSingle","tag":"60","name":"TransactTime"}
+    // errors only mode writes straight out, with the msg number and type up front
+
+    if (berrors_only)
+    {
+        errs.buf.clear();
+        errs.put("{\"msg\":");
+        errs.put_int(nmsg);
+        errs.put(info.buf);
+        errs.put(",\"msgtype\":");
+        errs.put_json(msgtype);
+        errs.put(',');
+    }
+    else
+    {
+        if (errs.buf.size())
+            errs.put(',');
+        errs.put('{');
+    }
+
+    errs.put("\"error\":");
+    errs.put_json(trace_error_name(code));
+
+    XNode* xscope = scope[depth];
+    if (xscope)
+    {
+        errs.put(",\"scope\":");
+        errs.put_json(xscope->att("name"));
+    }
+
+    errs.put(",\"tag\":");
+    errs.put_json(fld);
+
+    if (xfield)
+    {
+        errs.put(",\"name\":");
+        errs.put_json(xfield->att("name"));
+    }
+    errs.put('}');
+
+    if (berrors_only)
+    {
+        out.put(errs.buf);
+        out.put('\n');
+    }
+}
+
+
+// CsvTraceSink
+
+
+void CsvTraceSink::row(const char* tag, int ntag, const char* name, const char* val, int nval, const char* err)
+{
+    out.put_int(nmsg);
+    out.put(',');
+    out.put_csv(spath);
+    out.put(',');
+    out.put_csv(tag, ntag);
+    out.put(',');
+    out.put_csv(name);
+    out.put(',');
+    out.put_csv(val, nval);
+    out.put(',');
+    out.put_csv(err);
+    out.put('\n');
+}
+
+void CsvTraceSink::header()
+{
+    if (!bheader)
+        out.put("msg,path,tag,name,value,error\n");
+    bheader=true;
+}
+
+void CsvTraceSink::msg_info(const char* skey, const char* sval)
+{
+    // comes before begin_msg, so for msg nmsg+1
+
+    header();
+
+    out.put_int(nmsg+1);
+    out.put(",msg,,");
+    out.put_csv(skey);
+    out.put(',');
+    out.put_csv(sval);
+    out.put(",\n");
+}
+
+void CsvTraceSink::begin_msg(const char* sz, int len)
+{
+    header();
+
+    nmsg++;
+    depth=0;
+    spath.clear();
+}
+
+void CsvTraceSink::end_msg()
+{
+    out.end_record();
+}
+
+void CsvTraceSink::begin_scope(const char* skey, XNode* xspec)
+{
+    push();
+    spath.append(skey);
+}
+
+void CsvTraceSink::end_scope(XNode* xspec)
+{
+    pop();
+}
+
+void CsvTraceSink::begin_group(XNode* xgroup, int nreps)
+{
+    push();
+    spath.push_back('.');
+    spath.append(xgroup->att("name"));
+}
+
+void CsvTraceSink::end_group(XNode* xgroup)
+{
+    pop();
+}
+
+void CsvTraceSink::begin_repeat(XNode* xgroup)
+{
+    // body.NoOrders[n]
+
+    char tmp[16];
+    int i=sizeof(tmp);
+    int n=nrep[depth]++;
+
+    tmp[--i]=']';
+    do { tmp[--i] = '0' + n%10; n/=10; } while(n);
+    tmp[--i]='[';
+
+    push();
+    spath.append(tmp+i, sizeof(tmp)-i);
+}
+
+void CsvTraceSink::end_repeat(XNode* xgroup)
+{
+    pop();
+}
+
+void CsvTraceSink::field(XNode* xfield, const string& val)
+{
+    const char* id = xfield->att("id");
+
+    row(id, strlen(id), xfield->att("name"), val.data(), val.length(), "");
+}
+
+void CsvTraceSink::error(int code, XNode* xfield, const string& fld)
+{
+    row(fld.data(), fld.length(), xfield ? xfield->att("name") : "", "", 0, trace_error_name(code));
+}
@@ -0,0 +1,208 @@
+//
+//  fixfmt.h - structured output formats for the fix tracer [json, csv]
+//
+//      sinks receive trace_fix_xspec events and write through OutBuf, which escapes by hand
+//      and writes in large blocks - no iostreams, no printf per field
+//
+#ifndef _FIXFMT_H_
+#define _FIXFMT_H_
+
+#include "fixcore.h"
+
+
+struct OutPipe
+{
+    // takes full blocks from an OutBuf [eg. to a writer thread] - swaps buf for an empty one
+
+    virtual ~OutPipe() {}
+    virtual void write_block(string& buf) = 0;
+};
+
+
+struct OutBuf
+{
+    // append only output buffer, flushed to fp in large blocks [fp NULL for in memory use]
+    // or handed to pipe whole, if set
+
+    enum { FLUSH_AT = 1<<16 };
+
+    FILE*       fp;
+    OutPipe*    pipe;
+    string      buf;
+
+    OutBuf(FILE* f=NULL)
+        : fp(f)
+        , pipe(NULL)
+    {
+        buf.reserve(FLUSH_AT*2);
+    }
+
+    ~OutBuf()
+    {
+        flush();
+    }
+
+    void put(char c)                        { buf.push_back(c); }
+    void put(const char* sz, int len)       { buf.append(sz, len); }
+    void put(const char* sz)                { buf.append(sz); }
+    void put(const string& s)               { buf.append(s); }
+
+    void put_int(long n);
+    void put_json(const char* sz, int len);         // "quoted" with json escapes
+    void put_json(const string& s)          { put_json(s.data(), s.length()); }
+    void put_json(const char* sz)           { put_json(sz ? sz : "", sz ? strlen(sz) : 0); }
+    void put_csv(const char* sz, int len);          // quoted only if it needs to be
+    void put_csv(const string& s)           { put_csv(s.data(), s.length()); }
+    void put_csv(const char* sz)            { put_csv(sz ? sz : "", sz ? strlen(sz) : 0); }
+
+    void end_record()
+    {
+        // called between records, so we only write out whole records
+
+        if ((fp || pipe) && (int)buf.size()>=FLUSH_AT)
+            flush();
+    }
+
+    void flush()
+    {
+        if (pipe)
+        {
+            if (buf.size())
+                pipe->write_block(buf);
+            return;
+        }
+
+        FIX_STAGE(STAGE_WRITE);
+
+        if (fp && buf.size())
+            fwrite(buf.data(), 1, buf.size(), fp);
+        if (fp)
+            buf.clear();
+    }
+};
+
+
+struct JsonTraceSink : TraceSink
+{
+    // one json object per line per message :
+    //  {"msg":1,"header":{..},"msgtype":"E","name":"NewOrderList","body":{..,"NoOrders":[{..},{..}]},"trailer":{..},"errors":[..]}
+    // or with berrors_only, one object per error :
+    //  {"msg":1,"msgtype":"D","error":"missing field","scope":"NewOrderSingle","tag":"60","name":"TransactTime"}
+
+    enum { MAXDEPTH = 64 };
+
+    OutBuf&     out;
+    OutBuf      errs;                   // error records, appended at end of msg
+    OutBuf      info;                   // msg_info members, written with the msg
+
+    bool        berrors_only;           // validate mode
+    int         nmsg;
+    int         depth;
+    const char* msgtype;
+    bool        first[MAXDEPTH];        // first member at each nesting level [no comma yet]
+    XNode*      scope[MAXDEPTH];        // spec at each nesting level [for error context]
+
+    JsonTraceSink(OutBuf& o, bool errors_only=false)
+        : out(o)
+        , berrors_only(errors_only)
+        , nmsg(0)
+        , depth(0)
+        , msgtype("")
+    {
+    }
+
+    void sep()
+    {
+        if (!first[depth])
+            out.put(',');
+        first[depth]=false;
+    }
+
+    void push(XNode* xspec)
+    {
+        if (depth+1<MAXDEPTH)
+            depth++;
+        first[depth]=true;
+        scope[depth]=xspec;
+    }
+
+    void pop()
+    {
+        if (depth>0)
+            depth--;
+    }
+
+    virtual void msg_info(const char* skey, const char* sval);
+    virtual void begin_msg(const char* sz, int len);
+    virtual void end_msg();
+    virtual void begin_scope(const char* skey, XNode* xspec);
+    virtual void end_scope(XNode* xspec);
+    virtual void begin_group(XNode* xgroup, int nreps);
+    virtual void end_group(XNode* xgroup);
+    virtual void begin_repeat(XNode* xgroup);
+    virtual void end_repeat(XNode* xgroup);
+    virtual void field(XNode* xfield, const string& val);
+    virtual void error(int code, XNode* xfield, const string& fld);
+    virtual void skip_msgs(int n)       { nmsg = n; }
+};
+
+
+struct CsvTraceSink : TraceSink
+{
+    // one row per field or error :  msg,path,tag,name,value,error
+    //  path shows scope and group repeat eg. body.NoOrders[1]
+    //  msg_info values are rows with path "msg" and no tag
+
+    enum { MAXDEPTH = 64 };
+
+    OutBuf&     out;
+
+    bool        bheader;                // column names written
+    int         nmsg;
+    int         depth;
+    int         pathlen[MAXDEPTH];      // length of spath at each nesting level, to pop back to
+    int         nrep[MAXDEPTH];         // group repeat index at each nesting level
+    string      spath;
+
+    CsvTraceSink(OutBuf& o)
+        : out(o)
+        , bheader(false)
+        , nmsg(0)
+        , depth(0)
+    {
+        spath.reserve(256);
+    }
+
+    void push()
+    {
+        if (depth+1<MAXDEPTH)
+            depth++;
+        pathlen[depth]=spath.length();
+        nrep[depth]=0;
+    }
+
+    void pop()
+    {
+        spath.resize(pathlen[depth]);
+        if (depth>0)
+            depth--;
+    }
+
+    void row(const char* tag, int ntag, const char* name, const char* val, int nval, const char* err);
+    void header();
+
+    virtual void msg_info(const char* skey, const char* sval);
+    virtual void begin_msg(const char* sz, int len);
+    virtual void end_msg();
+    virtual void begin_scope(const char* skey, XNode* xspec);
+    virtual void end_scope(XNode* xspec);
+    virtual void begin_group(XNode* xgroup, int nreps);
+    virtual void end_group(XNode* xgroup);
+    virtual void begin_repeat(XNode* xgroup);
+    virtual void end_repeat(XNode* xgroup);
+    virtual void field(XNode* xfield, const string& val);
+    virtual void error(int code, XNode* xfield, const string& fld);
+    virtual void skip_msgs(int n)       { nmsg = n; bheader = n>0; }
+};
+
+#endif //_FIXFMT_H_
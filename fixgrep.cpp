@@ -0,0 +1,690 @@
+//
+//  fixgrep.cpp - find the fix msgs that match tag predicates, across many log files at once
+//
+//      USAGE fixgrep [options] -e 35=D [-e 55=IBM ..] dir|file|glob ..
+//
+//      directories are walked for files [--include=*.log to pick them by name], globs expanded, then files are
+//      mmapped and searched on a pool of threads - files over 64MB in ranges, each range picking up at the first
+//      msg that starts in it
+//
+//      work stealing : each thread has a deque of ranges, largest first, and takes from its front - a thread out of
+//      work takes from the back of another threads deque, so a few big files dont leave the others idle
+//
+//      msgs are framed as fixtr frames them, and the predicates tested on the raw fields - no spec per msg
+//
+//          35=D        a field with the tag has the value          [any repeat in a group]
+//          55!=IBM     .. no field with the tag has the value
+//          58~reject   .. contains the text
+//          38>1000     .. numeric compare [< >]
+//          11          .. the tag is in the msg
+//
+//      all of them must hold - tags by number, or by name with the spec [-S, loaded once, only when needed]
+//
+//      each match as file:offset: and the msg as it is in the file, or with --format=json as fixtr --format=json traces it
+//      [the msg number is per thread] - matches of a range come in file order, ranges in the order they finish
+//
+//      exit status 0 if any msg matched, 1 if none
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <ctype.h>
+#include <cassert>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+enum GrepOp
+{
+    GREP_EQ = 0,
+    GREP_NE,
+    GREP_HAS,                           // ~ contains
+    GREP_LT,
+    GREP_GT,
+    GREP_PRESENT
+};
+
+struct GrepPred
+{
+    string          stag;               // as given, number or name
+    int             tag;
+    int             op;
+    string          val;
+    double          num;                // for < >
+    int             next;               // next predicate on the same tag, -1 none
+};
+
+struct GrepFile
+{
+    string          path;
+    long long       size;
+};
+
+struct GrepRange
+{
+    int             ifile;
+    long long       start;              // msgs starting in [start, end)
+    long long       end;
+};
+
+struct FixGrep;
+
+struct GrepWorker
+{
+    FixGrep&                G;
+    int                     id;
+
+    std::mutex              mtx;        // ranges
+    std::deque<GrepRange>   ranges;
+
+    OutBuf                  out;        // matches, written out whole under the output lock
+    TraceContext*           ctx;        // json trace
+    JsonTraceSink*          json;
+    vector<char>            sat;        // by predicate, for the msg
+    string                  norm;       // msg with rendered delimiters, normalized to SOH
+
+    long long               nmsgs;
+    long long               nmatched;
+    long long               nbytes;
+
+    GrepWorker(FixGrep& g, int i);
+    ~GrepWorker();
+
+    bool    take(GrepRange& R);
+    bool    steal(GrepRange& R);
+    void    run();
+    void    search(const GrepRange& R);
+    bool    match(const char* p, int len);
+    void    put_match(const GrepFile& F, long long off, const char* raw, int rawlen, const char* p, int len);
+    void    flush();
+};
+
+struct FixGrep
+{
+    enum { RANGE = 64<<20 };
+
+    vector<GrepFile>        files;
+    vector<GrepPred>        preds;
+    vector<int>             first;      // first predicate by tag, -1 none
+    bool                    bpositive;  // no != predicates : a msg is done once all hold
+    int                     delims;
+
+    MessageGenerator*       MG;         // json only
+    vector<GrepWorker*>     workers;
+    std::mutex              outmtx;
+
+    FixGrep()
+        : first(FixMessageView::NTAGS, -1)
+        , bpositive(true)
+        , delims(FIXDELIM_SOH)
+        , MG(NULL)
+    {
+    }
+
+    void    add_path(const char* szpath, const string& include);
+    void    walk(const string& dir, const string& include);
+    void    add_file(const string& path);
+    bool    add_pred(const char* szpred);
+    bool    resolve(MessageGenerator* mg);          // tags by name, false if one isnt known
+    void    run(int nthreads);
+};
+
+
+// FixGrep
+
+
+void FixGrep::add_file(const string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) || !S_ISREG(st.st_mode))
+        return;
+
+    GrepFile F = { path, (long long)st.st_size };
+    files.push_back(F);
+}
+
+void FixGrep::walk(const string& dir, const string& include)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+    {
+        fprintf(stderr, "Cant read directory [%s]\n", dir.c_str());
+        return;
+    }
+
+    vector<string> names;
+    while (dirent* e = readdir(d))
+        if (e->d_name[0]!='.')
+            names.push_back(e->d_name);
+    closedir(d);
+    sort(names.begin(), names.end());
+
+    for (int i=0;i<(int)names.size();i++)
+    {
+        string path = dir + (dir.size() && dir[dir.size()-1]=='/' ? "" : "/") + names[i];
+
+        struct stat st;
+        if (stat(path.c_str(), &st))
+            continue;
+        if (S_ISDIR(st.st_mode))
+            walk(path, include);
+        else if (S_ISREG(st.st_mode) && (include.empty() || 0==fnmatch(include.c_str(), names[i].c_str(), 0)))
+            add_file(path);
+    }
+}
+
+void FixGrep::add_path(const char* szpath, const string& include)
+{
+    // a glob [quoted, so not expanded by the shell], a directory, or a file
+
+    if (strpbrk(szpath, "*?["))
+    {
+        glob_t g;
+        if (0==glob(szpath, 0, NULL, &g))
+        {
+            for (size_t i=0;i<g.gl_pathc;i++)
+                add_path(g.gl_pathv[i], include);
+        }
+        else
+            fprintf(stderr, "No files match [%s]\n", szpath);
+        globfree(&g);
+        return;
+    }
+
+    struct stat st;
+    if (stat(szpath, &st))
+        fprintf(stderr, "Cant read file [%s]\n", szpath);
+    else if (S_ISDIR(st.st_mode))
+        walk(szpath, include);
+    else
+        add_file(szpath);
+}
+
+bool FixGrep::add_pred(const char* szpred)
+{
+    // tag[op value] - the tag is digits or a field name
+
+    const char* q = szpred;
+    while (*q && (isalnum((unsigned char)*q) || *q=='_'))
+        q++;
+
+    GrepPred P;
+    P.stag = string(szpred, q-szpred);
+    P.tag  = 0;
+    P.num  = 0;
+    P.next = -1;
+
+    if (!*q)
+        P.op = GREP_PRESENT;
+    else if (0==strncmp(q, "!=", 2))
+        P.op = GREP_NE, q+=2;
+    else if (*q=='=')
+        P.op = GREP_EQ, q++;
+    else if (*q=='~')
+        P.op = GREP_HAS, q++;
+    else if (*q=='<')
+        P.op = GREP_LT, q++;
+    else if (*q=='>')
+        P.op = GREP_GT, q++;
+    else
+        return false;
+
+    P.val = q;
+    if (P.op==GREP_LT || P.op==GREP_GT)
+    {
+        char* e;
+        P.num = strtod(P.val.c_str(), &e);
+        if (P.val.empty() || *e)
+            return false;
+    }
+
+    if (P.stag.empty())
+        return false;
+
+    preds.push_back(P);
+    if (P.op==GREP_NE)
+        bpositive = false;
+    return true;
+}
+
+bool FixGrep::resolve(MessageGenerator* mg)
+{
+    for (int i=0;i<(int)preds.size();i++)
+    {
+        GrepPred& P = preds[i];
+
+        string id = P.stag;
+        if (mg && mg->fields_by_name.count(id))
+            id = mg->fields_by_name[id];
+
+        P.tag = atoi(id.c_str());
+        if (P.tag<=0 || P.tag>=FixMessageView::NTAGS || id!=int_to_string(P.tag))
+        {
+            fprintf(stderr, "Bad predicate, no field [%s]\n", P.stag.c_str());
+            return false;
+        }
+
+        P.next = first[P.tag];
+        first[P.tag] = i;
+    }
+    return true;
+}
+
+static bool range_larger(const GrepRange& a, const GrepRange& b)
+{
+    return a.end-a.start > b.end-b.start;
+}
+
+void FixGrep::run(int nthreads)
+{
+    // ranges of RANGE bytes, dealt out largest first round the workers
+
+    vector<GrepRange> all;
+    for (int f=0;f<(int)files.size();f++)
+        for (long long s=0; s<files[f].size; s+=RANGE)
+        {
+            GrepRange R = { f, s, min(files[f].size, s+RANGE) };
+            all.push_back(R);
+        }
+    stable_sort(all.begin(), all.end(), range_larger);
+
+    nthreads = max(1, min(nthreads, (int)all.size()));
+    for (int i=0;i<nthreads;i++)
+        workers.push_back(new GrepWorker(*this, i));
+    for (int i=0;i<(int)all.size();i++)
+        workers[i%nthreads]->ranges.push_back(all[i]);
+
+    vector<std::thread*> threads;
+    for (int i=1;i<nthreads;i++)
+        threads.push_back(new std::thread(&GrepWorker::run, workers[i]));
+    workers[0]->run();
+
+    for (int i=0;i<(int)threads.size();i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    fflush(stdout);
+}
+
+
+// GrepWorker
+
+
+GrepWorker::GrepWorker(FixGrep& g, int i)
+    : G(g)
+    , id(i)
+    , ctx(NULL)
+    , json(NULL)
+    , sat(g.preds.size(), 0)
+    , nmsgs(0)
+    , nmatched(0)
+    , nbytes(0)
+{
+    if (G.MG)
+    {
+        ctx  = new TraceContext(*G.MG);
+        json = new JsonTraceSink(out);
+    }
+}
+
+GrepWorker::~GrepWorker()
+{
+    delete json;
+    delete ctx;
+}
+
+bool GrepWorker::take(GrepRange& R)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (ranges.empty())
+        return false;
+    R = ranges.front();
+    ranges.pop_front();
+    return true;
+}
+
+bool GrepWorker::steal(GrepRange& R)
+{
+    // from the back of the others, starting after this one
+
+    int n = G.workers.size();
+    for (int k=1;k<n;k++)
+    {
+        GrepWorker* W = G.workers[(id+k)%n];
+        std::lock_guard<std::mutex> lock(W->mtx);
+        if (W->ranges.empty())
+            continue;
+        R = W->ranges.back();
+        W->ranges.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void GrepWorker::run()
+{
+    GrepRange R;
+    while (true)
+    {
+        // nothing here or anywhere - ranges are never added, so no more to come
+
+        if (!take(R) && !steal(R))
+            break;
+        search(R);
+    }
+    flush();
+}
+
+void GrepWorker::flush()
+{
+    if (out.buf.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(G.outmtx);
+    fwrite(out.buf.data(), 1, out.buf.size(), stdout);
+    out.buf.clear();
+}
+
+bool GrepWorker::match(const char* p, int len)
+{
+    // one pass over the fields, only those with predicates looked at
+
+    const char* e = p+len;
+    int npreds = G.preds.size();
+    int nsat = 0;
+    memset(&sat[0], 0, npreds);
+
+    while (p<e)
+    {
+        int tag = 0;
+        const char* q = p;
+        while (q<e && *q>='0' && *q<='9')
+            tag = tag*10 + (*q++ - '0');
+        if (q==p || q>=e || *q!='=')
+            break;
+
+        const char* v = q+1;
+        const char* s = (const char*)memchr(v, '\001', e-v);
+        if (!s)
+            s = e;
+        p = s+1;
+
+        if (tag>=FixMessageView::NTAGS)
+            continue;
+
+        int n = s-v;
+        for (int i=G.first[tag]; i>=0; i=G.preds[i].next)
+        {
+            if (sat[i])
+                continue;
+
+            const GrepPred& P = G.preds[i];
+            bool b = false;
+            switch (P.op)
+            {
+            case GREP_EQ:
+            case GREP_NE:
+                b = n==(int)P.val.length() && 0==memcmp(v, P.val.data(), n);
+                break;
+            case GREP_HAS:
+                b = (int)P.val.length()<=n && memmem(v, n, P.val.data(), P.val.length());
+                break;
+            case GREP_LT:
+            case GREP_GT:
+            {
+                char sz[64];
+                if (n>0 && n<(int)sizeof(sz))
+                {
+                    memcpy(sz, v, n);
+                    sz[n] = 0;
+                    char* end;
+                    double d = strtod(sz, &end);
+                    b = !*end && (P.op==GREP_LT ? d<P.num : d>P.num);
+                }
+                break;
+            }
+            case GREP_PRESENT:
+                b = true;
+                break;
+            }
+
+            if (b)
+            {
+                sat[i] = 1;
+                nsat++;
+            }
+        }
+
+        // every predicate holds, nothing later can change that
+
+        if (G.bpositive && nsat==npreds)
+            return true;
+    }
+
+    for (int i=0;i<npreds;i++)
+        if ((G.preds[i].op==GREP_NE) == (sat[i]!=0))
+            return false;
+    return true;
+}
+
+void GrepWorker::put_match(const GrepFile& F, long long off, const char* raw, int rawlen, const char* p, int len)
+{
+    // raw : the msg as in the file, p : normalized to SOH
+    char sz[32];
+    string at = F.path + ":" + string(sz, sprintf(sz, "%lld", off));
+
+    if (!json)
+    {
+        out.put(at);
+        out.put(": ");
+        out.put(raw, rawlen);
+        out.put('\n');
+    }
+    else
+    {
+        if (G.MG->msg_bad(p, len, false))
+            return;
+        json->msg_info("at", at.c_str());
+        G.MG->trace_msg(p, len, *json, *ctx, true);
+    }
+
+    nmatched++;
+    if ((int)out.buf.size() >= OutBuf::FLUSH_AT)
+        flush();
+}
+
+void GrepWorker::search(const GrepRange& R)
+{
+    const GrepFile& F = G.files[R.ifile];
+
+    int fd = open(F.path.c_str(), O_RDONLY);
+    if (fd<0)
+    {
+        fprintf(stderr, "Cant read file [%s]\n", F.path.c_str());
+        return;
+    }
+
+    // from the range start to the file end [the last msg may run past the range], mapped on page boundaries
+
+    long long pg = sysconf(_SC_PAGESIZE);
+    long long mstart = R.start/pg*pg;
+    long long msize = F.size-mstart;
+
+    void* m = mmap(NULL, msize, PROT_READ, MAP_PRIVATE, fd, mstart);
+    close(fd);
+    if (m==MAP_FAILED)
+    {
+        fprintf(stderr, "Cant map file [%s]\n", F.path.c_str());
+        return;
+    }
+    madvise(m, msize, MADV_SEQUENTIAL);
+
+    const char* base = (const char*)m - mstart;       // base+offset is the file byte at offset
+    const int WINDOW = 1<<30;
+
+    long long s = R.start;
+    while (s < F.size)
+    {
+        int n = (int)min((long long)WINDOW, F.size-s);
+        bool beof = s+n==F.size;
+
+        int off, len, used;
+        int kind = fix_frame_next(base+s, n, beof, true, off, len, used, G.delims);
+        if (kind)
+        {
+            long long at = s+off;
+            if (at >= R.end)
+                break;
+
+            const char* p = base+at;
+            int rawlen = len;
+            if (kind!=FIXDELIM_SOH)
+            {
+                norm.assign(p, len);
+                len = fix_normalize(&norm[0], len, kind);
+                p = norm.data();
+            }
+
+            nmsgs++;
+            if (match(p, len))
+                put_match(F, at, base+at, rawlen, p, len);
+        }
+        else if (!used)
+            break;
+
+        s += used;
+    }
+
+    nbytes += R.end-R.start;
+    munmap(m, msize);
+    flush();
+}
+
+
+int main(int argc, char *argv[])
+{
+    // handle args
+
+    const char* szfile = "./spec/FIX44.xml";
+
+    mapss options;
+    options["threads"] = int_to_string(max(1, (int)std::thread::hardware_concurrency()));
+
+    FixGrep G;
+    vector<const char*> paths;
+    bool busage = false;
+
+    for (int i=1;i<argc;i++)
+    {
+        const char* szopt=argv[i];
+
+        if (0==strncmp(szopt, "-S=", 3) && strlen(szopt)>3)
+            szfile = szopt+3;
+        else if (0==strcmp(szopt, "-e") && i+1<argc)
+            busage = !G.add_pred(argv[++i]) || busage;
+        else if (0==strncmp(szopt, "--threads=", 10) && atoi(szopt+10)>0)
+            options["threads"] = szopt+10;
+        else if (0==strncmp(szopt, "--include=", 10))
+            options["include"] = szopt+10;
+        else if (0==strncmp(szopt, "--format=", 9))
+        {
+            options["format"] = szopt+9;
+            if (options["format"].compare("raw") && options["format"].compare("json"))
+                fprintf(stderr,"Bad option --format, use raw or json\n"), exit(-1);
+        }
+        else if (0==strncmp(szopt, "--delim=", 8))
+        {
+            options["delim"] = szopt+8;
+            if (options["delim"].compare("|") && options["delim"].compare("^A") && options["delim"].compare("any"))
+                fprintf(stderr,"Bad option --delim, use | ^A or any\n"), exit(-1);
+        }
+        else if (szopt[0]!='-')
+            paths.push_back(szopt);
+        else
+            busage = true;
+    }
+
+    if (busage || G.preds.empty() || paths.empty())
+    {
+        fprintf(stderr,"USAGE: fixgrep [options] -e 35=D {-e 55=IBM ..} dir|file|'glob' ..\n");
+        fprintf(stderr,"  predicate tag=value tag!=value tag~text tag<n tag>n tag : all must hold [tags by number or name]\n");
+        fprintf(stderr,"  option --include=*.log        : files in directories by name\n");
+        fprintf(stderr,"  option --threads=N            : search threads [default one per core]\n");
+        fprintf(stderr,"  option --format=raw|json      : matches as they are in the file, or traced as fixtr --format=json [default raw]\n");
+        fprintf(stderr,"  option -S=./spec/FIXnn.xml    : spec for field names and json\n");
+        fprintf(stderr,"  option --delim=|  --delim=^A  : also take msgs from logs that render SOH as | or ^A [--delim=any for both]\n");
+        exit(-1);
+    }
+
+    if (0==options["delim"].compare("|"))
+        G.delims |= FIXDELIM_PIPE;
+    else if (0==options["delim"].compare("^A"))
+        G.delims |= FIXDELIM_CARET;
+    else if (0==options["delim"].compare("any"))
+        G.delims = FIXDELIM_ANY;
+
+    // the spec only if a tag is named, or for json
+
+    bool bspec = 0==options["format"].compare("json");
+    for (int i=0;i<(int)G.preds.size();i++)
+        bspec = bspec || !isdigit((unsigned char)G.preds[i].stag[0]);
+
+    XNode* ndfix = NULL;
+    MessageGenerator* MG = NULL;
+    if (bspec)
+    {
+        if (access(szfile, R_OK))
+            fprintf(stderr,"Cant read file [%s]\n", szfile), exit(-1);
+
+        ndfix = parse_fix_spec_xml(szfile);
+        if (!ndfix)
+            exit(-1);
+        MG = new MessageGenerator(ndfix);
+        MG->expand_specs();
+    }
+
+    if (!G.resolve(MG))
+        exit(-1);
+    if (0==options["format"].compare("json"))
+        G.MG = MG;
+
+    for (int i=0;i<(int)paths.size();i++)
+        G.add_path(paths[i], options["include"]);
+
+    long long t0 = fix_nanos();
+    G.run(atoi(options["threads"].c_str()));
+    double secs = (fix_nanos()-t0)/1e9;
+
+    long long nmsgs = 0, nmatched = 0, nbytes = 0;
+    for (int i=0;i<(int)G.workers.size();i++)
+    {
+        nmsgs    += G.workers[i]->nmsgs;
+        nmatched += G.workers[i]->nmatched;
+        nbytes   += G.workers[i]->nbytes;
+        delete G.workers[i];
+    }
+
+    fprintf(stderr, "fixgrep : %d files, %.1f MB, %lld msgs, %lld matched, %d threads, %.2fs [%.0f MB/s]\n",
+        (int)G.files.size(), nbytes/1e6, nmsgs, nmatched, (int)G.workers.size(), secs, secs>0 ? nbytes/1e6/secs : 0);
+
+    delete MG;
+    delete ndfix;
+    return nmatched ? 0 : 1;
+}
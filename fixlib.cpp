@@ -0,0 +1,331 @@
+//
+//  fixlib.cpp - libfixcore C API over the framer and trace walk [see fixlib.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <set>
+#include <mutex>
+
+#include "fixcore.h"
+#include "fixreload.h"
+#include "fixlib.h"
+
+
+static_assert((int)FIXCORE_BAD_FIELD==(int)TRACE_BAD_FIELD && (int)FIXCORE_BAD_VALUE==(int)TRACE_BAD_VALUE, "fixcore_error out of step with TraceError");
+static_assert((int)FIXCORE_TYPE_DECIMAL==(int)VTYPE_FLOAT && (int)FIXCORE_TYPE_TIMESTAMP==(int)VTYPE_TIMESTAMP, "fixcore_type out of step with ValueType");
+
+
+struct fixcore_spec
+{
+    FixSpecHolder       holder;             // sessions read the current snapshot, reloads swap it [fixreload.h]
+
+    fixcore_spec(const char* szfile, SpecSnapshot* S)
+        : holder(szfile, S)
+    {
+    }
+};
+
+
+struct LibSink : TraceSink
+{
+    // trace events to the callers callbacks : scope names for errors, group depth for fields
+
+    enum { MAXDEPTH = 64 };
+
+    fixcore_callbacks   cb;
+    void*               user;
+    int                 depth;
+    XNode*              scope[MAXDEPTH];
+
+    LibSink(const fixcore_callbacks* c, void* u)
+        : user(u)
+        , depth(0)
+    {
+        if (c)
+            cb = *c;
+        else
+            memset(&cb, 0, sizeof(cb));
+        scope[0] = NULL;
+    }
+
+    void push(XNode* xspec)
+    {
+        if (depth+1<MAXDEPTH)
+            depth++;
+        scope[depth]=xspec;
+    }
+
+    void pop()
+    {
+        if (depth>0)
+            depth--;
+    }
+
+    static int tag_of(XNode* x)         { const char* id = x ? x->att("id") : NULL; return id ? atoi(id) : -1; }
+    static const char* name_of(XNode* x){ const char* nm = x ? x->att("name") : NULL; return nm ? nm : ""; }
+
+    // header / body / trailer are depth 1, each group repeat one more
+
+    virtual void begin_msg(const char* sz, int len)             { depth=0; scope[0]=NULL; }
+    virtual void begin_scope(const char* skey, XNode* xspec)    { push(xspec); }
+    virtual void end_scope(XNode* xspec)                        { pop(); }
+    virtual void begin_repeat(XNode* xgroup)                    { push(xgroup); }
+    virtual void end_repeat(XNode* xgroup)                      { pop(); }
+
+    virtual void begin_group(XNode* xgroup, int nreps)
+    {
+        if (cb.group)
+            cb.group(user, tag_of(xgroup), name_of(xgroup), nreps, depth-1);
+    }
+
+    virtual void field(XNode* xfield, const string& val)
+    {
+        if (cb.field)
+            cb.field(user, tag_of(xfield), name_of(xfield), val.data(), val.length(), depth-1);
+    }
+
+    virtual void error(int code, XNode* xfield, const string& fld)
+    {
+        if (cb.error)
+            cb.error(user, code, fld.c_str(), name_of(xfield), name_of(scope[depth]));
+    }
+};
+
+
+struct fixcore_session;
+
+static thread_local fixcore_session* tls_session = NULL;   // whose callbacks are running on this thread
+
+
+struct fixcore_session
+{
+    fixcore_spec*   spec;
+    SpecReader      reader;
+    LibSink         sink;
+    TraceContext    ctx;
+    FixFramer       framer;
+    bool            bvalues;
+
+    fixcore_session(fixcore_spec* sp, const fixcore_callbacks* cb, void* user, int flags)
+        : spec(sp)
+        , reader(sp->holder)
+        , sink(cb, user)
+        , ctx(*reader.snap->MG)
+        , framer(!(flags & FIXCORE_RAW))
+        , bvalues(!(flags & FIXCORE_VALIDATE))
+    {
+        ctx.bstrict = flags & FIXCORE_STRICT;
+
+        framer.delims = FIXDELIM_SOH;
+        if (flags & FIXCORE_DELIM_PIPE)
+            framer.delims |= FIXDELIM_PIPE;
+        if (flags & FIXCORE_DELIM_CARET)
+            framer.delims |= FIXDELIM_CARET;
+    }
+
+    int frame()
+    {
+        // trace every msg now complete in the framer, each against the spec current when it starts
+
+        int nmsgs = 0;
+        fixcore_session* outer = tls_session;
+        tls_session = this;
+
+        const char* p;
+        int len;
+        long long off;
+        while (framer.next(p, len, off))
+        {
+            nmsgs++;
+
+            if (reader.refresh())
+                ctx.size_for(*reader.snap->MG);
+            MessageGenerator& MG = *reader.snap->MG;
+
+            if (sink.cb.msg)
+                sink.cb.msg(sink.user, p, len, off);
+
+            if (MG.msg_bad(p, len, false))
+            {
+                if (sink.cb.error)
+                    sink.cb.error(sink.user, FIXCORE_BAD_MSG, "", "", "");
+                continue;
+            }
+
+            MG.trace_msg(p, len, sink, ctx, bvalues);
+
+            if (sink.cb.end_msg)
+                sink.cb.end_msg(sink.user, ctx.msgtype.c_str());
+        }
+
+        tls_session = outer;
+        return nmsgs;
+    }
+};
+
+
+struct SpecUse
+{
+    // the snapshot a call from outside the trace may read - in a sessions callbacks the one that session holds,
+    // else the current one under the holders lock, so a reload cant free it meanwhile
+
+    std::unique_lock<std::mutex>    lock;
+    SpecSnapshot*                   snap;
+
+    SpecUse(fixcore_spec* spec)
+    {
+        if (tls_session && tls_session->spec==spec)
+            snap = tls_session->reader.snap;
+        else
+        {
+            lock = std::unique_lock<std::mutex>(spec->holder.mtx);
+            snap = spec->holder.cur.load();
+        }
+    }
+};
+
+
+fixcore_spec* fixcore_spec_load(const char* szfile)
+{
+    SpecSnapshot* S = SpecSnapshot::load(szfile, false);  // expanded now, so sessions only ever read the spec
+    if (!S)
+        return NULL;
+
+    fixcore_spec* spec = new fixcore_spec(szfile, S);
+    spec->holder.start();                       // so a reload can be asked for from a signal handler
+    return spec;
+}
+
+void fixcore_spec_free(fixcore_spec* spec)
+{
+    delete spec;
+}
+
+int fixcore_spec_reload(fixcore_spec* spec, const char* szfile)
+{
+    if (!spec)
+        return -1;
+
+    if (szfile)
+        spec->holder.request(szfile);
+    else
+        spec->holder.request();
+    return 0;
+}
+
+long long fixcore_spec_epoch(fixcore_spec* spec)
+{
+    if (!spec)
+        return 0;
+
+    SpecUse use(spec);
+    return use.snap->epoch;
+}
+
+int fixcore_spec_reload_status(fixcore_spec* spec, long long* nreloads, long long* nfailed)
+{
+    if (!spec)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(spec->holder.mtx);
+    if (nreloads)
+        *nreloads = spec->holder.nreloads;
+    if (nfailed)
+        *nfailed = spec->holder.nfailed;
+    return spec->holder.lastreload;
+}
+
+const char* fixcore_spec_version(fixcore_spec* spec)
+{
+    // kept for good, so the string outlives a reload
+
+    static std::mutex mtx;
+    static std::set<string> versions;
+
+    if (!spec)
+        return "";
+
+    SpecUse use(spec);
+    std::lock_guard<std::mutex> lock(mtx);
+    return versions.insert(use.snap->MG->prelude).first->c_str();
+}
+
+fixcore_session* fixcore_session_new(fixcore_spec* spec, const fixcore_callbacks* cb, void* user, int flags)
+{
+    if (!spec)
+        return NULL;
+
+    return new fixcore_session(spec, cb, user, flags);
+}
+
+int fixcore_feed(fixcore_session* sess, const char* p, int n)
+{
+    if (!sess || n<0 || sess->framer.beof)
+        return -1;
+
+    sess->framer.append(p, n);
+    return sess->frame();
+}
+
+int fixcore_finish(fixcore_session* sess)
+{
+    if (!sess)
+        return -1;
+
+    sess->framer.beof = true;
+    return sess->frame();
+}
+
+void fixcore_session_free(fixcore_session* sess)
+{
+    delete sess;
+}
+
+const char* fixcore_error_name(int code)
+{
+    if (code==FIXCORE_BAD_MSG)
+        return "bad msg";
+    return trace_error_name(code);
+}
+
+int fixcore_field_type(fixcore_spec* spec, int tag)
+{
+    if (!spec)
+        return FIXCORE_TYPE_TEXT;
+
+    SpecUse use(spec);
+    MessageGenerator& MG = *use.snap->MG;
+
+    mapsx::iterator p = MG.fields.find(int_to_string(tag));            // find, not [] - the spec is shared
+    if (p==MG.fields.end())
+        return FIXCORE_TYPE_TEXT;
+
+    return fix_value_type(p->second->att("type"));
+}
+
+int fixcore_parse_int(const char* v, int n, long long* val)
+{
+    return fix_parse_int(v, n, *val);
+}
+
+int fixcore_parse_decimal(const char* v, int n, long long* mant, int* scale)
+{
+    FixDecimal d;
+    if (!fix_parse_decimal(v, n, d))
+        return 0;
+
+    *mant  = d.mant;
+    *scale = d.scale;
+    return 1;
+}
+
+int fixcore_parse_timestamp(const char* v, int n, long long* nanos)
+{
+    return fix_parse_timestamp(v, n, *nanos);
+}
@@ -0,0 +1,113 @@
+//
+//  fixlib.h - libfixcore : trace and validate fix msgs in process, C API [usable as is from C++]
+//
+//      spec   = fixcore_spec_load("spec/FIX44.xml");           // once, shared by any number of sessions
+//      sess   = fixcore_session_new(spec, &callbacks, user, flags);
+//      fixcore_feed(sess, bytes, n);                           // as bytes arrive, any boundaries
+//      fixcore_finish(sess);                                   // end of input
+//      fixcore_session_free(sess);  fixcore_spec_free(spec);
+//
+//      msgs are framed by BodyLength, checked, and walked against the spec - the callbacks are called
+//      on the feeding thread, pointers passed to them are only valid during the call
+//
+//      a session is single threaded, but sessions are independent : a spec is read only once loaded,
+//      so concurrent sessions on one spec [one per thread] need no locking
+//
+//      fixcore_spec_reload(spec, NULL) rebuilds the spec from its file on a background thread [eg. on SIGHUP, after
+//      a venue adds custom tags] - sessions move to it at their next msg, without waiting, and the old spec is
+//      freed once they all have - a spec that doesnt load is not published, fixcore_spec_reload_status says so
+//
+//      the library writes nothing to stderr : errors come back through return values and the error callback
+//
+//      link with -lfixcore -lxml2 -pthread [static] or -lfixcore [shared]
+//
+#ifndef _FIXLIB_H_
+#define _FIXLIB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIXCORE_API __attribute__((visibility("default")))
+
+
+typedef struct fixcore_spec     fixcore_spec;
+typedef struct fixcore_session  fixcore_session;
+
+
+enum fixcore_flags
+{
+    FIXCORE_VALIDATE    = 1,            // errors only, no field or group callbacks
+    FIXCORE_STRICT      = 2,            // also check values against the field type and enums
+    FIXCORE_RAW         = 4,            // input is a raw session stream, not log lines [no resync at end of line]
+    FIXCORE_DELIM_PIPE  = 8,            // also take msgs with SOH rendered as |
+    FIXCORE_DELIM_CARET = 16            // also take msgs with SOH rendered as ^A
+};
+
+
+enum fixcore_error
+{
+    // same codes as the fixtr trace [TraceError], plus whole msg errors
+
+    FIXCORE_BAD_FIELD   = 1,            // field not in the spec for this scope
+    FIXCORE_MISSING,                    // required field not seen
+    FIXCORE_REPEATED,                   // field seen more than once in scope
+    FIXCORE_NO_GROUP_START,             // group repeat doesnt start with the groups first field
+    FIXCORE_BAD_MSGTYPE,                // msg type not in spec
+    FIXCORE_BAD_TYPE,                   // value doesnt parse as the fields type [strict]
+    FIXCORE_BAD_VALUE,                  // value not one of the fields enums [strict]
+    FIXCORE_BAD_MSG     = 100           // bad prelude or checksum, msg not walked
+};
+
+
+enum fixcore_type
+{
+    // field value types from the spec, for the typed decoders below [same codes as ValueType]
+
+    FIXCORE_TYPE_TEXT   = 0,            // STRING, DATA, dates ..
+    FIXCORE_TYPE_INT,                   // INT LENGTH NUMINGROUP SEQNUM ..
+    FIXCORE_TYPE_DECIMAL,               // PRICE QTY AMT FLOAT ..
+    FIXCORE_TYPE_CHAR,
+    FIXCORE_TYPE_BOOL,
+    FIXCORE_TYPE_TIMESTAMP              // UTCTIMESTAMP
+};
+
+
+typedef struct fixcore_callbacks
+{
+    // any may be NULL
+
+    void (*msg)(void* user, const char* msg, int len, long long offset);           // framed msg [offset in the stream], before its fields
+    void (*field)(void* user, int tag, const char* name, const char* val, int vlen, int depth);     // depth is group nesting, 0 outside groups
+    void (*group)(void* user, int tag, const char* name, int nreps, int depth);    // group count field, its repeats follow as fields at depth+1
+    void (*error)(void* user, int code, const char* tag, const char* name, const char* scope);      // name may be ""
+    void (*end_msg)(void* user, const char* msgtype);
+} fixcore_callbacks;
+
+
+FIXCORE_API fixcore_spec*       fixcore_spec_load(const char* szfile);         // NULL if it cant be read
+FIXCORE_API void                fixcore_spec_free(fixcore_spec* spec);          // after its sessions are freed
+FIXCORE_API const char*         fixcore_spec_version(fixcore_spec* spec);       // eg. FIX.4.4
+FIXCORE_API int                 fixcore_spec_reload(fixcore_spec* spec, const char* szfile);   // in the background [NULL : same file, async signal safe], returns at once
+FIXCORE_API long long           fixcore_spec_epoch(fixcore_spec* spec);         // 1 as loaded, +1 per reload published [in callbacks : the sessions]
+FIXCORE_API int                 fixcore_spec_reload_status(fixcore_spec* spec, long long* nreloads, long long* nfailed);   // last reload 1 published, 0 failed [spec kept], -1 none yet - counts if not NULL
+
+FIXCORE_API fixcore_session*    fixcore_session_new(fixcore_spec* spec, const fixcore_callbacks* cb, void* user, int flags);
+FIXCORE_API int                 fixcore_feed(fixcore_session* sess, const char* p, int n);     // msgs framed, callbacks done before it returns
+FIXCORE_API int                 fixcore_finish(fixcore_session* sess);          // end of input, frames what is left
+FIXCORE_API void                fixcore_session_free(fixcore_session* sess);
+
+FIXCORE_API const char*         fixcore_error_name(int code);
+
+// typed decoding of a field value in place [eg. from the field callback] - 1 if it parses, 0 if not
+
+FIXCORE_API int                 fixcore_field_type(fixcore_spec* spec, int tag);                     // fixcore_type
+FIXCORE_API int                 fixcore_parse_int(const char* v, int n, long long* val);
+FIXCORE_API int                 fixcore_parse_decimal(const char* v, int n, long long* mant, int* scale);   // mant / 10^scale
+FIXCORE_API int                 fixcore_parse_timestamp(const char* v, int n, long long* nanos);     // ns since epoch
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_FIXLIB_H_
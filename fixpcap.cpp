@@ -0,0 +1,558 @@
+//
+//  fixpcap.cpp - read fix msgs straight out of packet captures [see fixpcap.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "fixcore.h"
+#include "fixpcap.h"
+
+
+// PcapReader
+
+
+PcapReader::PcapReader()
+    : base(NULL)
+    , size(0)
+    , pos(0)
+    , bng(false)
+    , bswap(false)
+    , bnano(false)
+    , linktype(0)
+{
+}
+
+PcapReader::~PcapReader()
+{
+    if (base)
+        munmap((void*)base, size);
+}
+
+bool PcapReader::open(const char* szfile)
+{
+    int fd = ::open(szfile, O_RDONLY);
+    if (fd<0)
+        return fprintf(stderr, "Cant read file [%s]\n", szfile), false;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size<24)
+    {
+        close(fd);
+        return fprintf(stderr, "Not a pcap file [%s]\n", szfile), false;
+    }
+
+    size = st.st_size;
+    void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p==MAP_FAILED)
+        return fprintf(stderr, "Cant map file [%s]\n", szfile), false;
+
+    base = (const unsigned char*)p;
+    madvise(p, size, MADV_SEQUENTIAL);
+
+    unsigned magic;
+    memcpy(&magic, base, 4);
+
+    switch(magic)
+    {
+        case 0xa1b2c3d4:    bswap=false; bnano=false; break;
+        case 0xd4c3b2a1:    bswap=true;  bnano=false; break;
+        case 0xa1b23c4d:    bswap=false; bnano=true;  break;
+        case 0x4d3cb2a1:    bswap=true;  bnano=true;  break;
+        case 0x0a0d0d0a:    bng=true; break;
+        default:
+            return fprintf(stderr, "Not a pcap or pcapng file [%s]\n", szfile), false;
+    }
+
+    if (!bng)
+    {
+        linktype = u32(base+20) & 0xffff;
+        pos = 24;
+    }
+
+    return true;
+}
+
+int PcapReader::next(PcapPacket& pkt)
+{
+    return bng ? next_pcapng(pkt) : next_pcap(pkt);
+}
+
+int PcapReader::next_pcap(PcapPacket& pkt)
+{
+    // 16 byte record header : ts sec, ts usec [or nsec], caplen, origlen
+
+    if (pos+16 > size)
+        return 0;
+
+    const unsigned char* rec = base+pos;
+    unsigned caplen = u32(rec+8);
+
+    if (pos+16+caplen > size)
+        return 0;                               // truncated last record
+
+    pkt.ts_sec   = u32(rec);
+    pkt.ts_nsec  = bnano ? u32(rec+4) : u32(rec+4)*1000L;
+    pkt.caplen   = caplen;
+    pkt.data     = rec+16;
+    pkt.linktype = linktype;
+    pkt.offset   = pos;
+
+    pos += 16+caplen;
+    return 1;
+}
+
+int PcapReader::next_pcapng(PcapPacket& pkt)
+{
+    // walk blocks until the next packet : section header resets interfaces, interface blocks
+    // give link type and timestamp resolution, enhanced / simple packet blocks carry packets
+
+    while (pos+12 <= size)
+    {
+        const unsigned char* blk = base+pos;
+        unsigned type = u32(blk);
+
+        if (type==0x0a0d0d0a)
+        {
+            // section header : byte order magic decides endian for the whole section
+
+            unsigned bom;
+            memcpy(&bom, blk+8, 4);
+            if (bom==0x1a2b3c4d)
+                bswap=false;
+            else if (bom==0x4d3c2b1a)
+                bswap=true;
+            else
+                return -1;
+
+            if_linktype.clear();
+            if_tsunits.clear();
+        }
+
+        unsigned blen = u32(blk+4);
+        if (blen<12 || (blen&3) || pos+blen > size)
+            return blen<12 || (blen&3) ? -1 : 0;
+
+        pos += blen;
+
+        if (type==1 && blen>=20)
+        {
+            // interface description : linktype, snaplen, options [if_tsresol is code 9]
+
+            // 10^-n or 2^-n seconds - past 10^-19 or 2^-63 the units per second dont fit in 64 bits, so those
+            // timestamps are given as 0 [units 0] rather than overflow
+
+            unsigned long long units = 1000000;
+            const unsigned char* opt  = blk+16;
+            const unsigned char* oend = blk+blen-4;
+            while (opt+4 <= oend)
+            {
+                unsigned code = u16(opt);
+                unsigned olen = u16(opt+2);
+                if (code==0)
+                    break;
+                if (code==9 && olen>=1)
+                {
+                    int v = opt[4];
+                    int n = v&0x7f;
+                    units = 1;
+                    if (n > ((v&0x80) ? 63 : 19))
+                        units = 0;
+                    for (int i=0;i<n && units;i++)
+                        units *= (v&0x80) ? 2 : 10;
+                }
+                opt += 4 + ((olen+3)&~3);
+            }
+
+            if_linktype.push_back(u16(blk+8));
+            if_tsunits.push_back(units);
+        }
+        else if (type==6 && blen>=32)
+        {
+            // enhanced packet : interface id, ts high, ts low, caplen, origlen, data
+
+            unsigned ifid = u32(blk+8);
+            if (ifid >= if_linktype.size())
+                continue;
+
+            unsigned long long ts = ((unsigned long long)u32(blk+12)<<32) | u32(blk+16);
+            unsigned long long units = if_tsunits[ifid];
+
+            // the fraction in 128 bits, units can be up to 2^63
+
+            pkt.caplen   = min(u32(blk+20), blen-32);
+            pkt.data     = blk+28;
+            pkt.linktype = if_linktype[ifid];
+            pkt.ts_sec   = units ? ts/units : 0;
+            pkt.ts_nsec  = units ? (long)((unsigned __int128)(ts%units) * 1000000000 / units) : 0;
+            pkt.offset   = blk-base;
+            return 1;
+        }
+        else if (type==3 && blen>=16)
+        {
+            // simple packet : interface 0, no timestamp
+
+            if (if_linktype.empty())
+                continue;
+
+            pkt.caplen   = min(u32(blk+8), blen-16);
+            pkt.data     = blk+12;
+            pkt.linktype = if_linktype[0];
+            pkt.ts_sec   = 0;
+            pkt.ts_nsec  = 0;
+            pkt.offset   = blk-base;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// TcpFlowKey
+
+
+string TcpFlowKey::label() const
+{
+    char sa[INET6_ADDRSTRLEN], da[INET6_ADDRSTRLEN];
+    int af = family==6 ? AF_INET6 : AF_INET;
+
+    inet_ntop(af, src, sa, sizeof(sa));
+    inet_ntop(af, dst, da, sizeof(da));
+
+    char buf[2*INET6_ADDRSTRLEN+32];
+    snprintf(buf, sizeof(buf), family==6 ? "[%s]:%d>[%s]:%d" : "%s:%d>%s:%d", sa, sport, da, dport);
+    return buf;
+}
+
+
+// TcpReassembler
+
+
+TcpReassembler::~TcpReassembler()
+{
+    for (map<TcpFlowKey, TcpStream*>::iterator p=flows.begin();p!=flows.end();p++)
+        delete p->second;
+}
+
+void TcpReassembler::packet(const PcapPacket& pkt)
+{
+    // strip link layer, ip, find tcp payload
+
+    npackets++;
+
+    const unsigned char* p    = pkt.data;
+    const unsigned char* pend = pkt.data + pkt.caplen;
+    int ethertype = 0;
+
+    switch(pkt.linktype)
+    {
+        case 1:                                 // ethernet, with any vlan tags
+            if (pend-p < 14)
+                return;
+            ethertype = p[12]<<8 | p[13];
+            p += 14;
+            while ((ethertype==0x8100 || ethertype==0x88a8) && pend-p>=4)
+            {
+                ethertype = p[2]<<8 | p[3];
+                p += 4;
+            }
+            break;
+        case 113:                               // linux cooked
+            if (pend-p < 16)
+                return;
+            ethertype = p[14]<<8 | p[15];
+            p += 16;
+            break;
+        case 276:                               // linux cooked v2
+            if (pend-p < 20)
+                return;
+            ethertype = p[0]<<8 | p[1];
+            p += 20;
+            break;
+        case 0:                                 // bsd loopback, family in host order
+            if (pend-p < 4)
+                return;
+            p += 4;
+            ethertype = (pend>p && (*p>>4)==6) ? 0x86dd : 0x0800;
+            break;
+        case 12:
+        case 101:                               // raw ip
+            ethertype = (pend>p && (*p>>4)==6) ? 0x86dd : 0x0800;
+            break;
+        default:
+            return;
+    }
+
+    TcpFlowKey key;
+    memset(&key, 0, sizeof(key));
+
+    if (ethertype==0x0800)
+    {
+        if (pend-p < 20 || (p[0]>>4)!=4)
+            return;
+        int ihl   = (p[0]&15)*4;
+        int total = p[2]<<8 | p[3];
+        int frag  = (p[6]<<8 | p[7]) & 0x3fff;
+        if (p[9]!=6 || frag || ihl<20 || pend-p < ihl)
+            return;                             // not tcp, or a fragment
+        if (total>=ihl && total < pend-p)
+            pend = p+total;                     // ethernet padding
+
+        key.family = 4;
+        memcpy(key.src, p+12, 4);
+        memcpy(key.dst, p+16, 4);
+        p += ihl;
+    }
+    else if (ethertype==0x86dd)
+    {
+        if (pend-p < 40)
+            return;
+        int plen = p[4]<<8 | p[5];
+        int nh   = p[6];
+        key.family = 6;
+        memcpy(key.src, p+8, 16);
+        memcpy(key.dst, p+24, 16);
+        if (40+plen < pend-p)
+            pend = p+40+plen;
+        p += 40;
+
+        while (nh==0 || nh==43 || nh==60)       // hop by hop, routing, dest options
+        {
+            if (pend-p < 8)
+                return;
+            nh = p[0];
+            p += (p[1]+1)*8;
+        }
+        if (nh!=6)
+            return;
+    }
+    else
+        return;
+
+    if (pend-p < 20)
+        return;
+
+    int doff = (p[12]>>4)*4;
+    if (doff<20 || pend-p < doff)
+        return;
+
+    key.sport = p[0]<<8 | p[1];
+    key.dport = p[2]<<8 | p[3];
+
+    unsigned seq = (unsigned)p[4]<<24 | p[5]<<16 | p[6]<<8 | p[7];
+    int flags = p[13];
+
+    segment(pkt, key, seq, flags, p+doff, pend-(p+doff));
+}
+
+void TcpReassembler::segment(const PcapPacket& pkt, const TcpFlowKey& key, unsigned seq, int flags, const unsigned char* payload, int len)
+{
+    // the connection's stream, started afresh on a syn - ended on a rst, or once the bytes up to its fin are all in
+    // [a fin can come ahead of data still to arrive out of order]
+
+    const int SYN=0x02, FIN=0x01, RST=0x04;
+
+    if (len<=0 && !(flags & (SYN|FIN|RST)))
+        return;                                             // pure ack
+
+    map<TcpFlowKey, TcpStream*>::iterator pf = flows.find(key);
+    if (pf==flows.end())
+    {
+        if (!(flags & SYN) && len<=0)
+            return;                                         // fin or rst of a flow not open
+
+        // retransmits of a flow just closed neednt open it again
+
+        map<TcpFlowKey, unsigned>::iterator pc = closed.find(key);
+        if (pc!=closed.end())
+        {
+            if (!(flags & SYN) && (int)(seq+len - pc->second) <= 0)
+            {
+                nsegments++;
+                nretrans++;
+                return;
+            }
+            closed.erase(pc);
+        }
+
+        pf = flows.insert(make_pair(key, new TcpStream())).first;
+    }
+    TcpStream& S = *pf->second;
+
+    if (flags & SYN)
+    {
+        // new connection [data starts after the syn]
+
+        S.binit   = true;
+        S.nextseq = seq+1;
+        S.nextoff = 0;
+        S.framer.reset();
+        S.ooo.clear();
+        S.nooo    = 0;
+        S.bfin    = false;
+        seq++;
+    }
+
+    if (len>0)
+        place(S, pkt, key, seq, payload, len);
+
+    if ((flags & FIN) && !S.bfin)
+    {
+        S.bfin   = true;
+        S.finseq = seq+len;
+    }
+
+    if ((flags & RST) || (S.bfin && S.binit && (int)(S.nextseq - S.finseq) >= 0))
+        close_flow(pf);
+}
+
+void TcpReassembler::close_flow(map<TcpFlowKey, TcpStream*>::iterator pf)
+{
+    // remembered a while, so late retransmits are known as such
+
+    closed[pf->first] = pf->second->nextseq;
+    closedq.push_back(pf->first);
+    if ((int)closedq.size() > MAX_CLOSED)
+    {
+        closed.erase(closedq.front());
+        closedq.pop_front();
+    }
+
+    delete pf->second;
+    flows.erase(pf);
+}
+
+void TcpReassembler::place(TcpStream& S, const PcapPacket& pkt, const TcpFlowKey& key, unsigned seq, const unsigned char* payload, int len)
+{
+    // place the segment in its stream : in order bytes are appended and framed,
+    // retransmitted bytes trimmed, segments beyond a gap held until it fills
+
+    nsegments++;
+
+    if (!S.binit)
+    {
+        // joined mid stream
+
+        S.binit   = true;
+        S.nextseq = seq;
+    }
+
+    int d = (int)(seq - S.nextseq);
+
+    if (d<0)
+    {
+        // retransmit, all or part already seen
+
+        nretrans++;
+        if (len <= -d)
+            return;
+        payload += -d;
+        len     -= -d;
+        d = 0;
+    }
+
+    if (d>0)
+    {
+        // ahead of a gap : hold it, unless the gap looks like it will never fill
+
+        nooo++;
+        unsigned long long off = S.nextoff + d;
+        string& seg = S.ooo[off];
+        if ((int)seg.length() < len)
+        {
+            S.nooo += len - seg.length();
+            seg.assign((const char*)payload, len);
+        }
+
+        if (S.nooo <= MAX_OOO)
+            return;
+
+        // give up on the gap : drop the partial msg before it, carry on from the first held segment
+
+        ngaps++;
+        S.framer.reset();
+        S.nextseq += S.ooo.begin()->first - S.nextoff;
+        S.nextoff  = S.ooo.begin()->first;
+    }
+    else
+        append(S, payload, len);
+
+    // anything held that now follows on
+
+    while (!S.ooo.empty() && S.ooo.begin()->first <= S.nextoff)
+    {
+        map<unsigned long long, string>::iterator p = S.ooo.begin();
+        long long skip = S.nextoff - p->first;
+        if (skip < (long long)p->second.length())
+            append(S, (const unsigned char*)p->second.data()+skip, p->second.length()-skip);
+        S.nooo -= p->second.length();
+        S.ooo.erase(p);
+    }
+
+    frame(S, pkt, key);
+}
+
+void TcpReassembler::append(TcpStream& S, const unsigned char* p, int len)
+{
+    S.framer.append((const char*)p, len);
+    S.nextseq += len;
+    S.nextoff += len;
+}
+
+void TcpReassembler::frame(TcpStream& S, const PcapPacket& pkt, const TcpFlowKey& key)
+{
+    // complete msgs by BodyLength, straight out of the stream buffer [anything else is skipped]
+
+    const char* sz;
+    int len;
+    long long off;
+    while (S.framer.next(sz, len, off))
+    {
+        nmsgs++;
+        handler.fix_msg(sz, len, pkt, key);
+    }
+}
+
+void TcpReassembler::trace_summary(FILE* fp)
+{
+    fprintf(fp, "\npcap : %lld packets, %lld tcp segments, %lld retransmits, %lld out of order, %lld gaps skipped, %d flows open, %lld fix msgs\n",
+        npackets, nsegments, nretrans, nooo, ngaps, (int)flows.size(), nmsgs);
+}
+
+
+int pcap_trace_file(const char* szfile, FixMsgHandler& handler, FILE* fpsummary)
+{
+    // feed every packet of the capture through reassembly to the handler
+
+    PcapReader reader;
+    if (!reader.open(szfile))
+        return -1;
+
+    TcpReassembler tcp(handler);
+
+    PcapPacket pkt;
+    int ret;
+    while (1==(ret = reader.next(pkt)))
+        tcp.packet(pkt);
+
+    if (ret<0)
+        fprintf(stderr, "bad pcapng block in [%s]\n", szfile);
+
+    if (fpsummary)
+        tcp.trace_summary(fpsummary);
+
+    return ret;
+}
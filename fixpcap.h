@@ -0,0 +1,153 @@
+//
+//  fixpcap.h - read fix msgs straight out of packet captures
+//
+//      PcapReader      - pcap [usec / nsec] and pcapng files, mmapped, one packet at a time
+//      TcpReassembler  - per direction 4-tuple tcp streams, in order, with out of order segments held
+//                        until the gap fills and retransmits trimmed, fix msgs framed by BodyLength
+//                        straight out of the stream buffer - a flow ends on a rst, or on a fin once the
+//                        bytes before it are all in [a fin can come ahead of reordered data]
+//
+#ifndef _FIXPCAP_H_
+#define _FIXPCAP_H_
+
+#include <deque>
+
+#include "fixcore.h"
+
+
+struct PcapPacket
+{
+    const unsigned char*    data;
+    int                     caplen;
+    int                     linktype;           // DLT_ value, eg. 1 ethernet
+    long long               ts_sec;             // capture time
+    long                    ts_nsec;
+    long long               offset;             // file offset of the packet record
+};
+
+
+struct PcapReader
+{
+    // mmap whole file, walk records [pcap] or blocks [pcapng]
+
+    const unsigned char*    base;
+    size_t                  size;
+    size_t                  pos;
+
+    bool                    bng;                // pcapng
+    bool                    bswap;              // file is other endian
+    bool                    bnano;              // pcap : ns timestamps
+    int                     linktype;           // pcap : file link type
+
+    veci                    if_linktype;        // pcapng : per interface in current section
+    vector<unsigned long long> if_tsunits;      // pcapng : per interface timestamp units per second, 0 unknown
+
+    PcapReader();
+    ~PcapReader();
+
+    bool        open(const char* szfile);
+    int         next(PcapPacket& pkt);          // 1 packet, 0 eof, -1 bad file
+
+    unsigned    u32(const unsigned char* p)     { unsigned v; memcpy(&v, p, 4); return bswap ? __builtin_bswap32(v) : v; }
+    unsigned    u16(const unsigned char* p)     { unsigned short v; memcpy(&v, p, 2); return bswap ? __builtin_bswap16(v) : v; }
+
+    int         next_pcap(PcapPacket& pkt);
+    int         next_pcapng(PcapPacket& pkt);
+};
+
+
+struct TcpFlowKey
+{
+    // one direction of a tcp connection
+
+    unsigned char           src[16];
+    unsigned char           dst[16];
+    unsigned short          sport;
+    unsigned short          dport;
+    unsigned char           family;             // 4 or 6
+
+    bool operator<(const TcpFlowKey& k) const   { return memcmp(this, &k, sizeof(*this)) < 0; }
+
+    string  label() const;                      // 10.0.0.1:5001>10.0.0.2:9876
+};
+
+
+struct TcpStream
+{
+    bool                            binit;
+    unsigned                        nextseq;        // seq of next in order byte
+    unsigned long long              nextoff;        // stream offset of next in order byte
+
+    FixFramer                       framer;         // in order bytes not yet framed
+
+    map<unsigned long long, string> ooo;            // out of order segments by stream offset
+    int                             nooo;           // bytes held in ooo
+
+    bool                            bfin;           // fin seen - the flow ends once nextseq reaches finseq
+    unsigned                        finseq;
+
+    TcpStream()
+        : binit(false)
+        , nextseq(0)
+        , nextoff(0)
+        , framer(false)
+        , nooo(0)
+        , bfin(false)
+        , finseq(0)
+    {
+    }
+};
+
+
+struct FixMsgHandler
+{
+    // receives each framed fix msg, with the packet that completed it and its flow
+
+    virtual ~FixMsgHandler() {}
+    virtual void fix_msg(const char* sz, int len, const PcapPacket& pkt, const TcpFlowKey& flow) = 0;
+};
+
+
+struct TcpReassembler
+{
+    enum { MAX_OOO = 1<<22 };                       // bytes held for one gap before we give up on it
+    enum { MAX_CLOSED = 1<<16 };                    // closed flows remembered
+
+    FixMsgHandler&                  handler;
+    map<TcpFlowKey, TcpStream*>     flows;          // open, until rst or fin [or the end of the capture]
+    map<TcpFlowKey, unsigned>       closed;         // recently closed, seq they ended at
+    deque<TcpFlowKey>               closedq;        // .. oldest first
+
+    long long       npackets;
+    long long       nsegments;                      // tcp segments with payload
+    long long       nretrans;                       // segments [or parts] seen before
+    long long       nooo;                           // segments that arrived ahead of a gap
+    long long       ngaps;                          // gaps never filled, skipped
+    long long       nmsgs;
+
+    TcpReassembler(FixMsgHandler& h)
+        : handler(h)
+        , npackets(0)
+        , nsegments(0)
+        , nretrans(0)
+        , nooo(0)
+        , ngaps(0)
+        , nmsgs(0)
+    {
+    }
+
+    ~TcpReassembler();
+
+    void    packet(const PcapPacket& pkt);
+    void    segment(const PcapPacket& pkt, const TcpFlowKey& key, unsigned seq, int flags, const unsigned char* payload, int len);
+    void    close_flow(map<TcpFlowKey, TcpStream*>::iterator pf);
+    void    place(TcpStream& S, const PcapPacket& pkt, const TcpFlowKey& key, unsigned seq, const unsigned char* payload, int len);
+    void    append(TcpStream& S, const unsigned char* p, int len);
+    void    frame(TcpStream& S, const PcapPacket& pkt, const TcpFlowKey& key);
+    void    trace_summary(FILE* fp);
+};
+
+
+int     pcap_trace_file(const char* szfile, FixMsgHandler& handler, FILE* fpsummary);
+
+#endif //_FIXPCAP_H_
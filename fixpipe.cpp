@@ -0,0 +1,255 @@
+//
+//  fixpipe.cpp - pipelined trace, one thread per stage [see fixpipe.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixpipe.h"
+
+
+FixPipeline::FixPipeline(int fdin, FILE* fp, PipeMsgHandler& h)
+    : fd(fdin)
+    , fpout(fp)
+    , handler(h)
+    , delims(FIXDELIM_SOH)
+    , filled(NCHUNKS)
+    , freed(NCHUNKS)
+    , msgs(NMSGS)
+    , blocks(NBLOCKS)
+{
+    // all chunks start on the free ring, output blocks at full size
+
+    for (int i=0;i<NCHUNKS;i++)
+    {
+        PipeChunk* C = new PipeChunk();
+        C->buf.resize(CHUNKSZ);
+        C->len    = 0;
+        C->offset = 0;
+        chunks.push_back(C);
+
+        *freed.claim() = C;
+        freed.publish();
+    }
+
+    for (int i=0;i<blocks.capacity();i++)
+        blocks.slots[i].reserve(OutBuf::FLUSH_AT*2);
+}
+
+FixPipeline::~FixPipeline()
+{
+    for (int i=0;i<(int)chunks.size();i++)
+        delete chunks[i];
+}
+
+static int chunk_cut(const char* p, int n, int delims)
+{
+    // how much of p[0..n) holds only whole msgs [and text between them] :
+    // up to the last 8=FIX, or past it if its msg is complete here
+    // [a msg with a bad BodyLength runs to end of line, as in fix_frame_next]
+
+    const char* q = NULL;
+    for (const char* r=p+n; r>p && NULL!=(r=(const char*)memrchr(p, '8', r-p)); )
+    {
+        if (p+n-r >= 5 && 0==memcmp(r, "8=FIX", 5))
+        {
+            q = r;
+            break;
+        }
+    }
+
+    if (!q)
+        return max(0, n-4);                         // keep a tail that could start "8=FIX"
+
+    int kind;
+    int len = fix_candidate_length(q, p+n-q, delims, kind);
+    if (len>0)
+        return q-p + len;
+    if (len<0)
+    {
+        const char* nl = (const char*)memchr(q, '\n', p+n-q);
+        if (nl)
+            return nl+1-p;
+    }
+    return q-p;
+}
+
+void FixPipeline::reader()
+{
+    // fill a free chunk, cut it after its last whole msg, carry the rest over to the next chunk
+    // one read per chunk unless it doesnt hold a whole msg yet, so a slow live feed isnt held back
+
+    string      carry;
+    long long   ntotal = 0;
+    bool        beof = false;
+
+    while (!beof)
+    {
+        PipeChunk* C = *freed.peek_wait();
+        freed.release();
+
+        int n = carry.length();
+        if (n >= (int)C->buf.size())
+            C->buf.resize(n*2);
+        memcpy(&C->buf[0], carry.data(), n);
+        C->offset = ntotal - n;
+
+        int ncut = 0;
+        while (true)
+        {
+            if (n == (int)C->buf.size())
+                C->buf.resize(C->buf.size()*2);         // a msg longer than the chunk
+
+            int r;
+            {
+                FIX_STAGE(STAGE_READ);
+                r = read(fd, &C->buf[n], C->buf.size()-n);
+            }
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+            {
+                beof = true;
+                break;
+            }
+            FIX_COUNT(COUNT_BYTES_IN, r);
+
+            n      += r;
+            ntotal += r;
+
+            {
+                FIX_STAGE(STAGE_FIND);
+                ncut = chunk_cut(C->buf.data(), n, delims);
+            }
+            if (ncut>0)
+                break;
+        }
+
+        if (beof)
+            ncut = n;
+
+        C->len = ncut;
+        carry.assign(C->buf.data()+ncut, n-ncut);
+
+        *filled.claim_wait() = C;
+        filled.publish();
+    }
+
+    filled.done();
+}
+
+void FixPipeline::framer()
+{
+    // frame each chunk on its own [it ends on a msg boundary], then the end of chunk marker
+
+    PipeChunk** pC;
+    while (NULL != (pC = filled.peek_wait()))
+    {
+        PipeChunk* C = *pC;
+        filled.release();
+
+        char* p = &C->buf[0];
+        int s = 0;
+        while (true)
+        {
+            int ret, off, len, used;
+            {
+                FIX_STAGE(STAGE_FIND);
+                ret = fix_frame_next(p+s, C->len-s, true, true, off, len, used, delims);
+            }
+            if (!ret)
+                break;
+
+            if (ret!=FIXDELIM_SOH)
+                len = fix_normalize(p+s+off, len, ret);
+
+            PipeMsg* M = msgs.claim_wait();
+            M->chunk  = C;
+            M->p      = p+s+off;
+            M->len    = len;
+            M->offset = C->offset + s+off;
+            msgs.publish();
+
+            s += used;
+        }
+
+        PipeMsg* M = msgs.claim_wait();
+        M->chunk = C;
+        M->p     = NULL;
+        msgs.publish();
+    }
+
+    msgs.done();
+}
+
+void FixPipeline::tracer()
+{
+    PipeMsg* M;
+    while (NULL != (M = msgs.peek_wait()))
+    {
+        if (!M->p)
+        {
+            PipeChunk* C = M->chunk;
+            msgs.release();
+
+            *freed.claim_wait() = C;
+            freed.publish();
+            continue;
+        }
+
+        handler.pipe_msg(M->p, M->len, M->offset);
+        msgs.release();
+    }
+
+    handler.finish();
+    blocks.done();
+}
+
+void FixPipeline::writer()
+{
+    string* s;
+    while (NULL != (s = blocks.peek_wait()))
+    {
+        {
+            FIX_STAGE(STAGE_WRITE);
+            fwrite(s->data(), 1, s->size(), fpout);
+        }
+        s->clear();
+        blocks.release();
+    }
+
+    fflush(fpout);
+}
+
+void FixPipeline::write_block(string& buf)
+{
+    // on the tracer thread : hand over the full block, take back an empty one
+
+    string* s = blocks.claim_wait();
+    s->swap(buf);
+    blocks.publish();
+}
+
+void FixPipeline::run()
+{
+    // reader on this thread
+
+    std::thread tframer(&FixPipeline::framer, this);
+    std::thread ttracer(&FixPipeline::tracer, this);
+    std::thread twriter(&FixPipeline::writer, this);
+
+    reader();
+
+    tframer.join();
+    ttracer.join();
+    twriter.join();
+}
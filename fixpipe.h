@@ -0,0 +1,78 @@
+//
+//  fixpipe.h - pipelined trace of a continuous input, one thread per stage
+//
+//      reader  - read() into pooled chunks, cut after the last whole msg [a part msg is carried to the next chunk]
+//      framer  - frame msgs by BodyLength [fix_frame_next], skipping text between them
+//      tracer  - per msg handler [spec walk, formatting into an OutBuf]
+//      writer  - write OutBuf blocks to the output
+//
+//      stages are joined by SpscRings of descriptors that point into the chunks - nothing is copied
+//      between stages, and chunks go back to the reader through a free ring once traced
+//
+#ifndef _FIXPIPE_H_
+#define _FIXPIPE_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixring.h"
+
+
+struct PipeChunk
+{
+    string          buf;                // whole msgs, and any text between them
+    int             len;
+    long long       offset;             // input offset of buf[0]
+};
+
+
+struct PipeMsg
+{
+    // a msg in a chunk
+    // or with p NULL, the end of chunk [tracer hands the chunk back]
+
+    PipeChunk*      chunk;
+    const char*     p;
+    int             len;
+    long long       offset;             // input offset of p
+};
+
+
+struct PipeMsgHandler
+{
+    // called on the tracer thread
+
+    virtual ~PipeMsgHandler() {}
+    virtual void pipe_msg(const char* p, int len, long long offset) = 0;
+    virtual void finish() {}            // input done - flush output
+};
+
+
+struct FixPipeline : OutPipe
+{
+    enum { NCHUNKS = 8, CHUNKSZ = 1<<20, NMSGS = 1<<14, NBLOCKS = 8 };
+
+    int                     fd;
+    FILE*                   fpout;
+    PipeMsgHandler&         handler;
+    int                     delims;     // FIXDELIM_x accepted, as FixFramer
+
+    vector<PipeChunk*>      chunks;
+    SpscRing<PipeChunk*>    filled;     // reader -> framer
+    SpscRing<PipeChunk*>    freed;      // tracer -> reader
+    SpscRing<PipeMsg>       msgs;       // framer -> tracer
+    SpscRing<string>        blocks;     // tracer -> writer [swapped with OutBuf, so they keep capacity]
+
+    FixPipeline(int fdin, FILE* fp, PipeMsgHandler& h);
+    ~FixPipeline();
+
+    void    reader();
+    void    framer();
+    void    tracer();
+    void    writer();
+
+    virtual void write_block(string& buf);
+
+    void    run();
+};
+
+#endif //_FIXPIPE_H_
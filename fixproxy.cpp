@@ -0,0 +1,555 @@
+//
+//  fixproxy.cpp - inline tcp proxy with tracing off the forwarding path [see fixproxy.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "fixcore.h"
+#include "fixproxy.h"
+
+
+static volatile sig_atomic_t proxy_stop = 0;
+
+static void proxy_on_signal(int)
+{
+    proxy_stop = 1;
+}
+
+
+static bool split_host_port(const string& s, string& host, string& port)
+{
+    // "host:port", "[v6]:port" or just "port"
+
+    size_t n = s.rfind(':');
+    if (n==string::npos)
+    {
+        host = "";
+        port = s;
+    }
+    else
+    {
+        host = s.substr(0, n);
+        port = s.substr(n+1);
+        if (host.length()>=2 && host[0]=='[' && host[host.length()-1]==']')
+            host = host.substr(1, host.length()-2);
+    }
+    return !port.empty() && atoi(port.c_str())>0;
+}
+
+static void sock_label(int fd, bool bpeer, char* buf, int n)
+{
+    // ip:port of either end of a socket
+
+    struct sockaddr_storage sa;
+    socklen_t salen = sizeof(sa);
+    int ret = bpeer ? getpeername(fd, (struct sockaddr*)&sa, &salen) : getsockname(fd, (struct sockaddr*)&sa, &salen);
+
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    if (ret || getnameinfo((struct sockaddr*)&sa, salen, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST|NI_NUMERICSERV))
+        snprintf(buf, n, "?");
+    else if (sa.ss_family==AF_INET6)
+        snprintf(buf, n, "[%s]:%s", host, port);
+    else
+        snprintf(buf, n, "%s:%s", host, port);
+}
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+
+// FixProxy
+
+
+FixProxy::~FixProxy()
+{
+    while (!conns.empty())
+        close_conn(conns.size()-1);
+    if (fdlisten>=0)
+        close(fdlisten);
+}
+
+bool FixProxy::parse(const char* szspec)
+{
+    const char* p = strstr(szspec, "=>");
+    if (!p)
+        return false;
+
+    slisten  = string(szspec, p-szspec);
+    sconnect = p+2;
+
+    string host, port;
+    return split_host_port(slisten, host, port) && split_host_port(sconnect, host, port) && !host.empty();
+}
+
+bool FixProxy::listen()
+{
+    string host, port;
+    split_host_port(slisten, host, port);
+
+    struct addrinfo hints, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &ai))
+        return fprintf(stderr, "proxy : bad listen address [%s]\n", slisten.c_str()), false;
+
+    for (struct addrinfo* a=ai;a && fdlisten<0;a=a->ai_next)
+    {
+        int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd<0)
+            continue;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (bind(fd, a->ai_addr, a->ai_addrlen) || ::listen(fd, 16))
+        {
+            close(fd);
+            continue;
+        }
+        fdlisten = fd;
+    }
+    freeaddrinfo(ai);
+
+    if (fdlisten<0)
+        return fprintf(stderr, "proxy : cant listen on [%s]\n", slisten.c_str()), false;
+
+    fcntl(fdlisten, F_SETFL, fcntl(fdlisten, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+bool FixProxy::resolve()
+{
+    // the server addresses, looked up once rather than on the forwarding thread per client
+
+    string host, port;
+    split_host_port(sconnect, host, port);
+
+    struct addrinfo hints, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &ai))
+        return fprintf(stderr, "proxy : bad server address [%s]\n", sconnect.c_str()), false;
+
+    for (struct addrinfo* a=ai;a;a=a->ai_next)
+    {
+        ProxyAddr A;
+        memcpy(&A.sa, a->ai_addr, a->ai_addrlen);
+        A.salen = a->ai_addrlen;
+        upaddrs.push_back(A);
+    }
+    freeaddrinfo(ai);
+    return !upaddrs.empty();
+}
+
+void FixProxy::accept_conn()
+{
+    // new client : start the connect through to the server, the client waits on it [see connect_done]
+
+    int fd = accept(fdlisten, NULL, NULL);
+    if (fd<0)
+        return;
+
+    set_nonblocking(fd);
+
+    ProxyConn* C = new ProxyConn();
+    C->d[0].src = fd;
+    C->d[1].dst = fd;
+
+    if (!connect_next(C))
+    {
+        fprintf(stderr, "proxy : cant connect to [%s]\n", sconnect.c_str());
+        close(fd);
+        delete C;
+        return;
+    }
+
+    conns.push_back(C);
+}
+
+bool FixProxy::connect_next(ProxyConn* C)
+{
+    for (; C->naddr<(int)upaddrs.size(); C->naddr++)
+    {
+        const ProxyAddr& A = upaddrs[C->naddr];
+
+        int up = socket(A.sa.ss_family, SOCK_STREAM, 0);
+        if (up<0)
+            continue;
+        set_nonblocking(up);
+
+        if (connect(up, (const struct sockaddr*)&A.sa, A.salen) && errno!=EINPROGRESS)
+        {
+            close(up);
+            continue;
+        }
+
+        // in progress [or done already, as on loopback - the poll finds it writable at once]
+
+        C->d[0].dst = up;
+        C->d[1].src = up;
+        C->bconnecting = true;
+        return true;
+    }
+    return false;
+}
+
+int FixProxy::connect_done(ProxyConn* C)
+{
+    int up = C->d[0].dst;
+    int err = 0;
+    socklen_t errlen = sizeof(err);
+    if (getsockopt(up, SOL_SOCKET, SO_ERROR, &err, &errlen))
+        err = errno;
+
+    if (!err)
+    {
+        connected(C);
+        return 0;
+    }
+
+    // refused or unreachable : the next address, if any
+
+    close(up);
+    C->d[0].dst = -1;
+    C->d[1].src = -1;
+    C->naddr++;
+
+    if (connect_next(C))
+        return 0;
+
+    fprintf(stderr, "proxy : cant connect to [%s] [%s]\n", sconnect.c_str(), strerror(err));
+    return -1;
+}
+
+void FixProxy::connected(ProxyConn* C)
+{
+    int fd = C->d[0].src;
+    int up = C->d[0].dst;
+    C->bconnecting = false;
+
+    char sclient[64], sserver[64];
+    sock_label(fd, true, sclient, sizeof(sclient));
+    sock_label(up, true, sserver, sizeof(sserver));
+    snprintf(C->d[0].flow, sizeof(C->d[0].flow), "%s>%s", sclient, sserver);
+    snprintf(C->d[1].flow, sizeof(C->d[1].flow), "%s>%s", sserver, sclient);
+
+    nconns++;
+
+    fprintf(stderr, "proxy : open  %s\n", C->d[0].flow);
+}
+
+void FixProxy::close_conn(int i)
+{
+    ProxyConn* C = conns[i];
+
+    if (!C->bconnecting)
+        fprintf(stderr, "proxy : close %s\n", C->d[0].flow);
+
+    close(C->d[0].src);
+    if (C->d[0].dst>=0)
+        close(C->d[0].dst);
+    delete C;
+    conns.erase(conns.begin()+i);
+}
+
+int FixProxy::flush(ProxyDir& D)
+{
+    // write out what dst hasnt taken yet
+
+    while (D.wlen>0)
+    {
+        int w = send(D.dst, D.buf+D.woff, D.wlen, MSG_NOSIGNAL);
+        if (w<0)
+        {
+            if (errno==EINTR)
+                continue;
+            return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : -1;
+        }
+        D.woff += w;
+        D.wlen -= w;
+    }
+    return 0;
+}
+
+int FixProxy::forward(ProxyDir& D)
+{
+    // read, write straight back out of the same buffer, then [traffic gone] frame a copy for the tracer
+    // we dont read src again until dst has taken all of it, so a slow side slows its peer as tcp would
+
+    int n = read(D.src, D.buf, ProxyDir::BUFSZ);
+    if (n<0)
+        return (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) ? 0 : -1;
+
+    if (n==0)
+    {
+        D.beof = true;
+        shutdown(D.dst, SHUT_WR);
+        return 0;
+    }
+
+    nbytes  += n;
+    D.nread += n;
+    D.woff = 0;
+    D.wlen = n;
+
+    if (flush(D))
+        return -1;
+
+    frame(D, D.buf, n);
+    return 0;
+}
+
+void FixProxy::frame(ProxyDir& D, const char* p, int n)
+{
+    // complete msgs by BodyLength, straight out of the read buffer where we can
+    // only a msg split across reads is carried over in partial
+
+    if (!D.partial.empty())
+    {
+        D.partial.append(p, n);
+        p = D.partial.data();
+        n = D.partial.length();
+    }
+
+    long long off0 = D.nread - n;               // stream offset of p
+    int s = 0;
+
+    while (true)
+    {
+        int off, len, used;
+        int ret = fix_frame_next(p+s, n-s, false, false, off, len, used);
+
+        if (ret)
+            copy_msg(D, p+s+off, len, off0+s+off);
+        nresync += ret ? off : used;
+        s += used;
+
+        if (!ret)
+            break;
+    }
+
+    if (p==D.partial.data())
+        D.partial.erase(0, s);
+    else
+        D.partial.assign(p+s, n-s);
+}
+
+void FixProxy::copy_msg(ProxyDir& D, const char* p, int len, long long offset)
+{
+    // hand the tracer a copy, or drop it if the tracer is behind
+
+    nmsgs++;
+
+    ProxyMsg* m = ring.claim();
+    if (!m)
+    {
+        ndropped++;
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    m->data.assign(p, len);
+    m->ts_sec  = ts.tv_sec;
+    m->ts_nsec = ts.tv_nsec;
+    m->offset  = offset;
+    memcpy(m->flow, D.flow, sizeof(m->flow));
+
+    ring.publish();
+}
+
+void FixProxy::run()
+{
+    // one poll over the listener and every connection : each direction waits either for
+    // src to be readable, or for dst to take what it hasnt yet
+
+    vector<struct pollfd>   fds;
+    vector<int>             who;                // conn*2 + dir, -1 listener
+
+    while (!proxy_stop)
+    {
+        fds.clear();
+        who.clear();
+
+        struct pollfd pfd;
+        pfd.fd      = fdlisten;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        who.push_back(-1);
+
+        for (int i=0;i<(int)conns.size();i++)
+        {
+            if (conns[i]->bconnecting)
+            {
+                // the connect to the server completes when it turns writable
+
+                pfd.fd     = conns[i]->d[0].dst;
+                pfd.events = POLLOUT;
+                fds.push_back(pfd);
+                who.push_back(i*2);
+                continue;
+            }
+
+            for (int k=0;k<2;k++)
+            {
+                ProxyDir& D = conns[i]->d[k];
+                if (D.wlen>0)
+                {
+                    pfd.fd     = D.dst;
+                    pfd.events = POLLOUT;
+                }
+                else if (!D.beof)
+                {
+                    pfd.fd     = D.src;
+                    pfd.events = POLLIN;
+                }
+                else
+                    continue;
+                fds.push_back(pfd);
+                who.push_back(i*2+k);
+            }
+        }
+
+        int ret = poll(&fds[0], fds.size(), 200);
+        if (ret<0 && errno!=EINTR)
+        {
+            perror("proxy : poll");
+            break;
+        }
+        if (ret<=0)
+            continue;
+
+        vector<bool> bbad(conns.size(), false);
+
+        for (int j=1;j<(int)fds.size();j++)
+        {
+            if (!fds[j].revents)
+                continue;
+
+            int i = who[j]/2;
+            ProxyDir& D = conns[i]->d[who[j]%2];
+
+            if (bbad[i])
+                continue;
+
+            int err;
+            if (conns[i]->bconnecting)
+                err = connect_done(conns[i]);
+            else
+                err = D.wlen>0 ? flush(D) : forward(D);
+            if (err)
+                bbad[i] = true;
+        }
+
+        // drop connections with an error, or closed both ways with nothing left to write
+
+        for (int i=conns.size()-1;i>=0;i--)
+        {
+            ProxyConn* C = conns[i];
+            if (bbad[i] || (C->d[0].beof && C->d[1].beof && !C->d[0].wlen && !C->d[1].wlen))
+                close_conn(i);
+        }
+
+        if (fds[0].revents)
+            accept_conn();
+    }
+}
+
+void FixProxy::trace_summary(FILE* fp)
+{
+    fprintf(fp, "\nproxy : %lld connections, %lld bytes forwarded, %lld fix msgs, %lld traced, %lld dropped [trace behind], %lld bytes skipped\n",
+        nconns, nbytes, nmsgs, nmsgs-ndropped, ndropped, nresync);
+}
+
+
+static void proxy_tracer(SpscRing<ProxyMsg>* ring, ProxyMsgHandler* handler)
+{
+    // drain the ring, flush output when it runs dry, back off to sleeping when idle for a while
+
+    int nidle = 0;
+    while (true)
+    {
+        ProxyMsg* m = ring->peek();
+        if (m)
+        {
+            handler->proxy_msg(*m);
+            ring->release();
+            nidle = 0;
+            continue;
+        }
+
+        if (ring->finished())
+            break;
+
+        if (nidle++ == 0)
+            handler->proxy_idle();
+
+        if (nidle < 1000)
+            sched_yield();
+        else
+            usleep(200);
+    }
+
+    handler->proxy_idle();
+}
+
+int proxy_trace(const char* szspec, ProxyMsgHandler& handler, FILE* fpsummary)
+{
+    // forward on this thread, trace on another, until interrupted
+
+    FixProxy P;
+
+    if (!P.parse(szspec))
+        return fprintf(stderr, "proxy : bad spec [%s], use  listen:port=>host:port\n", szspec), -1;
+    if (!P.listen() || !P.resolve())
+        return -1;
+
+    signal(SIGINT,  proxy_on_signal);
+    signal(SIGTERM, proxy_on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "proxy : %s => %s\n", P.slisten.c_str(), P.sconnect.c_str());
+
+    std::thread tracer(proxy_tracer, &P.ring, &handler);
+
+    P.run();
+
+    P.ring.done();
+    tracer.join();
+
+    if (fpsummary)
+        P.trace_summary(fpsummary);
+
+    return 0;
+}
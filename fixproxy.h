@@ -0,0 +1,143 @@
+//
+//  fixproxy.h - inline tcp proxy, tracing a copy of the fix traffic off the forwarding path
+//
+//      one forwarding thread polls every connection [non blocking sockets], writes each read
+//      straight back out of the same buffer, and only then frames the bytes by BodyLength and
+//      copies complete msgs into an SpscRing
+//
+//      connects to the server are non blocking as well - a new client is held until its connect completes, so a slow
+//      or unreachable server stalls only that client
+//
+//      a tracer thread drains the ring into the handler - if it falls behind the ring fills and
+//      msg copies are dropped [and counted], forwarded traffic is never held up
+//
+#ifndef _FIXPROXY_H_
+#define _FIXPROXY_H_
+
+#include <sys/socket.h>
+
+#include "fixcore.h"
+#include "fixring.h"
+
+
+struct ProxyMsg
+{
+    string                  data;               // one complete fix msg [slot reused, keeps its capacity]
+    long long               ts_sec;             // wall clock when read
+    long                    ts_nsec;
+    long long               offset;             // offset of the msg in its direction of the stream
+    char                    flow[136];          // client:port>server:port or the reverse
+};
+
+
+struct ProxyMsgHandler
+{
+    // called on the tracer thread, one msg at a time
+
+    virtual ~ProxyMsgHandler() {}
+    virtual void proxy_msg(const ProxyMsg& m) = 0;
+    virtual void proxy_idle() {}                // ring empty - flush output
+};
+
+
+struct ProxyDir
+{
+    // one direction of a proxied connection
+
+    enum { BUFSZ = 1<<16 };
+
+    int         src;
+    int         dst;
+    bool        beof;                           // src closed, dst shut down for write
+    int         woff;                           // unwritten bytes in buf [dst not ready]
+    int         wlen;
+    long long   nread;                          // bytes read from src so far
+    char        flow[136];
+    string      partial;                        // start of a msg split across reads
+    char        buf[BUFSZ];
+
+    ProxyDir()
+        : src(-1)
+        , dst(-1)
+        , beof(false)
+        , woff(0)
+        , wlen(0)
+        , nread(0)
+    {
+        flow[0]=0;
+    }
+};
+
+
+struct ProxyConn
+{
+    ProxyDir    d[2];                           // 0 client to server, 1 server to client
+    bool        bconnecting;                    // connect to the server in progress - client held, not read, until it completes
+    int         naddr;                          // server address being tried
+
+    ProxyConn()
+        : bconnecting(false)
+        , naddr(0)
+    {
+    }
+};
+
+
+struct ProxyAddr
+{
+    struct sockaddr_storage sa;
+    socklen_t               salen;
+};
+
+
+struct FixProxy
+{
+    enum { RING_SLOTS = 4096 };
+
+    string                      slisten;        // [host:]port
+    string                      sconnect;       // host:port
+
+    int                         fdlisten;
+    vector<ProxyAddr>           upaddrs;        // sconnect resolved, once at the start
+    vector<ProxyConn*>          conns;
+    SpscRing<ProxyMsg>          ring;
+
+    long long   nconns;
+    long long   nbytes;                         // forwarded, both directions
+    long long   nmsgs;                          // framed
+    long long   ndropped;                       // msg copies dropped, ring full
+    long long   nresync;                        // bytes skipped looking for 8=FIX
+
+    FixProxy()
+        : fdlisten(-1)
+        , ring(RING_SLOTS)
+        , nconns(0)
+        , nbytes(0)
+        , nmsgs(0)
+        , ndropped(0)
+        , nresync(0)
+    {
+    }
+
+    ~FixProxy();
+
+    bool    parse(const char* szspec);          // "listen:port=>host:port"
+    bool    listen();
+    bool    resolve();                          // sconnect to upaddrs
+    void    accept_conn();
+    bool    connect_next(ProxyConn* C);         // non blocking connect from address naddr on, false if none left
+    int     connect_done(ProxyConn* C);         // connect finished [dst writable], -1 if no address took it
+    void    connected(ProxyConn* C);
+    void    close_conn(int i);
+    int     forward(ProxyDir& D);               // -1 on error, 0 ok
+    int     flush(ProxyDir& D);
+    void    frame(ProxyDir& D, const char* p, int n);
+    void    copy_msg(ProxyDir& D, const char* p, int len, long long offset);
+    void    run();                              // until SIGINT / SIGTERM
+    void    trace_summary(FILE* fp);
+};
+
+
+int     proxy_trace(const char* szspec, ProxyMsgHandler& handler, FILE* fpsummary);
+
+#endif //_FIXPROXY_H_
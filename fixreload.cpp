@@ -0,0 +1,296 @@
+//
+//  fixreload.cpp - spec reload under running traces [see fixreload.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixreload.h"
+
+
+// SpecSnapshot
+
+
+SpecSnapshot::SpecSnapshot(XNode* nd, MessageGenerator* mg, bool owned)
+    : ndfix(nd)
+    , MG(mg)
+    , epoch(0)
+    , bowned(owned)
+{
+    MG->expand_specs();                         // now, so readers only ever read it
+}
+
+SpecSnapshot::~SpecSnapshot()
+{
+    if (!bowned)
+        return;
+
+    delete MG;
+    delete ndfix;
+}
+
+SpecSnapshot* SpecSnapshot::load(const char* szfile, bool bverbose)
+{
+    // libxml2 parser setup / cleanup isnt safe against another thread parsing, so loads take turns
+
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    XNode* ndfix = parse_fix_spec_xml(szfile, bverbose);
+    if (!ndfix)
+        return NULL;
+
+    // MessageGenerator takes these as given - a reload must not take the process down with a wrong file
+
+    XNode* ndmsgs = ndfix->child("messages");
+    bool bfix = false;
+    if (ndfix->child("header") && ndfix->child("trailer") && ndfix->child("fields") && ndmsgs)
+        for (int i=0; !bfix && i<(int)ndmsgs->nods.size(); i++)
+            bfix = ndmsgs->nods[i]->atts["msgtype"]=="D";
+    if (!bfix)
+    {
+        if (bverbose)
+            fprintf(stderr, "ERROR not a fix spec : %s\n", szfile);
+        delete ndfix;
+        return NULL;
+    }
+
+    return new SpecSnapshot(ndfix, new MessageGenerator(ndfix), true);
+}
+
+
+// SpecReader
+
+
+SpecReader::SpecReader(FixSpecHolder& h)
+    : holder(h)
+{
+    std::lock_guard<std::mutex> lock(holder.mtx);
+
+    snap = holder.cur.load();
+    epoch.store(snap->epoch);
+    holder.readers.push_back(this);
+}
+
+SpecReader::~SpecReader()
+{
+    std::lock_guard<std::mutex> lock(holder.mtx);
+
+    vector<SpecReader*>& rs = holder.readers;
+    rs.erase(std::remove(rs.begin(), rs.end(), this), rs.end());
+}
+
+
+// FixSpecHolder
+
+
+static FixSpecHolder* volatile sighup_holder = NULL;     // the one SIGHUP reloads
+
+FixSpecHolder::FixSpecHolder(const char* szfile, SpecSnapshot* first)
+    : cur(NULL)
+    , nepochs(0)
+    , file(szfile)
+    , reloader(NULL)
+    , bstop(false)
+    , nreloads(0)
+    , nfailed(0)
+    , lastreload(-1)
+    , bverbose(false)
+{
+    sem_init(&wake, 0, 0);
+
+    first->epoch = ++nepochs;
+    cur.store(first);
+}
+
+FixSpecHolder::~FixSpecHolder()
+{
+    if (sighup_holder==this)
+        sighup_holder = NULL;
+
+    if (reloader)
+    {
+        bstop = true;
+        sem_post(&wake);
+        reloader->join();
+        delete reloader;
+    }
+    sem_destroy(&wake);
+
+    assert(readers.empty());
+
+    for (int i=0;i<(int)retired.size();i++)
+        delete retired[i];
+    delete cur.load();
+}
+
+long long FixSpecHolder::publish(SpecSnapshot* S)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    S->epoch = ++nepochs;
+    retired.push_back(cur.exchange(S));         // readers pick it up at their next msg
+    return S->epoch;
+}
+
+int FixSpecHolder::reclaim()
+{
+    // a retired snapshot is free once every reader holds a later one [readers only move forward]
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    long long oldest = cur.load()->epoch;
+    for (int i=0;i<(int)readers.size();i++)
+        oldest = min(oldest, readers[i]->epoch.load(std::memory_order_acquire));
+
+    int n = 0;
+    for (int i=0;i<(int)retired.size();i++)
+    {
+        if (retired[i]->epoch < oldest)
+            delete retired[i];
+        else
+            retired[n++] = retired[i];
+    }
+    retired.resize(n);
+    return n;
+}
+
+bool FixSpecHolder::reload(const char* szfile)
+{
+    string sfile;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        sfile = szfile ? szfile : file.c_str();
+    }
+
+    SpecSnapshot* S = SpecSnapshot::load(sfile.c_str(), bverbose);
+    if (!S)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            nfailed++;
+            lastreload = 0;
+        }
+        if (bverbose)
+            fprintf(stderr, "Spec reload failed [%s], spec unchanged\n", sfile.c_str());
+        return false;
+    }
+
+    // S is the readers once published
+
+    string prelude = S->MG->prelude;
+    long long epoch = publish(S);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        file = sfile;
+        nreloads++;
+        lastreload = 1;
+    }
+    if (bverbose)
+        fprintf(stderr, "Spec reloaded [%s] %s, epoch %lld\n", sfile.c_str(), prelude.c_str(), epoch);
+
+    reclaim();
+    return true;
+}
+
+void FixSpecHolder::run()
+{
+    // wait for requests, and while snapshots wait to be freed look again every 100ms
+
+    while (!bstop)
+    {
+        bool bwaiting;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            bwaiting = !retired.empty();
+        }
+
+        int r;
+        if (!bwaiting)
+            r = sem_wait(&wake);
+        else
+        {
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100*1000*1000;
+            if (ts.tv_nsec >= 1000*1000*1000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000*1000*1000;
+            }
+            r = sem_timedwait(&wake, &ts);
+        }
+
+        if (bstop)
+            break;
+
+        if (r==0)
+        {
+            // requests while loading fold into one
+
+            while (0==sem_trywait(&wake))
+                ;
+
+            string sfile;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                sfile.swap(pending);
+            }
+            reload(sfile.empty() ? NULL : sfile.c_str());
+        }
+        else
+            reclaim();
+    }
+}
+
+void FixSpecHolder::start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!reloader)
+        reloader = new std::thread(&FixSpecHolder::run, this);
+}
+
+void FixSpecHolder::request()
+{
+    sem_post(&wake);
+}
+
+void FixSpecHolder::request(const char* szfile)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending = szfile ? szfile : "";
+    }
+    sem_post(&wake);
+}
+
+
+static void sighup_handler(int sig)
+{
+    if (sighup_holder)
+        sighup_holder->request();
+}
+
+void FixSpecHolder::on_sighup()
+{
+    start();
+    sighup_holder = this;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sighup_handler;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+}
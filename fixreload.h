@@ -0,0 +1,106 @@
+//
+//  fixreload.h - spec reload under running traces : the expanded spec as an immutable snapshot behind one atomic pointer
+//
+//      a snapshot is parsed, expanded and compiled before it is published, and only read after - so any number of
+//      tracing threads share it with no locking
+//
+//      reader  :  one per tracing thread, refresh() between msgs - one atomic load, and a rebind when the spec changed
+//      reload  :  parse + expand off the hot path [the background thread on request(), eg. from SIGHUP], then publish
+//                 with one pointer store - a spec that doesnt load is counted [lastreload] and the current one kept,
+//                 and with bverbose each reload is reported on stderr [fixtr - a library must keep off the hosts stderr]
+//      reclaim :  a replaced snapshot is freed once every reader has refreshed past it [quiescent state, as in RCU] -
+//                 a reader that sees no more msgs holds its snapshot until it is destroyed, so freeing is late, never early
+//
+//      readers never wait : the only lock is taken by reloads, reclaim, and readers coming and going
+//
+#ifndef _FIXRELOAD_H_
+#define _FIXRELOAD_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <semaphore.h>
+
+#include "fixcore.h"
+
+
+struct SpecSnapshot
+{
+    XNode*              ndfix;
+    MessageGenerator*   MG;             // specs expanded and compiled, read only once published
+    long long           epoch;          // 1, 2 .. in publish order
+    bool                bowned;         // ndfix and MG freed with the snapshot
+
+    SpecSnapshot(XNode* nd, MessageGenerator* mg, bool owned);
+    ~SpecSnapshot();
+
+    static SpecSnapshot* load(const char* szfile, bool bverbose=true);     // parse and expand, NULL if the spec cant be read
+};
+
+
+struct FixSpecHolder;
+
+struct SpecReader
+{
+    // a tracing threads hold on the current snapshot
+
+    FixSpecHolder&          holder;
+    SpecSnapshot*           snap;
+    std::atomic<long long>  epoch;      // of snap, for reclaim
+
+    SpecReader(FixSpecHolder& h);       // holds the current snapshot
+    ~SpecReader();
+
+    inline bool refresh();              // between msgs - true if snap changed [caller rebinds anything sized or bound to the old MG]
+};
+
+
+struct FixSpecHolder
+{
+    std::atomic<SpecSnapshot*>  cur;
+    long long                   nepochs;
+
+    std::mutex                  mtx;        // all below
+    string                      file;       // loaded from, the default for the next reload
+    string                      pending;    // file asked for by request(szfile)
+    vector<SpecReader*>         readers;
+    vector<SpecSnapshot*>       retired;    // replaced, not yet freed
+
+    std::thread*                reloader;
+    sem_t                       wake;
+    std::atomic<bool>           bstop;
+
+    long long                   nreloads;
+    long long                   nfailed;
+    int                         lastreload; // 1 published, 0 failed and the spec kept, -1 none yet
+
+    bool                        bverbose;   // reloads [and the specs own parse messages] to stderr
+
+    FixSpecHolder(const char* szfile, SpecSnapshot* first);
+    ~FixSpecHolder();                       // after its readers
+
+    bool    reload(const char* szfile=NULL);                    // on the calling thread : load, publish, reclaim
+    long long publish(SpecSnapshot* S);                         // returns its epoch
+    int     reclaim();                                          // free what no reader holds, returns how many wait
+
+    void    start();                                            // background thread for request()
+    void    request();                                          // reload from file - async signal safe, returns at once
+    void    request(const char* szfile);                        // .. from another file [not from a signal handler]
+    void    run();
+
+    void    on_sighup();                                        // request() on SIGHUP
+};
+
+
+inline bool SpecReader::refresh()
+{
+    SpecSnapshot* S = holder.cur.load(std::memory_order_acquire);
+    if (S==snap)
+        return false;
+
+    snap = S;
+    epoch.store(S->epoch, std::memory_order_release);
+    return true;
+}
+
+#endif //_FIXRELOAD_H_
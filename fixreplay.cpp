@@ -0,0 +1,453 @@
+//
+//  fixreplay.cpp - resend the fix msgs of a log to a local engine : original timing, scaled, or flat out
+//
+//      USAGE fixreplay [options] < fix.log
+//
+//      msgs are framed as fixtr frames them [by BodyLength, text between msgs skipped], optionally rewritten
+//      [MsgSeqNum, SendingTime, CompIDs - BodyLength and CheckSum patched], and sent in batches by writev
+//
+//      unchanged msgs go out straight from the read buffer, rewritten ones from one batch buffer
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "fixcore.h"
+
+
+struct ReplaySpan
+{
+    const char* p;                      // in the read buffer, or NULL for batch+off
+    int         off;
+    int         len;
+};
+
+
+struct Replay
+{
+    enum { NBATCH = 256, BATCHBYTES = 1<<18, SPIN_NS = 100000 };
+
+    int                 fd;
+    double              speed;          // 1 original timing, 2 twice as fast .. 0 flat out
+    long long           seq;            // next MsgSeqNum when renumbering, 0 keep
+    string              sender;         // SenderCompID / TargetCompID to write, "" keep
+    string              target;
+    string              from;           // only msgs with this SenderCompID, "" all
+    bool                bstamp;         // SendingTime to when sent
+
+    FixMessageView      view;
+    FixClock            clock;
+    string              batch;
+    vector<ReplaySpan>  spans;
+    vector<struct iovec> iov;
+    int                 nbytes;
+
+    long long           ts0;            // SendingTime of the first msg [ns since epoch], -1 none yet
+    long long           t0;             // monotonic time it was sent
+    long long           due;            // when the last msg was due
+
+    long long           nmsgs;
+    long long           nsent;          // bytes
+    long long           nrewritten;
+    long long           nbadsum;        // not rewritten, checksum didnt check out
+    long long           nskipped;       // not from --from
+
+    Replay(int fdout)
+        : fd(fdout)
+        , speed(0)
+        , seq(0)
+        , bstamp(false)
+        , clock(3)
+        , nbytes(0)
+        , ts0(-1)
+        , t0(0)
+        , due(0)
+        , nmsgs(0)
+        , nsent(0)
+        , nrewritten(0)
+        , nbadsum(0)
+        , nskipped(0)
+    {
+        batch.reserve(BATCHBYTES*2);
+        iov.resize(NBATCH);
+    }
+
+    bool rewriting()    { return seq || bstamp || !sender.empty() || !target.empty(); }
+
+    static void wait_until(long long t)
+    {
+        // sleep to just short of t, spin the rest - sleeps overshoot by tens of us
+
+        long long now = fix_nanos();
+        if (t-now > SPIN_NS)
+        {
+            struct timespec ts;
+            ts.tv_sec  = (t-SPIN_NS)/1000000000;
+            ts.tv_nsec = (t-SPIN_NS)%1000000000;
+            while (EINTR==clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+                ;
+        }
+        while ((long long)fix_nanos() < t)
+            ;
+    }
+
+    void flush()
+    {
+        // one writev for the batch [partial writes resumed]
+
+        int n = spans.size();
+        for (int i=0;i<n;i++)
+        {
+            iov[i].iov_base = (void*)(spans[i].p ? spans[i].p : batch.data()+spans[i].off);
+            iov[i].iov_len  = spans[i].len;
+        }
+
+        struct iovec* v = &iov[0];
+        while (n>0)
+        {
+            ssize_t r = writev(fd, v, min(n, IOV_MAX));
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<0)
+            {
+                perror("fixreplay : write");
+                exit(-1);
+            }
+            nsent += r;
+
+            while (n>0 && r >= (ssize_t)v->iov_len)
+            {
+                r -= v->iov_len;
+                v++;
+                n--;
+            }
+            if (n>0)
+            {
+                v->iov_base = (char*)v->iov_base + r;
+                v->iov_len -= r;
+            }
+        }
+
+        spans.clear();
+        batch.clear();
+        nbytes = 0;
+    }
+
+    static void add_edit(FixEdit* edits, int& n, int ifld, const char* val, int vlen)
+    {
+        edits[n].ifld = ifld;
+        edits[n].val  = val;
+        edits[n].vlen = vlen;
+        n++;
+    }
+
+    static bool checksum_ok(const char* p, int len)
+    {
+        // the patched checksum is only right if the old one was
+
+        if (len<7)
+            return false;
+
+        unsigned sum = 0;
+        for (int i=0;i<len-7;i++)
+            sum += (unsigned char)p[i];
+
+        const char* q = p+len-4;
+        return (unsigned)((q[0]-'0')*100 + (q[1]-'0')*10 + (q[2]-'0')) == sum%256;
+    }
+
+    void msg(const char* p, int len)
+    {
+        view.parse(p, len);
+
+        if (!from.empty())
+        {
+            int i49 = view.find(49);
+            if (i49<0 || from.compare(0, string::npos, view.value(i49), view.flds[i49].vlen))
+            {
+                nskipped++;
+                return;
+            }
+        }
+
+        // pace by SendingTime : due when the first msg went, plus the gap in the log over speed
+
+        if (speed>0)
+        {
+            int i52 = view.find(52);
+            long long ts;
+            if (i52>=0 && view.get_timestamp(i52, ts))
+            {
+                if (ts0<0)
+                {
+                    ts0 = ts;
+                    t0  = fix_nanos();
+                }
+                if (ts>=ts0)
+                    due = max(due, t0 + (long long)((ts-ts0)/speed));
+            }
+
+            if (due > (long long)fix_nanos())
+            {
+                flush();
+                wait_until(due);
+            }
+        }
+
+        nmsgs++;
+
+        ReplaySpan S;
+        if (rewriting() && checksum_ok(p, len))
+        {
+            FixEdit edits[4];
+            int nedits = 0;
+
+            char sseq[24], stime[32];
+
+            int i34 = view.find(34);
+            int i49 = view.find(49);
+            int i52 = view.find(52);
+            int i56 = view.find(56);
+
+            if (seq && i34>1)
+                add_edit(edits, nedits, i34, sseq, snprintf(sseq, sizeof(sseq), "%lld", seq++));
+            if (!sender.empty() && i49>1)
+                add_edit(edits, nedits, i49, sender.data(), sender.length());
+            if (bstamp && i52>1)
+                add_edit(edits, nedits, i52, stime, clock.stamp(stime));
+            if (!target.empty() && i56>1)
+                add_edit(edits, nedits, i56, target.data(), target.length());
+
+            sort(edits, edits+nedits, [](const FixEdit& a, const FixEdit& b) { return a.ifld < b.ifld; });
+
+            S.p   = NULL;
+            S.off = batch.length();
+            S.len = fix_rewrite(view, edits, nedits, batch);
+            if (S.len<0)
+            {
+                S.p   = p;
+                S.len = len;
+            }
+            else
+                nrewritten++;
+        }
+        else
+        {
+            if (rewriting())
+                nbadsum++;
+
+            S.p   = p;
+            S.off = 0;
+            S.len = len;
+        }
+
+        spans.push_back(S);
+        nbytes += S.len;
+
+        if ((int)spans.size()>=NBATCH || nbytes>=BATCHBYTES)
+            flush();
+    }
+};
+
+
+static bool split_host_port(const string& s, string& host, string& port)
+{
+    size_t n = s.rfind(':');
+    if (n==string::npos)
+        return false;
+
+    host = s.substr(0, n);
+    port = s.substr(n+1);
+    if (host.length()>=2 && host[0]=='[' && host[host.length()-1]==']')
+        host = host.substr(1, host.length()-2);
+    return !port.empty();
+}
+
+static int connect_tcp(const string& s)
+{
+    string host, port;
+    if (!split_host_port(s, host, port))
+        return -1;
+
+    struct addrinfo hints, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &ai))
+        return -1;
+
+    int fdret = -1;
+    for (struct addrinfo* a=ai;a && fdret<0;a=a->ai_next)
+    {
+        int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd<0)
+            continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen))
+        {
+            close(fd);
+            continue;
+        }
+        fdret = fd;
+    }
+    freeaddrinfo(ai);
+
+    // batches are already full, dont hold the tail of one back
+
+    int one = 1;
+    if (fdret>=0)
+        setsockopt(fdret, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fdret;
+}
+
+static int connect_unix(const string& path)
+{
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(sa.sun_path))
+        return -1;
+    strcpy(sa.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // handle args
+
+    mapss options;
+    for (int i=1;i<argc;i++)
+    {
+        const char* szopt=argv[i];
+
+        if (0==strncmp(szopt, "--connect=", 10))
+            options["connect"] = szopt+10;
+        else if (0==strncmp(szopt, "--unix=", 7))
+            options["unix"] = szopt+7;
+        else if (0==strncmp(szopt, "--speed=", 8))
+        {
+            options["speed"] = szopt+8;
+            if (atof(szopt+8)<=0)
+                fprintf(stderr,"Bad option --speed, use a factor > 0 eg. 1 or 10 or 0.5\n"), exit(-1);
+        }
+        else if (0==strcmp(szopt, "--max"))
+            options["speed"] = "0";
+        else if (0==strncmp(szopt, "--seq=", 6))
+            options["seq"] = szopt+6;
+        else if (0==strcmp(szopt, "--stamp"))
+            options["stamp"] = "Y";
+        else if (0==strncmp(szopt, "--sender=", 9))
+            options["sender"] = szopt+9;
+        else if (0==strncmp(szopt, "--target=", 9))
+            options["target"] = szopt+9;
+        else if (0==strncmp(szopt, "--from=", 7))
+            options["from"] = szopt+7;
+        else if (0==strncmp(szopt, "--delim=", 8))
+        {
+            options["delim"] = szopt+8;
+            if (options["delim"].compare("|") && options["delim"].compare("^A") && options["delim"].compare("any"))
+                fprintf(stderr,"Bad option --delim, use | ^A or any\n"), exit(-1);
+        }
+        else
+        {
+            fprintf(stderr,"USAGE: fixreplay [options] < fix_messages.fix   [to stdout unless --connect / --unix]\n");
+            fprintf(stderr,"  option --connect=host:port    : send over tcp\n");
+            fprintf(stderr,"  option --unix=path            : send over a unix socket\n");
+            fprintf(stderr,"  option --speed=N              : timing from SendingTime, N times faster [default 1, as logged]\n");
+            fprintf(stderr,"  option --max                  : send as fast as the socket takes them\n");
+            fprintf(stderr,"  option --seq=N                : renumber MsgSeqNum from N\n");
+            fprintf(stderr,"  option --stamp                : SendingTime to the time sent [UTC ms]\n");
+            fprintf(stderr,"  option --sender=ID --target=ID: rewrite SenderCompID / TargetCompID\n");
+            fprintf(stderr,"  option --from=ID              : only msgs with SenderCompID ID [one side of a session log]\n");
+            fprintf(stderr,"  option --delim=|  --delim=^A  : also take msgs from logs that render SOH as | or ^A [--delim=any for both]\n");
+            exit(-1);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd = 1;
+    if (!options["connect"].empty() && (fd = connect_tcp(options["connect"])) < 0)
+        fprintf(stderr,"Cant connect to [%s]\n", options["connect"].c_str()), exit(-1);
+    if (!options["unix"].empty() && (fd = connect_unix(options["unix"])) < 0)
+        fprintf(stderr,"Cant connect to [%s]\n", options["unix"].c_str()), exit(-1);
+
+    Replay R(fd);
+    R.speed  = options["speed"].empty() ? 1 : atof(options["speed"].c_str());
+    R.seq    = atoll(options["seq"].c_str());
+    R.bstamp = !options["stamp"].empty();
+    R.sender = options["sender"];
+    R.target = options["target"];
+    R.from   = options["from"];
+
+    FixFramer framer;
+    if (0==options["delim"].compare("|"))
+        framer.delims |= FIXDELIM_PIPE;
+    else if (0==options["delim"].compare("^A"))
+        framer.delims |= FIXDELIM_CARET;
+    else if (0==options["delim"].compare("any"))
+        framer.delims = FIXDELIM_ANY;
+
+    // read, frame, send - each batch is flushed before the read buffer is refilled
+
+    long long tstart = fix_nanos();
+
+    while (!framer.beof)
+    {
+        char* p = framer.space();
+        int r = read(0, p, framer.avail());
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            framer.beof = true;
+        else
+            framer.commit(r);
+
+        const char* sz;
+        int len;
+        long long off;
+        while (framer.next(sz, len, off))
+            R.msg(sz, len);
+
+        R.flush();
+    }
+
+    double secs = (fix_nanos()-tstart)/1e9;
+    fprintf(stderr, "fixreplay : %lld msgs, %lld bytes in %.3f s, %.0f msgs/s", R.nmsgs, R.nsent, secs, secs>0 ? R.nmsgs/secs : 0.0);
+    if (R.rewriting())
+        fprintf(stderr, ", %lld rewritten, %lld bad checksum sent as is", R.nrewritten, R.nbadsum);
+    if (!R.from.empty())
+        fprintf(stderr, ", %lld not from %s", R.nskipped, R.from.c_str());
+    fprintf(stderr, "\n");
+
+    if (fd!=1)
+        close(fd);
+    return 0;
+}
@@ -0,0 +1,484 @@
+//
+//  fixrewrite.cpp - rewrite a fix log by tag rules [see fixrewrite.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixrewrite.h"
+#include "fixcheckpoint.h"
+
+
+static inline unsigned long long rotl64(unsigned long long x, int b)
+{
+    return (x<<b) | (x>>(64-b));
+}
+
+static unsigned long long siphash24(unsigned long long k0, unsigned long long k1, const char* p, int n)
+{
+    // SipHash-2-4 : a keyed prf, so pseudonyms cant be made without the key, nor the key had back from them
+
+    unsigned long long v0 = k0 ^ 0x736f6d6570736575ULL;
+    unsigned long long v1 = k1 ^ 0x646f72616e646f6dULL;
+    unsigned long long v2 = k0 ^ 0x6c7967656e657261ULL;
+    unsigned long long v3 = k1 ^ 0x7465646279746573ULL;
+
+#define SIPROUND \
+    v0 += v1; v1 = rotl64(v1,13); v1 ^= v0; v0 = rotl64(v0,32); \
+    v2 += v3; v3 = rotl64(v3,16); v3 ^= v2; \
+    v0 += v3; v3 = rotl64(v3,21); v3 ^= v0; \
+    v2 += v1; v1 = rotl64(v1,17); v1 ^= v2; v2 = rotl64(v2,32)
+
+    const unsigned char* u = (const unsigned char*)p;
+    int nw = n & ~7;
+    for (int i=0;i<nw;i+=8)
+    {
+        unsigned long long m = 0;
+        for (int j=7;j>=0;j--)
+            m = m<<8 | u[i+j];
+        v3 ^= m;
+        SIPROUND; SIPROUND;
+        v0 ^= m;
+    }
+
+    unsigned long long b = (unsigned long long)n << 56;
+    for (int j=n-1;j>=nw;j--)
+        b |= (unsigned long long)u[j] << (8*(j-nw));
+    v3 ^= b;
+    SIPROUND; SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+#undef SIPROUND
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static bool rule_error(const char* szfile, int nline, const char* szerr)
+{
+    fprintf(stderr,"Bad rewrite rule [%s] line %d : %s\n", szfile, nline, szerr);
+    return false;
+}
+
+bool FixRewriter::load(const char* szfile)
+{
+    FILE* fp = fopen(szfile, "r");
+    if (!fp)
+    {
+        fprintf(stderr,"Cant read file [%s]\n", szfile);
+        return false;
+    }
+
+    bool bok = true;
+    char line[1024];
+    for (int nline=1; bok && fgets(line, sizeof(line), fp); nline++)
+    {
+        char* hash = strchr(line, '#');
+        if (hash)
+            *hash = 0;
+
+        char sfld[256], sact[768];
+        int ntok = sscanf(line, "%255s %767s", sfld, sact);
+        if (ntok<=0)
+            continue;
+        if (ntok<2)
+        {
+            bok = rule_error(szfile, nline, "expecting <tag or field name> <action>");
+            break;
+        }
+
+        // tag by number or spec field name
+
+        int tag = -1;
+        if (strspn(sfld, "0123456789")==strlen(sfld))
+            tag = atoi(sfld);
+        else
+        {
+            mapss::iterator p = MG.fields_by_name.find(sfld);
+            if (p!=MG.fields_by_name.end())
+                tag = atoi(p->second.c_str());
+        }
+
+        if (tag<=0)
+        {
+            bok = rule_error(szfile, nline, "unknown field");
+            break;
+        }
+        if (tag==8 || tag==9 || tag==10 || tag==35)
+        {
+            bok = rule_error(szfile, nline, "BeginString BodyLength MsgType and CheckSum cant be rewritten");
+            break;
+        }
+
+        RewriteRule R;
+        const char* eq = strchr(sact, '=');
+        int nact = eq ? eq-sact : strlen(sact);
+        R.arg = eq ? eq+1 : "";
+
+        if (nact==7 && 0==strncmp(sact, "replace", 7) && eq && *R.arg.c_str())
+            R.action = REWRITE_REPLACE;
+        else if (nact==4 && 0==strncmp(sact, "hash", 4))
+        {
+            // 128 bit key from the salt
+
+            R.action = REWRITE_HASH;
+            R.k0 = siphash24(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL, R.arg.data(), R.arg.length());
+            R.k1 = siphash24(0x1716151413121110ULL, 0x1f1e1d1c1b1a1918ULL, R.arg.data(), R.arg.length());
+        }
+        else if (nact==4 && 0==strncmp(sact, "drop", 4) && !eq)
+            R.action = REWRITE_DROP;
+        else if (nact==8 && 0==strncmp(sact, "renumber", 8) && tag==34)
+        {
+            R.action = REWRITE_RENUMBER;
+            seqstart = eq ? atoll(eq+1) : 1;
+            if (seqstart<=0)
+            {
+                bok = rule_error(szfile, nline, "renumber from 1 or more");
+                break;
+            }
+        }
+        else
+        {
+            bok = rule_error(szfile, nline, "use replace=value hash{=salt} drop, or renumber{=N} for 34");
+            break;
+        }
+
+        if (tag>=(int)rules.size())
+            rules.resize(tag+1);
+        if (rules[tag].action)
+        {
+            bok = rule_error(szfile, nline, "field already has a rule");
+            break;
+        }
+        rules[tag] = R;
+    }
+    fclose(fp);
+
+    if (!bok)
+        return false;
+
+    // renumbering shifts the other seq fields with it, unless they have rules of their own
+
+    if (seqstart)
+    {
+        static const int seqtags[] = { 36, 7, 16, 45, 369 };
+        for (int i=0;i<5;i++)
+        {
+            int tag = seqtags[i];
+            if (tag>=(int)rules.size())
+                rules.resize(tag+1);
+            if (!rules[tag].action)
+                rules[tag].action = tag==36 ? REWRITE_SEQ_OWN : REWRITE_SEQ_PEER;
+        }
+    }
+
+    return true;
+}
+
+
+static void put_delimited(OutBuf& out, const char* p, int len, int kind)
+{
+    // a msg back out in the delimiters it was read with
+
+    if (kind==FIXDELIM_PIPE || kind==FIXDELIM_CARET)
+    {
+        for (int i=0;i<len;i++)
+        {
+            if (p[i]!=0x01)
+                out.put(p[i]);
+            else if (kind==FIXDELIM_PIPE)
+                out.put('|');
+            else
+                out.put("^A", 2);
+        }
+        return;
+    }
+
+    out.put(p, len);
+}
+
+static int seq_shifted(char* sz, const char* v, int vlen, long long delta)
+{
+    // seq number shifted by delta [at least 1], 0 if it isnt one or 0 [EndSeqNo 0 is infinity]
+
+    long long seq;
+    if (!delta || !fix_parse_int(v, vlen, seq) || seq<=0)
+        return 0;
+
+    return sprintf(sz, "%lld", max(1LL, seq+delta));
+}
+
+bool FixRewriter::msg_whole(const char* p, int len)
+{
+    // BodyLength leads to the trailer and CheckSum is right, whatever the BeginString [rules apply to any fix version]
+    // - fix_rewrite patches both from the bytes it changes, so they must be right to start with
+
+    if (fix_msg_length(p, len)!=len || view.parse(p, len)<3 || view.nend!=len)
+        return false;
+
+    const FixField& F = view.flds[view.nflds-1];
+    return F.tag==10 && F.vlen==3 && 0==memcmp(p+F.voff, fix_checksum(p, F.toff).c_str(), 3);
+}
+
+void FixRewriter::put_bad(const char* p, int len, int kind)
+{
+    // a msg the rules cant be applied to is dropped, so nothing unmasked gets out - unless asked to copy it as is
+
+    nbad++;
+    if (bpassbad)
+        put_delimited(out, p, len, kind);
+}
+
+void FixRewriter::msg(const char* p, int len, int kind)
+{
+    nmsgs++;
+
+    if (!msg_whole(p, len))
+    {
+        put_bad(p, len, kind);
+        return;
+    }
+
+    int n = view.nflds;
+    int nrules = rules.size();
+
+    // session seq deltas, set at its first msg and again when a Logon resets it
+
+    long long owndelta = 0;
+    long long peerdelta = 0;
+    if (seqstart)
+    {
+        string sender = view.get(49);
+        string target = view.get(56);
+
+        long long seq;
+        int i34 = view.find(34);
+        if (i34>=0 && view.get_int(i34, seq))
+        {
+            string key = sender + '\001' + target;
+            map<string, long long>::iterator d = seqdelta.find(key);
+            if (d==seqdelta.end())
+                d = seqdelta.insert(make_pair(key, seqstart-seq)).first;
+            else if (seq==1 && view.get(35)=="A")
+                d->second = seqstart-seq;
+            owndelta = d->second;
+        }
+
+        map<string, long long>::iterator d = seqdelta.find(target + '\001' + sender);
+        if (d!=seqdelta.end())
+            peerdelta = d->second;
+    }
+
+    // edits in field order, values collected in vals first [it may grow]
+
+    edits.clear();
+    voffs.clear();
+    vals.clear();
+
+    for (int i=2;i<n-1;i++)
+    {
+        int tag = view.flds[i].tag;
+        if (tag<=0 || tag>=nrules || !rules[tag].action)
+            continue;
+
+        const RewriteRule& R = rules[tag];
+        const char* v = view.value(i);
+        int vlen = view.flds[i].vlen;
+
+        FixEdit E;
+        E.ifld = i;
+        E.val  = NULL;
+        E.vlen = 0;
+
+        int voff = vals.length();
+
+        char sz[32];
+        int nsz = 0;
+
+        switch (R.action)
+        {
+        case REWRITE_REPLACE:
+            vals.append(R.arg);
+            break;
+
+        case REWRITE_HASH:
+            nsz = sprintf(sz, "%016llX", siphash24(R.k0, R.k1, v, vlen));
+            vals.append(sz, nsz);
+            break;
+
+        case REWRITE_DROP:
+            voff = -1;
+            break;
+
+        case REWRITE_RENUMBER:
+        case REWRITE_SEQ_OWN:
+        case REWRITE_SEQ_PEER:
+            nsz = seq_shifted(sz, v, vlen, R.action==REWRITE_SEQ_PEER ? peerdelta : owndelta);
+            if (!nsz)
+                continue;
+            vals.append(sz, nsz);
+            break;
+        }
+
+        edits.push_back(E);
+        voffs.push_back(voff);
+    }
+
+    if (edits.empty())
+    {
+        put_delimited(out, p, len, kind);
+        return;
+    }
+
+    for (int k=0; k<(int)edits.size(); k++)
+    {
+        if (voffs[k]<0)
+            continue;
+
+        int vend = vals.length();
+        for (int k2=k+1; k2<(int)edits.size(); k2++)
+            if (voffs[k2]>=0)
+            {
+                vend = voffs[k2];
+                break;
+            }
+
+        edits[k].val  = vals.data()+voffs[k];
+        edits[k].vlen = vend-voffs[k];
+    }
+
+    // straight into the output, or rendered back to | or ^A from a copy
+
+    int nstart = out.buf.length();
+    if (fix_rewrite(view, &edits[0], edits.size(), out.buf)<0)
+    {
+        out.buf.resize(nstart);
+        put_bad(p, len, kind);
+        return;
+    }
+
+    if (kind==FIXDELIM_PIPE)
+        replace(out.buf.begin()+nstart, out.buf.end(), '\001', '|');
+    else if (kind==FIXDELIM_CARET)
+    {
+        string smsg(out.buf, nstart);
+        out.buf.resize(nstart);
+        put_delimited(out, smsg.data(), smsg.length(), kind);
+    }
+
+    nrewritten++;
+}
+
+void FixRewriter::save(FixCheckpoint& ck)
+{
+    // counts, and the renumbered sessions
+
+    ck.clear();
+    ck.line("counts");
+    ck.add(nmsgs);
+    ck.add(nrewritten);
+    ck.add(nbad);
+
+    for (map<string, long long>::iterator p=seqdelta.begin(); p!=seqdelta.end(); ++p)
+    {
+        ck.line("seq");
+        ck.add(p->first);
+        ck.add(p->second);
+    }
+}
+
+bool FixRewriter::restore(FixCheckpoint& ck)
+{
+    while (ck.next_line())
+    {
+        if (ck.is("counts"))
+        {
+            nmsgs      = ck.get_int(1);
+            nrewritten = ck.get_int(2);
+            nbad       = ck.get_int(3);
+        }
+        else if (ck.is("seq"))
+            seqdelta[ck.get(1)] = ck.get_int(2);
+        else
+            return false;
+    }
+    return true;
+}
+
+void FixRewriter::run(int fd, int delims, FixCheckpoint* ck)
+{
+    // frame as fixtr does, copying across the text between msgs
+    // done : stream offset written up to - the framer only lets go of bytes before its cursor in space()
+
+    FixFramer framer;
+    framer.delims = delims;
+    framer.base = ck ? ck->offset : 0;
+
+    long long done = framer.base;
+    while (!framer.beof)
+    {
+        long long upto = framer.base+framer.s;
+        if (upto>done)
+        {
+            out.put(framer.buf.data()+(done-framer.base), upto-done);
+            done = upto;
+        }
+
+        {
+            FIX_STAGE(STAGE_READ);
+            char* p = framer.space();
+            int r = read(fd, p, framer.avail());
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+                framer.beof = true;
+            else
+                framer.commit(r);
+            FIX_COUNT(COUNT_BYTES_IN, r>0 ? r : 0);
+        }
+
+        const char* p;
+        int len;
+        long long off;
+        while (true)
+        {
+            {
+                FIX_STAGE(STAGE_FIND);
+                if (!framer.next(p, len, off))
+                    break;
+            }
+            if (off<done)
+                continue;                           // inside a msg run to end of line, already written
+
+            out.put(framer.buf.data()+(done-framer.base), off-done);
+            FIX_COUNT(COUNT_MSGS, 1);
+            FIX_COUNT(COUNT_MSG_BYTES, len);
+            msg(p, len, framer.kind);
+            done = off+framer.rawlen;
+
+            out.end_record();
+
+            if (ck && ck->tick())
+            {
+                save(*ck);
+                ck->save(done, out);
+            }
+        }
+    }
+
+    long long upto = framer.base+framer.e;
+    if (upto>done)
+        out.put(framer.buf.data()+(done-framer.base), upto-done);
+
+    out.flush();
+}
@@ -0,0 +1,103 @@
+//
+//  fixrewrite.h - rewrite a fix log by tag rules : mask, pseudonymize or drop values, renumber sessions
+//
+//      rules file, one rule per line [tag number or field name, # comments] -
+//
+//          1           hash                    Account to a pseudonym [same value, same pseudonym]
+//          ClientID    hash=s3cret             .. keyed by the salt, so without it pseudonyms cant be made from known ids
+//          448         replace=XXXX
+//          58          drop
+//          34          renumber=1              MsgSeqNum from 1 per session, and the seq fields that refer to it
+//
+//      msgs are framed as fixtr frames them, each good msg rewritten from its token spans by fix_rewrite
+//      [BodyLength and CheckSum patched from the changed bytes only] - text between msgs is copied as is
+//
+//      pseudonyms are SipHash-2-4 of the value, keyed from the salt - 16 hex digits [an unsalted hash has a known key,
+//      so anyone can hash known ids to match them : salt with a secret for logs that leave the building]
+//
+//      rules apply to msgs of any BeginString - msgs that dont check out [BodyLength, CheckSum, fields that dont
+//      tokenize] cant be rewritten safely, so they are dropped and counted, or copied as is with bpassbad
+//      [fixtr --rewrite-pass-bad]
+//
+#ifndef _FIXREWRITE_H_
+#define _FIXREWRITE_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+struct FixCheckpoint;
+
+
+enum RewriteAction
+{
+    REWRITE_NONE = 0,
+    REWRITE_REPLACE,
+    REWRITE_HASH,
+    REWRITE_DROP,
+    REWRITE_RENUMBER,                   // 34 only
+    REWRITE_SEQ_OWN,                    // 36 NewSeqNo - shifted with the sessions own 34
+    REWRITE_SEQ_PEER                    // 7 16 45 369 - refer to the other sides 34
+};
+
+
+struct RewriteRule
+{
+    int         action;
+    string      arg;                    // replace value, hash salt
+    unsigned long long k0;              // hash key, from the salt
+    unsigned long long k1;
+
+    RewriteRule()
+        : action(REWRITE_NONE)
+        , k0(0)
+        , k1(0)
+    {
+    }
+};
+
+
+struct FixRewriter
+{
+    MessageGenerator&       MG;
+    OutBuf&                 out;
+
+    vector<RewriteRule>     rules;      // by tag
+    long long               seqstart;   // renumber from, 0 no renumbering
+    map<string, long long>  seqdelta;   // sender \001 target => new - old MsgSeqNum
+
+    FixMessageView          view;
+    vector<FixEdit>         edits;
+    vector<int>             voffs;      // edited values by offset in vals [-1 drop], edits point in once all are made
+    string                  vals;
+
+    long long               nmsgs;
+    long long               nrewritten;
+    long long               nbad;       // dropped, or copied as is
+    bool                    bpassbad;   // copy bad msgs as is, unrewritten
+
+    FixRewriter(MessageGenerator& mg, OutBuf& o)
+        : MG(mg)
+        , out(o)
+        , seqstart(0)
+        , nmsgs(0)
+        , nrewritten(0)
+        , nbad(0)
+        , bpassbad(false)
+    {
+    }
+
+    bool    load(const char* szfile);                       // false and a message on stderr if the rules dont parse
+    void    msg(const char* p, int len, int kind);          // one framed msg [normalized to SOH] to out, in its original delimiters
+    void    run(int fd, int delims, FixCheckpoint* ck=NULL);    // fd to out, msgs rewritten and text between them as is
+
+    void    save(FixCheckpoint& ck);                        // state for a checkpoint [fixcheckpoint.h]
+    bool    restore(FixCheckpoint& ck);                     // .. back from one, false if it doesnt parse
+
+    // internal
+
+    bool    msg_whole(const char* p, int len);              // framed, tokenized into view, CheckSum right
+    void    put_bad(const char* p, int len, int kind);
+};
+
+#endif //_FIXREWRITE_H_
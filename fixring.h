@@ -0,0 +1,136 @@
+//
+//  fixring.h - lock free single producer / single consumer ring of reusable slots
+//
+//      slots are constructed once and reused, so a slot holding a string keeps its capacity -
+//      once warmed up the ring hands over data with no allocation
+//
+//      producer :  T* p = ring.claim();   if (p) { fill *p; ring.publish(); }   [NULL when full - caller decides to drop or wait]
+//      consumer :  T* p = ring.peek();    if (p) { use *p;  ring.release(); }   [NULL when empty]
+//
+//      claim_wait / peek_wait spin, then yield, then sleep until a slot is free / ready [peek_wait NULL once finished]
+//
+#ifndef _FIXRING_H_
+#define _FIXRING_H_
+
+#include <atomic>
+#include <sched.h>
+#include <unistd.h>
+
+
+template <class T>
+struct SpscRing
+{
+    vector<T>               slots;
+    unsigned                mask;
+
+    alignas(64) std::atomic<unsigned>   head;       // next slot to publish [written by producer]
+    unsigned                            tailcache;  // producer's last view of tail
+
+    alignas(64) std::atomic<unsigned>   tail;       // next slot to consume [written by consumer]
+    unsigned                            headcache;  // consumer's last view of head
+
+    alignas(64) std::atomic<bool>       bdone;      // producer has finished
+
+    SpscRing(int nslots)
+        : head(0)
+        , tailcache(0)
+        , tail(0)
+        , headcache(0)
+        , bdone(false)
+    {
+        // round up to a power of 2
+
+        unsigned n = 2;
+        while ((int)n < nslots)
+            n <<= 1;
+
+        slots.resize(n);
+        mask = n-1;
+    }
+
+    int capacity()          { return mask+1; }
+
+    // producer side
+
+    T* claim()
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h - tailcache > mask)
+        {
+            tailcache = tail.load(std::memory_order_acquire);
+            if (h - tailcache > mask)
+                return NULL;
+        }
+        return &slots[h & mask];
+    }
+
+    void publish()
+    {
+        head.store(head.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    void done()
+    {
+        bdone.store(true, std::memory_order_release);
+    }
+
+    // consumer side
+
+    T* peek()
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t == headcache)
+        {
+            headcache = head.load(std::memory_order_acquire);
+            if (t == headcache)
+                return NULL;
+        }
+        return &slots[t & mask];
+    }
+
+    void release()
+    {
+        tail.store(tail.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    bool finished()
+    {
+        // producer done and nothing left [check after peek returns NULL]
+
+        return bdone.load(std::memory_order_acquire) && tail.load(std::memory_order_relaxed)==head.load(std::memory_order_acquire);
+    }
+
+    // blocking
+
+    static void backoff(int n)
+    {
+        if (n<64)
+            ;
+        else if (n<1024)
+            sched_yield();
+        else
+            usleep(100);
+    }
+
+    T* claim_wait()
+    {
+        T* p;
+        for (int n=0;!(p=claim());n++)
+            backoff(n);
+        return p;
+    }
+
+    T* peek_wait()
+    {
+        T* p;
+        for (int n=0;!(p=peek());n++)
+        {
+            if (finished())
+                return NULL;
+            backoff(n);
+        }
+        return p;
+    }
+};
+
+#endif //_FIXRING_H_
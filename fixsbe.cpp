@@ -0,0 +1,819 @@
+//
+//  fixsbe.cpp - compact binary fix logs [see fixsbe.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+
+#include "fixcore.h"
+#include "fixsbe.h"
+
+
+static const int enc_width[] = { 0, 4, 8, 9, 5, 1, 8, 0, 0, 0 };     // by BinEnc, in the fixed part
+
+
+template<class T> static inline void put_le(string& s, T v)             { s.append((const char*)&v, sizeof(v)); }
+template<class T> static inline void put_at(string& s, int off, T v)    { memcpy(&s[off], &v, sizeof(v)); }
+template<class T> static inline T get_le(const char* p)                 { T v; memcpy(&v, p, sizeof(v)); return v; }
+
+static inline void put_str(string& s, const char* p, int n)
+{
+    if (n<255)
+        s.push_back((char)n);
+    else
+    {
+        s.push_back((char)255);
+        put_le<unsigned short>(s, n);
+    }
+    s.append(p, n);
+}
+
+static inline unsigned byte_sum(const char* p, int n)
+{
+    unsigned sum = 0;
+    for (int i=0;i<n;i++)
+        sum += (unsigned char)p[i];
+    return sum;
+}
+
+static int format_int(long long v, char* p)
+{
+    char tmp[24];
+    int i = sizeof(tmp);
+
+    bool bneg = v<0;
+    unsigned long long u = bneg ? -(unsigned long long)v : v;
+
+    do { tmp[--i] = '0' + u%10; u/=10; } while(u);
+    if (bneg)
+        tmp[--i] = '-';
+
+    memcpy(p, tmp+i, sizeof(tmp)-i);
+    return sizeof(tmp)-i;
+}
+
+static int format_decimal(const FixDecimal& d, char* p)
+{
+    // mant / 10^scale with exactly scale places, as it was sent
+
+    char digs[24];
+    bool bneg = d.mant<0;
+    unsigned long long u = bneg ? -(unsigned long long)d.mant : d.mant;
+
+    int nd = 0;
+    do { digs[nd++] = '0' + u%10; u/=10; } while(u);
+    while (nd <= d.scale)
+        digs[nd++] = '0';
+
+    int n = 0;
+    if (bneg)
+        p[n++] = '-';
+    for (int i=nd-1;i>=0;i--)
+    {
+        p[n++] = digs[i];
+        if (i==d.scale && i)
+            p[n++] = '.';
+    }
+    return n;
+}
+
+
+// BinTemplate
+
+
+static int layout(vector<BinField>& flds, int a, int b, bool& bgroups)
+{
+    // fixed offsets for the fields of one block, each groups repeat block in turn
+
+    int off = 0;
+    bgroups = false;
+    for (int k=a;k<b;k++)
+    {
+        BinField& F = flds[k];
+        F.off  = off;
+        F.ntag = sprintf(F.tagtext, "%d=", F.tag);
+        off   += enc_width[F.enc];
+
+        if (F.enc==BENC_GROUP)
+        {
+            bgroups = true;
+            F.fixsz = layout(flds, k+1, k+1+F.nsub, F.bgroups);
+            k += F.nsub;
+        }
+    }
+    return off;
+}
+
+void BinTemplate::compile()
+{
+    fixsz = layout(flds, 0, flds.size(), bgroups);
+}
+
+void BinTemplate::serialize(string& s) const
+{
+    put_le<unsigned short>(s, flds.size());
+    for (int k=0;k<(int)flds.size();k++)
+    {
+        const BinField& F = flds[k];
+        put_le<unsigned>(s, F.tag);
+        s.push_back((char)F.enc);
+        s.push_back((char)F.arg);
+        if (F.enc==BENC_CONST)
+            put_str(s, F.cval.data(), F.cval.length());
+        if (F.enc==BENC_GROUP)
+            put_le<unsigned short>(s, F.nsub);
+    }
+}
+
+bool BinTemplate::deserialize(const char* p, int n)
+{
+    const char* pend = p+n;
+    if (pend-p < 2)
+        return false;
+
+    int nflds = get_le<unsigned short>(p);
+    p += 2;
+
+    flds.resize(nflds);
+    for (int k=0;k<nflds;k++)
+    {
+        BinField& F = flds[k];
+        if (pend-p < 6)
+            return false;
+
+        F.tag  = get_le<unsigned>(p);
+        F.enc  = (unsigned char)p[4];
+        F.arg  = (unsigned char)p[5];
+        F.nsub = 0;
+        p += 6;
+
+        if (F.enc>BENC_GROUP || (F.enc==BENC_TIMESTAMP && F.arg>9))
+            return false;
+
+        if (F.enc==BENC_CONST)
+        {
+            if (pend-p < 1)
+                return false;
+            int len = (unsigned char)*p++;
+            if (len==255)
+            {
+                if (pend-p < 2)
+                    return false;
+                len = get_le<unsigned short>(p);
+                p += 2;
+            }
+            if (pend-p < len)
+                return false;
+            F.cval.assign(p, len);
+            p += len;
+        }
+        if (F.enc==BENC_GROUP)
+        {
+            if (pend-p < 2)
+                return false;
+            F.nsub = get_le<unsigned short>(p);
+            p += 2;
+            if (k+1+F.nsub > nflds)
+                return false;
+        }
+    }
+
+    compile();
+    return p==pend;
+}
+
+
+// BinEncoder
+
+
+BinEncoder::BinEncoder(MessageGenerator& mg)
+    : MG(mg)
+    , tagtype(FixMessageView::NTAGS, BENC_STR)
+    , nmsgs(0)
+    , nraw(0)
+{
+    // encodings from the spec types - ints and decimals at their widest, narrowed per value in field_enc
+
+    MG.expand_specs();
+
+    for (mapsx::iterator p=MG.fields.begin(); p!=MG.fields.end(); p++)
+    {
+        int tag = atoi(p->first.c_str());
+        const char* sztype = p->second->att("type");
+        if (tag<=0 || tag>=(int)tagtype.size() || !sztype)
+            continue;
+
+        int enc = BENC_STR;
+        switch (fix_value_type(sztype))
+        {
+        case VTYPE_INT:         enc = BENC_INT64;       break;
+        case VTYPE_FLOAT:       enc = BENC_DECIMAL;     break;
+        case VTYPE_CHAR:
+        case VTYPE_BOOL:        enc = BENC_CHAR;        break;
+        case VTYPE_TIMESTAMP:   enc = BENC_TIMESTAMP;   break;
+        }
+        tagtype[tag] = enc;
+    }
+
+    for (int i=0;i<10;i++)
+        clocks[i].digits = i;
+}
+
+BinEncoder::~BinEncoder()
+{
+    for (int i=0;i<(int)templates.size();i++)
+        delete templates[i];
+}
+
+int BinEncoder::field_enc(int i)
+{
+    // encoding of field i of the view - by its spec type, if the value comes back from it byte for byte
+
+    const FixField& f = view.flds[i];
+    const char* v = view.value(i);
+    int n = f.vlen;
+    char tmp[48];
+
+    if (f.tag==8 || f.tag==35)
+        return BENC_CONST;
+
+    if (i==1 && f.tag==9)
+    {
+        const FixField& f10 = view.flds[view.nflds-1];
+        if (f10.tag==10 && n==format_int(f10.toff-(f.voff+n+1), tmp) && 0==memcmp(v, tmp, n))
+            return BENC_DERIVED;
+    }
+
+    if (i==view.nflds-1 && f.tag==10 && n==3)
+    {
+        unsigned sum = byte_sum(view.sz, f.toff) % 256;
+        char ssum[3] = { (char)('0'+sum/100), (char)('0'+sum/10%10), (char)('0'+sum%10) };
+        if (0==memcmp(v, ssum, 3))
+            return BENC_DERIVED;
+    }
+
+    int enc = f.tag>0 && f.tag<(int)tagtype.size() ? tagtype[f.tag] : BENC_STR;
+    switch (enc)
+    {
+    case BENC_INT64:
+        if (!fix_parse_int(v, n, fint[i]) || n!=format_int(fint[i], tmp) || memcmp(v, tmp, n))
+            return BENC_STR;
+        return fint[i]>=-0x7fffffffLL-1 && fint[i]<=0x7fffffff ? BENC_INT32 : BENC_INT64;
+
+    case BENC_DECIMAL:
+        if (!fix_parse_decimal(v, n, fdec[i]) || fdec[i].scale>18 || n!=format_decimal(fdec[i], tmp) || memcmp(v, tmp, n))
+            return BENC_STR;
+        return fdec[i].mant>=-0x7fffffffLL-1 && fdec[i].mant<=0x7fffffff ? BENC_DECIMAL32 : BENC_DECIMAL;
+
+    case BENC_CHAR:
+        return n==1 ? BENC_CHAR : BENC_STR;
+
+    case BENC_TIMESTAMP:
+    {
+        int digits = n>18 ? n-18 : 0;
+        if (digits>9 || !fix_parse_timestamp(v, n, fint[i]) || fint[i]<0)
+            return BENC_STR;
+        if (n!=clocks[digits].format(fint[i], tmp) || memcmp(v, tmp, n))
+            return BENC_STR;
+        return enc;
+    }
+    }
+
+    return BENC_STR;
+}
+
+int BinEncoder::group_end(ValidScope* gs, int icount, int nreps)
+{
+    // end of a groups repeats by the spec, -1 if there arent nreps of them
+
+    int i = icount+1;
+    if (i>=view.nflds)
+        return -1;
+
+    int delim = view.flds[i].tag;
+    for (int r=0;r<nreps;r++)
+    {
+        if (i>=view.nflds || view.flds[i].tag!=delim)
+            return -1;
+        i = repeat_end(gs, i, delim);
+    }
+    return i;
+}
+
+int BinEncoder::repeat_end(ValidScope* gs, int i, int delim)
+{
+    // a repeat runs from its first field over the groups fields, and nested groups, until its first field again
+
+    int j = i;
+    while (j<view.nflds)
+    {
+        int tag = view.flds[j].tag;
+        if (j>i && tag==delim)
+            break;
+
+        int s = gs->find(tag);
+        if (s<0)
+            break;
+
+        ValidScope* ns = gs->slots[s].group;
+        int k = ns && (fenc[j]==BENC_INT32 || fenc[j]==BENC_INT64) && fint[j]>0 ? group_end(ns, j, fint[j]) : -1;
+        j = k>0 ? k : j+1;
+    }
+    return j;
+}
+
+static bool same_shape(const vector<BinField>& shape, int a, int b, int n)
+{
+    for (int k=0;k<n;k++)
+    {
+        const BinField& x = shape[a+k];
+        const BinField& y = shape[b+k];
+        if (x.tag!=y.tag || x.enc!=y.enc || x.arg!=y.arg || x.nsub!=y.nsub || x.cval!=y.cval)
+            return false;
+    }
+    return true;
+}
+
+int BinEncoder::build(int i, int iend, ValidScope** scopes, int nscopes)
+{
+    // template entries for fields i..iend, group repeats folded into one block where they all have the same shape
+
+    while (i<iend)
+    {
+        const FixField& f = view.flds[i];
+
+        ValidScope* gs = NULL;
+        for (int s=0; s<nscopes && !gs; s++)
+        {
+            int slot = scopes[s]->find(f.tag);
+            if (slot>=0)
+                gs = scopes[s]->slots[slot].group;
+        }
+
+        if (gs && (fenc[i]==BENC_INT32 || fenc[i]==BENC_INT64) && fint[i]>0 && fint[i]<=0xffff)
+        {
+            int nreps = fint[i];
+            int gend = group_end(gs, i, nreps);
+            if (gend>0 && gend<=iend)
+            {
+                int k0 = shape.size();
+                BinField G;
+                G.tag  = f.tag;
+                G.enc  = BENC_GROUP;
+                G.arg  = 0;
+                G.nsub = 0;
+                shape.push_back(G);
+
+                int k1 = shape.size();
+                int delim = view.flds[i+1].tag;
+                int rs = i+1;
+                int re = repeat_end(gs, rs, delim);
+                build(rs, re, &gs, 1);
+
+                int nsub = shape.size()-k1;
+                bool bsame = nsub<=0xffff;
+                for (int r=1; bsame && r<nreps; r++)
+                {
+                    rs = re;
+                    re = repeat_end(gs, rs, delim);
+
+                    int k2 = shape.size();
+                    build(rs, re, &gs, 1);
+                    bsame = (int)shape.size()-k2==nsub && same_shape(shape, k1, k2, nsub);
+                    shape.resize(k2);
+                }
+
+                if (bsame)
+                {
+                    shape[k0].nsub = nsub;
+                    i = gend;
+                    continue;
+                }
+                shape.resize(k0);                   // repeats differ - fields one by one
+            }
+        }
+
+        BinField F;
+        F.tag  = f.tag;
+        F.enc  = fenc[i];
+        F.arg  = F.enc==BENC_TIMESTAMP ? (f.vlen>18 ? f.vlen-18 : 0) : 0;
+        F.nsub = 0;
+        if (F.enc==BENC_CONST)
+            F.cval.assign(view.value(i), f.vlen);
+        shape.push_back(F);
+        i++;
+    }
+    return i;
+}
+
+int BinEncoder::put_block(const BinTemplate& T, int a, int b, int i, string& out, int depth)
+{
+    // fixed part, then strings and groups gathered per depth - returns the next field of the view
+
+    string& sbuf = vars[2*depth];
+    string& gbuf = vars[2*depth+1];
+    sbuf.clear();
+    gbuf.clear();
+
+    bool bgroups = a ? T.flds[a-1].bgroups : T.bgroups;
+    int fixsz    = a ? T.flds[a-1].fixsz : T.fixsz;
+
+    int base = out.length();
+    out.append(fixsz, 0);
+
+    for (int k=a;k<b;k++)
+    {
+        const BinField& F = T.flds[k];
+        const FixField& f = view.flds[i];
+
+        switch (F.enc)
+        {
+        case BENC_STR:          put_str(sbuf, view.value(i), f.vlen);                   break;
+        case BENC_INT32:        put_at<int>(out, base+F.off, fint[i]);                  break;
+        case BENC_INT64:
+        case BENC_TIMESTAMP:    put_at<long long>(out, base+F.off, fint[i]);            break;
+        case BENC_CHAR:         out[base+F.off] = *view.value(i);                       break;
+        case BENC_DECIMAL:
+            put_at<long long>(out, base+F.off, fdec[i].mant);
+            out[base+F.off+8] = fdec[i].scale;
+            break;
+        case BENC_DECIMAL32:
+            put_at<int>(out, base+F.off, fdec[i].mant);
+            out[base+F.off+4] = fdec[i].scale;
+            break;
+        case BENC_GROUP:
+        {
+            int nreps = fint[i];
+            put_le<unsigned short>(gbuf, nreps);
+            i++;
+            for (int r=0;r<nreps;r++)
+                i = put_block(T, k+1, k+1+F.nsub, i, gbuf, depth+1);
+            k += F.nsub;
+            continue;
+        }
+        }
+        i++;
+    }
+
+    if (bgroups)
+        put_le<unsigned short>(out, sbuf.length());
+    out.append(sbuf);
+    out.append(gbuf);
+    return i;
+}
+
+void BinEncoder::text(const char* p, int len, string& out)
+{
+    if (len<=0)
+        return;
+
+    out.push_back('X');
+    put_le<unsigned>(out, len);
+    out.append(p, len);
+}
+
+void BinEncoder::msg(const char* p, int len, string& out)
+{
+    nmsgs++;
+
+    // a field whose tag isnt a plain number [-1 from the view] couldnt be written back as it was, so the msg goes raw
+
+    int n = view.parse(p, len);
+    bool braw = n<3 || view.nend!=len;
+    for (int i=0;i<n && !braw;i++)
+        braw = view.flds[i].tag<0;
+
+    if (braw)
+    {
+        nraw++;
+        out.push_back('R');
+        put_le<unsigned>(out, len);
+        out.append(p, len);
+        return;
+    }
+
+    if ((int)fenc.size() < n)
+    {
+        fenc.resize(n*2);
+        fint.resize(n*2);
+        fdec.resize(n*2);
+    }
+    for (int i=0;i<n;i++)
+        fenc[i] = field_enc(i);
+
+    // shape of this msg, its template found or added
+
+    ValidScope* scopes[3];
+    int nscopes = 0;
+    scopes[nscopes++] = MG.vheader;
+
+    const char* mt;
+    int nmt;
+    if (view.get(35, mt, nmt))
+    {
+        map<string,ValidScope*>::iterator pb = MG.vbodies.find(string(mt, nmt));
+        if (pb!=MG.vbodies.end())
+            scopes[nscopes++] = pb->second;
+    }
+    scopes[nscopes++] = MG.vtrailer;
+
+    shape.clear();
+    build(0, n, scopes, nscopes);
+
+    BinTemplate probe;
+    probe.flds.swap(shape);
+    skey.clear();
+    probe.serialize(skey);
+    probe.flds.swap(shape);
+
+    int tid;
+    map<string,int>::iterator pt = tids.find(skey);
+    if (pt!=tids.end())
+        tid = pt->second;
+    else
+    {
+        tid = templates.size();
+        if (tid>0xffff)
+        {
+            nraw++;
+            out.push_back('R');
+            put_le<unsigned>(out, len);
+            out.append(p, len);
+            return;
+        }
+
+        BinTemplate* T = new BinTemplate();
+        T->flds = shape;
+        T->compile();
+        templates.push_back(T);
+        tids[skey] = tid;
+
+        out.push_back('T');
+        put_le<unsigned>(out, 2+skey.length());
+        put_le<unsigned short>(out, tid);
+        out.append(skey);
+    }
+
+    // the msg block, or the msg as is if it wont fit in a u16 length
+
+    int nstart = out.length();
+    out.push_back('M');
+    put_le<unsigned short>(out, tid);
+    put_le<unsigned short>(out, 0);
+
+    const BinTemplate& T = *templates[tid];
+    if (vars.size() < 2*(T.flds.size()+1))
+        vars.resize(2*(T.flds.size()+1));                // a buffer pair per depth, sized before any are in use
+
+    put_block(T, 0, T.flds.size(), 0, out, 0);
+
+    int nblock = out.length()-nstart-5;
+    if (nblock>0xffff)
+    {
+        out.resize(nstart);
+        nraw++;
+        out.push_back('R');
+        put_le<unsigned>(out, len);
+        out.append(p, len);
+        return;
+    }
+    put_at<unsigned short>(out, nstart+3, nblock);
+}
+
+
+// BinDecoder
+
+
+BinDecoder::BinDecoder()
+    : nvals(0)
+    , nmsgs(0)
+    , nbad(0)
+{
+    vals.resize(256);
+    for (int i=0;i<10;i++)
+        clocks[i].digits = i;
+}
+
+BinDecoder::~BinDecoder()
+{
+    for (int i=0;i<(int)templates.size();i++)
+        delete templates[i];
+}
+
+int BinDecoder::get_block(const BinTemplate& T, int a, int b, const char* p, const char* pend)
+{
+    // values of one block into vals, returns its length or -1 if it runs past pend
+
+    bool bgroups = a ? T.flds[a-1].bgroups : T.bgroups;
+    int fixsz    = a ? T.flds[a-1].fixsz : T.fixsz;
+
+    const char* v = p+fixsz;
+    if (v+(bgroups ? 2 : 0) > pend)
+        return -1;
+
+    const char* g = NULL;
+    if (bgroups)
+    {
+        g = v+2 + get_le<unsigned short>(v);
+        v += 2;
+        if (g>pend)
+            return -1;
+    }
+
+    for (int k=a;k<b;k++)
+    {
+        const BinField& F = T.flds[k];
+
+        if (nvals==(int)vals.size())
+            vals.resize(nvals*2);
+        BinValue& V = vals[nvals++];
+        V.f = &F;
+
+        const char* q = p+F.off;
+        switch (F.enc)
+        {
+        case BENC_STR:
+        {
+            if (v>=pend)
+                return -1;
+            int len = (unsigned char)*v++;
+            if (len==255)
+            {
+                if (pend-v<2)
+                    return -1;
+                len = get_le<unsigned short>(v);
+                v += 2;
+            }
+            if (pend-v<len)
+                return -1;
+            V.s    = v;
+            V.slen = len;
+            v += len;
+            break;
+        }
+        case BENC_INT32:        V.i = get_le<int>(q);           break;
+        case BENC_INT64:
+        case BENC_TIMESTAMP:    V.i = get_le<long long>(q);     break;
+        case BENC_CHAR:         V.i = (unsigned char)*q;        break;
+        case BENC_DECIMAL:
+            V.d.mant  = get_le<long long>(q);
+            V.d.scale = (unsigned char)q[8];
+            break;
+        case BENC_DECIMAL32:
+            V.d.mant  = get_le<int>(q);
+            V.d.scale = (unsigned char)q[4];
+            break;
+        case BENC_CONST:
+            V.s    = F.cval.data();
+            V.slen = F.cval.length();
+            break;
+        case BENC_GROUP:
+        {
+            if (!g || pend-g<2)
+                return -1;
+            int nreps = get_le<unsigned short>(g);
+            g += 2;
+            V.i = nreps;
+            for (int r=0;r<nreps;r++)
+            {
+                int n = get_block(T, k+1, k+1+F.nsub, g, pend);
+                if (n<0)
+                    return -1;
+                g += n;
+            }
+            k += F.nsub;
+            break;
+        }
+        }
+    }
+
+    return (bgroups ? g : v) - p;
+}
+
+int BinDecoder::next(const char* p, int n, int& kind, const char*& data, int& dlen)
+{
+    if (n<1)
+        return 0;
+
+    kind = *p;
+    if (kind=='M')
+    {
+        if (n<5)
+            return 0;
+
+        int tid  = get_le<unsigned short>(p+1);
+        int blen = get_le<unsigned short>(p+3);
+        if (n<5+blen)
+            return 0;
+        if (tid>=(int)templates.size())
+            return -1;
+
+        data  = p+5;
+        dlen  = blen;
+        nvals = 0;
+
+        const BinTemplate& T = *templates[tid];
+        if (get_block(T, 0, T.flds.size(), data, data+blen)!=blen)
+        {
+            nbad++;
+            return -1;
+        }
+        nmsgs++;
+        return 5+blen;
+    }
+
+    if (kind!='T' && kind!='R' && kind!='X')
+        return -1;
+    if (n<5)
+        return 0;
+
+    unsigned len = get_le<unsigned>(p+1);
+    if (len > (1u<<30))
+        return -1;
+    if ((unsigned)n-5 < len)
+        return 0;
+
+    data = p+5;
+    dlen = len;
+
+    if (kind=='T')
+    {
+        BinTemplate* T = new BinTemplate();
+        if (len<2 || get_le<unsigned short>(data)!=templates.size() || !T->deserialize(data+2, len-2))
+        {
+            delete T;
+            nbad++;
+            return -1;
+        }
+        templates.push_back(T);
+    }
+
+    return 5+len;
+}
+
+int BinDecoder::to_text(string& out)
+{
+    // the msg as it was sent - BodyLength and CheckSum worked out again where they were left out
+
+    int nstart = out.length();
+    int nlen   = -1;                                // BodyLength slot to fill
+    int nbody  = 0;
+
+    for (int k=0;k<nvals;k++)
+    {
+        const BinValue& V = vals[k];
+        const BinField& F = *V.f;
+
+        if (F.enc==BENC_DERIVED && F.tag==10)
+        {
+            if (nlen>=0)
+            {
+                char sz[16];
+                int nd = format_int(out.length()-nbody, sz);
+                out.replace(nlen, 10, sz, nd);
+                nlen = -1;
+            }
+            unsigned sum = byte_sum(out.data()+nstart, out.length()-nstart) % 256;
+            char sck[8] = { '1', '0', '=', (char)('0'+sum/100), (char)('0'+sum/10%10), (char)('0'+sum%10), 0x01, 0 };
+            out.append(sck, 7);
+            continue;
+        }
+
+        out.append(F.tagtext, F.ntag);
+
+        char tmp[48];
+        switch (F.enc)
+        {
+        case BENC_STR:
+        case BENC_CONST:        out.append(V.s, V.slen);                                        break;
+        case BENC_INT32:
+        case BENC_INT64:
+        case BENC_GROUP:        out.append(tmp, format_int(V.i, tmp));                          break;
+        case BENC_DECIMAL:
+        case BENC_DECIMAL32:    out.append(tmp, format_decimal(V.d, tmp));                      break;
+        case BENC_CHAR:         out.push_back((char)V.i);                                       break;
+        case BENC_TIMESTAMP:    out.append(tmp, clocks[F.arg].format(V.i, tmp));                break;
+        case BENC_DERIVED:
+            nlen = out.length();                    // BodyLength, room for the widest
+            out.append(10, '0');
+            out.push_back(0x01);
+            nbody = out.length();
+            continue;
+        }
+        out.push_back(0x01);
+    }
+
+    if (nlen>=0)
+    {
+        char sz[16];
+        int nd = format_int(out.length()-nbody, sz);
+        out.replace(nlen, 10, sz, nd);
+    }
+
+    return out.length()-nstart;
+}
@@ -0,0 +1,150 @@
+//
+//  fixsbe.h - compact binary fix logs, SBE style : fixed offset numeric fields, length prefixed strings, counted group blocks
+//
+//      a msg is laid out by a template - its fields in order, each with an encoding from its spec type
+//      [SEQNUM LENGTH NUMINGROUP .. int32, INT int64, PRICE QTY .. decimal, UTCTIMESTAMP ns, CHAR a byte]
+//      where the value round trips exactly, else as a string - ints and decimals that fit take 4 byte forms
+//
+//      group repeats of the same shape fold into one counted block [group membership from the compiled spec],
+//      BeginString and MsgType are constants of the template, BodyLength and CheckSum are rebuilt when they were right
+//
+//      templates are written into the stream the first time a msg of that shape is seen, so a file is self describing
+//      and decoding needs no spec - text between msgs, and msgs that dont fit a template, are kept as is
+//
+//      file    :  magic, then records
+//      record  :  'T' u32 len, template    'M' u16 template u16 len, block    'R' / 'X' u32 len, raw msg / text
+//      block   :  fixed fields [at offsets from the template], u16 varlen if it has groups, strings, groups
+//      string  :  u8 len [255 : u16 len follows], bytes
+//      group   :  u16 count, count repeat blocks
+//
+//      all little endian, unaligned
+//
+#ifndef _FIXSBE_H_
+#define _FIXSBE_H_
+
+#include "fixcore.h"
+
+
+#define FIXSBE_MAGIC        "\x89" "FIXSBE1"
+#define FIXSBE_MAGICLEN     8
+
+
+enum BinEnc
+{
+    BENC_STR = 0,                       // var section
+    BENC_INT32,                         // 4 bytes
+    BENC_INT64,                         // 8 bytes
+    BENC_DECIMAL,                       // 8 bytes mantissa, 1 byte scale
+    BENC_DECIMAL32,                     // 4 bytes mantissa, 1 byte scale
+    BENC_CHAR,                          // 1 byte
+    BENC_TIMESTAMP,                     // 8 bytes ns since epoch, fraction digits in arg
+    BENC_CONST,                         // value in the template
+    BENC_DERIVED,                       // BodyLength, CheckSum - rebuilt on decode
+    BENC_GROUP                          // count field, nsub entries of the repeat follow
+};
+
+
+struct BinField
+{
+    int         tag;
+    int         enc;                    // BinEnc
+    int         arg;                    // timestamp fraction digits
+    string      cval;                   // BENC_CONST value
+    int         nsub;                   // BENC_GROUP : entries in its repeat [nested groups and their entries included]
+
+    // compiled
+
+    int         off;                    // in the fixed part of its block
+    int         fixsz;                  // BENC_GROUP : fixed part of a repeat
+    bool        bgroups;                // BENC_GROUP : repeats have groups of their own
+    char        tagtext[16];            // "tag="
+    int         ntag;
+};
+
+
+struct BinTemplate
+{
+    vector<BinField>    flds;           // in msg order, group repeats inline after their count
+    int                 fixsz;          // fixed part of the msg block
+    bool                bgroups;
+
+    void    compile();                  // offsets, block sizes, tag text
+    void    serialize(string& s) const;
+    bool    deserialize(const char* p, int n);
+};
+
+
+struct BinValue
+{
+    // a decoded field - strings in place in the record, or in the template for constants
+
+    const BinField* f;                  // tag, encoding
+    long long   i;                      // INT32 INT64 TIMESTAMP CHAR, group count
+    FixDecimal  d;
+    const char* s;                      // STR CONST
+    int         slen;
+};
+
+
+struct BinEncoder
+{
+    // fix text to records
+
+    MessageGenerator&       MG;
+    vector<unsigned char>   tagtype;    // BinEnc by tag, from the spec field types
+    map<string, int>        tids;       // serialized template => id
+    vector<BinTemplate*>    templates;
+
+    FixMessageView          view;
+    vector<BinField>        shape;
+    vector<char>            fenc;       // per field of the view : its BinEnc
+    vector<long long>       fint;       // .. and numeric value
+    vector<FixDecimal>      fdec;
+    vector<string>          vars;       // strings and groups per block depth [reused]
+    string                  skey;
+    FixClock                clocks[10]; // timestamp text by fraction digits, to check values round trip
+
+    long long               nmsgs;
+    long long               nraw;       // kept as is
+
+    BinEncoder(MessageGenerator& mg);
+    ~BinEncoder();
+
+    void    msg(const char* p, int len, string& out);       // appends one record
+    void    text(const char* p, int len, string& out);      // bytes between msgs
+
+    // internal
+
+    int     field_enc(int i);
+    int     group_end(ValidScope* gs, int icount, int nreps);
+    int     repeat_end(ValidScope* gs, int i, int delim);
+    int     build(int i, int iend, ValidScope** scopes, int nscopes);
+    int     put_block(const BinTemplate& T, int a, int b, int i, string& out, int depth);
+};
+
+
+struct BinDecoder
+{
+    // records back to values [next] and to fix text [decode]
+
+    vector<BinTemplate*>    templates;
+    vector<BinValue>        vals;       // last msg, in field order
+    int                     nvals;
+    FixClock                clocks[10]; // timestamp text by fraction digits
+
+    long long               nmsgs;
+    long long               nbad;       // records that didnt decode
+
+    BinDecoder();
+    ~BinDecoder();
+
+    // record at p [n bytes available] : its length, 0 if more bytes are needed, -1 if its not a record
+    // kind set to 'M' 'R' 'X' or 'T', msg values decoded into vals for 'M', raw bytes at data for 'R' and 'X'
+
+    int     next(const char* p, int n, int& kind, const char*& data, int& dlen);
+    int     to_text(string& out);                           // vals as a fix msg, returns its length
+
+    int     get_block(const BinTemplate& T, int a, int b, const char* p, const char* pend);
+};
+
+#endif //_FIXSBE_H_
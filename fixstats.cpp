@@ -0,0 +1,272 @@
+//
+//  fixstats.cpp - per stage timing report [see fixstats.h]
+//
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+#include "fixstats.h"
+
+
+unsigned long long fix_nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+
+// LatencyHistogram
+
+
+unsigned long long LatencyHistogram::percentile(double p)
+{
+    // top of the bucket holding the p'th value, capped at the max seen
+
+    if (!n)
+        return 0;
+
+    unsigned long long target = (unsigned long long)(p*n + 0.999999);
+    if (target<1)
+        target=1;
+
+    unsigned long long sum = 0;
+    for (int i=0;i<NBUCKETS;i++)
+    {
+        sum += counts[i];
+        if (sum>=target)
+            return min(bucket_top(i), nmax);
+    }
+    return nmax;
+}
+
+
+// LatencyStats
+
+
+LatencyStats::LatencyStats(int n)
+    : nworst(n)
+{
+    memset(by_char, 0, sizeof(by_char));
+    memset(by_size, 0, sizeof(by_size));
+    worst.reserve(nworst+1);
+}
+
+LatencyStats::~LatencyStats()
+{
+    for (int i=0;i<128;i++)
+        delete by_char[i];
+    for (int i=0;i<64;i++)
+        delete by_size[i];
+    for (map<string, LatencyHistogram*>::iterator p=by_type.begin();p!=by_type.end();p++)
+        delete p->second;
+}
+
+void LatencyStats::add(unsigned long long ns, long long offset, const string& msgtype, int len)
+{
+    all.add(ns);
+
+    LatencyHistogram** pH;
+    if (msgtype.length()==1 && (unsigned char)msgtype[0]<128)
+        pH = &by_char[(int)msgtype[0]];
+    else
+        pH = &by_type[msgtype];
+    if (!*pH)
+        *pH = new LatencyHistogram();
+    (*pH)->add(ns);
+
+    int nsize = len>0 ? 63-__builtin_clzll(len) : 0;
+    if (!by_size[nsize])
+        by_size[nsize] = new LatencyHistogram();
+    by_size[nsize]->add(ns);
+
+    // keep the slowest nworst
+
+    if ((int)worst.size()==nworst && ns<=worst.front().ns)
+        return;
+
+    Worst w;
+    w.ns     = ns;
+    w.offset = offset;
+    w.len    = len;
+    strncpy(w.msgtype, msgtype.c_str(), sizeof(w.msgtype)-1);
+    w.msgtype[sizeof(w.msgtype)-1] = 0;
+
+    worst.push_back(w);
+    push_heap(worst.begin(), worst.end(), greater<Worst>());
+    if ((int)worst.size()>nworst)
+    {
+        pop_heap(worst.begin(), worst.end(), greater<Worst>());
+        worst.pop_back();
+    }
+}
+
+static void report_line(FILE* fp, const char* label, LatencyHistogram& H)
+{
+    fprintf(fp, "  %-20s %10llu %10llu %10llu %10llu %10llu\n", label, H.n,
+        H.percentile(0.5), H.percentile(0.99), H.percentile(0.999), H.nmax);
+}
+
+void LatencyStats::report(FILE* fp)
+{
+    char label[64];
+
+    fprintf(fp, "\nlatency [ns]\n");
+    fprintf(fp, "  %-20s %10s %10s %10s %10s %10s\n", "", "msgs", "p50", "p99", "p99.9", "max");
+
+    report_line(fp, "all", all);
+
+    for (int i=0;i<128;i++)
+    {
+        if (!by_char[i])
+            continue;
+        snprintf(label, sizeof(label), "35=%c", i);
+        report_line(fp, label, *by_char[i]);
+    }
+    for (map<string, LatencyHistogram*>::iterator p=by_type.begin();p!=by_type.end();p++)
+    {
+        snprintf(label, sizeof(label), "35=%s", p->first.c_str());
+        report_line(fp, label, *p->second);
+    }
+
+    for (int i=0;i<64;i++)
+    {
+        if (!by_size[i])
+            continue;
+        snprintf(label, sizeof(label), "bytes %llu-%llu", 1ULL<<i, (2ULL<<i)-1);
+        report_line(fp, label, *by_size[i]);
+    }
+
+    vector<Worst> sorted(worst);
+    sort(sorted.begin(), sorted.end(), greater<Worst>());
+
+    fprintf(fp, "\nslowest %d msgs\n", (int)sorted.size());
+    fprintf(fp, "  %10s %14s %6s %8s\n", "ns", "offset", "35=", "bytes");
+    for (int i=0;i<(int)sorted.size();i++)
+        fprintf(fp, "  %10llu %14lld %6s %8d\n", sorted[i].ns, sorted[i].offset, sorted[i].msgtype, sorted[i].len);
+}
+
+
+// stage timers
+
+
+#ifdef FIXTR_STATS
+
+static double wall_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static const char* stage_names[NSTAGES] =
+    { "other", "read", "find", "check", "walk", "tokenize", "lookup", "format", "write" };
+
+static std::mutex           stats_lock;
+static FixStats*            stats_exited;           // totals of threads that have exited
+static double               wall_start;
+static unsigned long long   tsc_start;
+
+thread_local FixStats fix_thread_stats;
+
+FixStats::FixStats()
+    : stage(STAGE_OTHER)
+    , t0(fix_cycles())
+{
+    memset(cycles, 0, sizeof(cycles));
+    memset(counts, 0, sizeof(counts));
+}
+
+FixStats::~FixStats()
+{
+    std::lock_guard<std::mutex> lock(stats_lock);
+
+    if (!stats_exited)
+        stats_exited = new FixStats();
+    merge_into(*stats_exited);
+}
+
+void FixStats::merge_into(FixStats& total)
+{
+    for (int i=0;i<NSTAGES;i++)
+        total.cycles[i] += cycles[i];
+    for (int i=0;i<NCOUNTERS;i++)
+        total.counts[i] += counts[i];
+}
+
+void fix_stats_start()
+{
+    // setup before this [spec parse and expand] isnt the run, so not in the figures
+
+    wall_start = wall_now();
+    tsc_start  = fix_cycles();
+
+    FixStats& S = fix_thread_stats;
+    memset(S.cycles, 0, sizeof(S.cycles));
+    memset(S.counts, 0, sizeof(S.counts));
+    S.t0 = tsc_start;
+}
+
+void fix_stats_report(FILE* fp)
+{
+    // charge the open stage of this thread, then merge with threads that have finished
+
+    FixStats& S = fix_thread_stats;
+    unsigned long long now = fix_cycles();
+    S.cycles[S.stage] += now - S.t0;
+    S.t0 = now;
+
+    double secs = wall_now() - wall_start;
+
+    FixStats T;
+    S.merge_into(T);
+    {
+        std::lock_guard<std::mutex> lock(stats_lock);
+        if (stats_exited)
+            stats_exited->merge_into(T);
+    }
+
+    unsigned long long total = 0;
+    for (int i=0;i<NSTAGES;i++)
+        total += T.cycles[i];
+
+    unsigned long long nmsgs = T.counts[COUNT_MSGS];
+    double ghz = secs>0 ? (now-tsc_start)/secs/1e9 : 0;
+
+    fprintf(fp, "\nstats-timing\n");
+    fprintf(fp, "  %llu msgs, %llu msg bytes, %llu input bytes in %.3f s  [cycle clock %.2f GHz]\n",
+        nmsgs, T.counts[COUNT_MSG_BYTES], T.counts[COUNT_BYTES_IN], secs, ghz);
+    fprintf(fp, "  %.0f msgs/s  %.1f MB/s in  %.0f cycles/msg  %llu fields  %llu lookups\n",
+        secs>0 ? nmsgs/secs : 0, secs>0 ? T.counts[COUNT_BYTES_IN]/secs/1e6 : 0,
+        nmsgs ? (double)total/nmsgs : 0, T.counts[COUNT_FIELDS], T.counts[COUNT_LOOKUPS]);
+
+    fprintf(fp, "  %-10s %14s %7s %12s\n", "stage", "cycles", "%", "cycles/msg");
+    for (int i=0;i<NSTAGES;i++)
+    {
+        if (!T.cycles[i])
+            continue;
+        fprintf(fp, "  %-10s %14llu %6.1f%% %12.0f\n", stage_names[i], T.cycles[i],
+            total ? 100.0*T.cycles[i]/total : 0, nmsgs ? (double)T.cycles[i]/nmsgs : 0);
+    }
+}
+
+#else
+
+void fix_stats_start()
+{
+}
+
+void fix_stats_report(FILE* fp)
+{
+    fprintf(fp, "\nstats-timing : not compiled in, rebuild with  make clean; make STATS=1\n");
+}
+
+#endif //FIXTR_STATS
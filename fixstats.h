@@ -0,0 +1,200 @@
+//
+//  fixstats.h - hot path instrumentation : per stage cycle timers and counters
+//
+//      compiled in only with -DFIXTR_STATS [make STATS=1], otherwise the macros are empty
+//
+//      FIX_STAGE(STAGE_x)      charge cycles to stage x until end of scope [exclusive time, nested stages pause the outer]
+//      FIX_COUNT(COUNT_x, n)   add n to counter x
+//
+//      each thread accumulates its own FixStats, merged into the report at exit
+//
+//      LatencyStats is always compiled in [fixtr --latency] : per msg processing time
+//      in log-linear histograms by msg type and size, plus the slowest msgs by input offset
+//
+#ifndef _FIXSTATS_H_
+#define _FIXSTATS_H_
+
+#include <stdio.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+enum FixStage
+{
+    STAGE_OTHER = 0,
+    STAGE_READ,                 // reading input
+    STAGE_FIND,                 // searching for 8=FIX
+    STAGE_CHECK,                // msg_bad prelude / checksum
+    STAGE_WALK,                 // trace engine control flow
+    STAGE_TOKENIZE,             // FixMessageView::parse
+    STAGE_LOOKUP,               // ValidScope::find [XNode::lookup outside the trace walk]
+    STAGE_FORMAT,               // sink output formatting
+    STAGE_WRITE,                // writing output
+    NSTAGES
+};
+
+enum FixCounter
+{
+    COUNT_MSGS = 0,
+    COUNT_BYTES_IN,
+    COUNT_MSG_BYTES,
+    COUNT_FIELDS,
+    COUNT_LOOKUPS,
+    NCOUNTERS
+};
+
+void fix_stats_start();                 // mark wall clock start, once setup is done - drops what this thread had so far
+void fix_stats_report(FILE* fp);        // merged report over all threads
+
+unsigned long long fix_nanos();         // monotonic clock in ns
+
+
+struct LatencyHistogram
+{
+    // HDR style log-linear buckets : 32 linear sub buckets per power of 2 [~3% precision], values in ns
+
+    enum { SUBBITS = 5, NSUB = 1<<SUBBITS, NBUCKETS = (64-SUBBITS)*NSUB + 2*NSUB };
+
+    unsigned long long  counts[NBUCKETS];
+    unsigned long long  n;
+    unsigned long long  nmax;
+
+    LatencyHistogram()
+        : n(0)
+        , nmax(0)
+    {
+        memset(counts, 0, sizeof(counts));
+    }
+
+    static int bucket(unsigned long long v)
+    {
+        if (v < 2*NSUB)
+            return v;
+
+        int shift = 63 - __builtin_clzll(v) - SUBBITS;
+        return shift*NSUB + (v>>shift);
+    }
+
+    static unsigned long long bucket_top(int i)
+    {
+        // highest value that lands in bucket i
+
+        if (i < 2*NSUB)
+            return i;
+
+        int shift = i/NSUB - 1;
+        unsigned long long sub = i%NSUB + NSUB;
+        return ((sub+1)<<shift) - 1;
+    }
+
+    void add(unsigned long long v)
+    {
+        counts[bucket(v)]++;
+        n++;
+        if (v>nmax)
+            nmax=v;
+    }
+
+    unsigned long long percentile(double p);
+};
+
+
+struct LatencyStats
+{
+    // per msg latency by msg type and by msg size [power of 2 classes], and the worst N msgs
+
+    struct Worst
+    {
+        unsigned long long  ns;
+        long long           offset;             // input byte offset of the msg
+        int                 len;
+        char                msgtype[8];
+
+        bool operator>(const Worst& w) const { return ns > w.ns; }
+    };
+
+    int                             nworst;
+    LatencyHistogram                all;
+    LatencyHistogram*               by_char[128];       // single char msg types, the common case
+    std::map<std::string, LatencyHistogram*> by_type;   // longer msg types
+    LatencyHistogram*               by_size[64];
+    std::vector<Worst>              worst;              // min heap on ns, size nworst
+
+    LatencyStats(int n=10);
+    ~LatencyStats();
+
+    void add(unsigned long long ns, long long offset, const std::string& msgtype, int len);
+    void report(FILE* fp);
+};
+
+
+#ifdef FIXTR_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline unsigned long long fix_cycles() { return __rdtsc(); }
+#else
+#include <time.h>
+inline unsigned long long fix_cycles()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+struct FixStats
+{
+    // per thread totals, folded into the process totals when the thread exits
+
+    unsigned long long  cycles[NSTAGES];
+    unsigned long long  counts[NCOUNTERS];
+    int                 stage;              // stage being charged now
+    unsigned long long  t0;                 // since
+
+    FixStats();
+    ~FixStats();
+
+    void merge_into(FixStats& total);
+};
+
+extern thread_local FixStats fix_thread_stats;
+
+struct StageTimer
+{
+    // charge the enclosing scope to a stage, restoring the outer stage on exit
+
+    int prev;
+
+    StageTimer(int stage)
+    {
+        FixStats& S = fix_thread_stats;
+        unsigned long long now = fix_cycles();
+        S.cycles[S.stage] += now - S.t0;
+        S.t0   = now;
+        prev   = S.stage;
+        S.stage= stage;
+    }
+
+    ~StageTimer()
+    {
+        FixStats& S = fix_thread_stats;
+        unsigned long long now = fix_cycles();
+        S.cycles[S.stage] += now - S.t0;
+        S.t0   = now;
+        S.stage= prev;
+    }
+};
+
+#define FIX_STAGE(s)        StageTimer _fix_stage_timer(s)
+#define FIX_COUNT(c, n)     (fix_thread_stats.counts[c] += (n))
+
+#else
+
+#define FIX_STAGE(s)
+#define FIX_COUNT(c, n)
+
+#endif //FIXTR_STATS
+
+#endif //_FIXSTATS_H_
@@ -0,0 +1,537 @@
+//
+//  fixtop.cpp - heavy hitters of chosen tags in fixed memory [see fixtop.h]
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fixcore.h"
+#include "fixfmt.h"
+#include "fixtop.h"
+#include "fixcheckpoint.h"
+
+
+static unsigned long long value_hash(const char* v, int n)
+{
+    // FNV-1a, then mixed [splitmix64 finalizer] so both halves are usable as independent hashes
+
+    unsigned long long h = 14695981039346656037ULL;
+    for (int i=0;i<n;i++)
+        h = (h ^ (unsigned char)v[i]) * 1099511628211ULL;
+
+    h ^= h >> 30;   h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;   h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static inline int sketch_col(unsigned long long h, int row)
+{
+    // row r of the sketch at h1 + r*h2 [double hashing]
+
+    unsigned h1 = (unsigned)h;
+    unsigned h2 = (unsigned)(h >> 32) | 1;
+    return (h1 + row*h2) & (TopSketch::WIDTH-1);
+}
+
+
+// TopSketch
+
+
+TopSketch::TopSketch(int t, const char* nm, int cap)
+    : tag(t)
+    , name(nm)
+    , capacity(cap)
+    , counts(DEPTH*WIDTH, 0)
+    , qty38(DEPTH*WIDTH, 0)
+    , qty32(DEPTH*WIDTH, 0)
+    , entries(cap)
+    , nvalues(0)
+{
+    int n = 4;
+    while (n < 2*cap)
+        n <<= 1;
+    table.assign(n, 0);
+    heap.reserve(cap);
+}
+
+void TopSketch::clear()
+{
+    std::fill(counts.begin(), counts.end(), 0);
+    std::fill(qty38.begin(), qty38.end(), 0);
+    std::fill(qty32.begin(), qty32.end(), 0);
+    std::fill(table.begin(), table.end(), 0);
+    heap.clear();
+    nvalues = 0;
+}
+
+long long TopSketch::estimate(const vector<long long>& sketch, unsigned long long h) const
+{
+    long long est = sketch[sketch_col(h, 0)];
+    for (int r=1;r<DEPTH;r++)
+        est = min(est, sketch[r*WIDTH + sketch_col(h, r)]);
+    return est;
+}
+
+int TopSketch::lookup(unsigned long long h, const char* v, int n) const
+{
+    unsigned mask = table.size()-1;
+    unsigned k = (unsigned)(h >> 40) & mask;
+    for (; table[k]; k=(k+1) & mask)
+    {
+        const TopEntry& e = entries[table[k]-1];
+        if (e.hash==h && (int)e.value.length()==n && 0==memcmp(e.value.data(), v, n))
+            break;
+    }
+    return k;
+}
+
+void TopSketch::unlink(int slot)
+{
+    // backward shift delete : move up any entry further along the chain that may sit in the gap
+
+    unsigned mask = table.size()-1;
+    unsigned i = slot;
+    unsigned j = slot;
+    table[i] = 0;
+
+    while (true)
+    {
+        j = (j+1) & mask;
+        if (!table[j])
+            break;
+
+        unsigned k = (unsigned)(entries[table[j]-1].hash >> 40) & mask;
+        bool bstays = i<=j ? (i<k && k<=j) : (i<k || k<=j);
+        if (bstays)
+            continue;
+
+        table[i] = table[j];
+        table[j] = 0;
+        i = j;
+    }
+}
+
+void TopSketch::sift_down(int i)
+{
+    int n = heap.size();
+    while (true)
+    {
+        int c = 2*i+1;
+        if (c>=n)
+            break;
+        if (c+1<n && entries[heap[c+1]].count < entries[heap[c]].count)
+            c++;
+        if (entries[heap[i]].count <= entries[heap[c]].count)
+            break;
+
+        swap(heap[i], heap[c]);
+        entries[heap[i]].hpos = i;
+        entries[heap[c]].hpos = c;
+        i = c;
+    }
+}
+
+void TopSketch::sift_up(int i)
+{
+    while (i>0)
+    {
+        int p = (i-1)/2;
+        if (entries[heap[p]].count <= entries[heap[i]].count)
+            break;
+
+        swap(heap[i], heap[p]);
+        entries[heap[i]].hpos = i;
+        entries[heap[p]].hpos = p;
+        i = p;
+    }
+}
+
+void TopSketch::add(const char* v, int n, long long q38, long long q32)
+{
+    unsigned long long h = value_hash(v, n);
+
+    long long est = 0;
+    for (int r=0;r<DEPTH;r++)
+    {
+        int k = r*WIDTH + sketch_col(h, r);
+        long long c = ++counts[k];
+        qty38[k] += q38;
+        qty32[k] += q32;
+        est = r ? min(est, c) : c;
+    }
+    nvalues++;
+
+    int s = lookup(h, v, n);
+    if (table[s])
+    {
+        TopEntry& e = entries[table[s]-1];
+        e.count = est;
+        sift_down(e.hpos);
+        return;
+    }
+
+    int ie;
+    int at;
+    if ((int)heap.size() < capacity)
+    {
+        ie = at = heap.size();
+        heap.push_back(ie);
+    }
+    else
+    {
+        // the least on the heap may have been seen since its count was taken
+
+        for (int tries=0;tries<4;tries++)
+        {
+            TopEntry& least = entries[heap[0]];
+            long long c = estimate(counts, least.hash);
+            if (c==least.count)
+                break;
+            least.count = c;
+            sift_down(0);
+        }
+
+        if (est <= entries[heap[0]].count)
+            return;
+
+        ie = heap[0];
+        at = 0;
+        TopEntry& old = entries[ie];
+        unlink(lookup(old.hash, old.value.data(), old.value.length()));
+        s = lookup(h, v, n);
+    }
+
+    TopEntry& e = entries[ie];
+    e.value.assign(v, n);
+    e.hash  = h;
+    e.count = est;
+    e.hpos  = at;
+    table[s] = ie+1;
+
+    if (at)
+        sift_up(at);
+    else
+        sift_down(0);
+}
+
+
+// FixTop
+
+
+FixTop::FixTop(MessageGenerator& mg, OutBuf& o, int n, long long ival)
+    : MG(mg)
+    , out(o)
+    , ntop(n)
+    , interval(ival)
+    , tnext(0)
+    , nmsgs(0)
+    , nbad(0)
+{
+    stime[0] = 0;
+}
+
+FixTop::~FixTop()
+{
+    for (int i=0;i<(int)sketches.size();i++)
+        delete sketches[i];
+}
+
+bool FixTop::add_tag(const char* sztag)
+{
+    // by number or by field name
+
+    string id = sztag;
+    if (MG.fields_by_name.count(id))
+        id = MG.fields_by_name[id];
+
+    int tag = atoi(id.c_str());
+    if (tag<=0 || id!=int_to_string(tag))
+        return false;
+
+    mapsx::iterator p = MG.fields.find(id);
+    const char* szname = p!=MG.fields.end() && p->second->att("name") ? p->second->att("name") : id.c_str();
+
+    sketches.push_back(new TopSketch(tag, szname, max(64, 8*ntop)));
+    return true;
+}
+
+static void put_qty(OutBuf& out, long long v)
+{
+    // fixed point at QTYPLACES back to the shortest decimal
+
+    const long long SCALE = 10000;
+
+    if (v<0)
+    {
+        out.put('-');
+        v = -v;
+    }
+    out.put_int(v/SCALE);
+
+    long long frac = v%SCALE;
+    if (!frac)
+        return;
+
+    char sz[16];
+    int n = sprintf(sz, ".%04lld", frac);
+    while (sz[n-1]=='0')
+        n--;
+    out.put(sz, n);
+}
+
+struct TopRow
+{
+    const TopEntry* e;
+    long long       count;
+
+    bool operator<(const TopRow& r) const
+    {
+        if (count!=r.count)
+            return count > r.count;
+        return e->value < r.e->value;
+    }
+};
+
+void FixTop::report(const char* label)
+{
+    vector<TopRow> rows;
+
+    for (int t=0;t<(int)sketches.size();t++)
+    {
+        TopSketch& S = *sketches[t];
+
+        rows.clear();
+        for (int i=0;i<(int)S.heap.size();i++)
+        {
+            const TopEntry& e = S.entries[S.heap[i]];
+            TopRow r = { &e, S.estimate(S.counts, e.hash) };
+            rows.push_back(r);
+        }
+        sort(rows.begin(), rows.end());
+
+        for (int i=0;i<(int)rows.size() && i<ntop;i++)
+        {
+            const TopEntry& e = *rows[i].e;
+
+            out.put(label);
+            out.put(' ');
+            out.put_int(S.tag);
+            out.put(' ');
+            out.put(S.name);
+            out.put(' ');
+            out.put_int(i+1);
+            out.put(' ');
+            out.put(e.value);
+            out.put(' ');
+            out.put_int(rows[i].count);
+            out.put(' ');
+            put_qty(out, S.estimate(S.qty38, e.hash));
+            out.put(' ');
+            put_qty(out, S.estimate(S.qty32, e.hash));
+            out.put('\n');
+        }
+        out.end_record();
+
+        S.clear();
+    }
+}
+
+static long long qty_of(const FixMessageView& view, int tag)
+{
+    FixDecimal d;
+    int i = view.find(tag);
+    if (i<0 || !view.get_decimal(i, d) || d.mant<0)
+        return 0;
+    return d.at_scale(TopSketch::QTYPLACES);
+}
+
+void FixTop::msg(const char* p, int len)
+{
+    if (MG.msg_bad(p, len, false))
+    {
+        nbad++;
+        return;
+    }
+
+    view.parse(p, len);
+    nmsgs++;
+
+    // windows by SendingTime, labelled by their start - a report for each window that saw msgs
+
+    if (interval)
+    {
+        long long t;
+        int i52 = view.find(52);
+        if (i52>=0 && view.get_timestamp(i52, t) && t>=tnext)
+        {
+            if (tnext)
+                report(stime);
+
+            long long tstart = t/interval*interval;
+            tnext = tstart+interval;
+
+            FixClock clock;
+            clock.digits = 3;
+            stime[clock.format(tstart, stime)] = 0;
+        }
+    }
+
+    long long q38 = qty_of(view, 38);
+    long long q32 = qty_of(view, 32);
+
+    for (int t=0;t<(int)sketches.size();t++)
+    {
+        int i = view.find(sketches[t]->tag);
+        if (i>=0)
+            sketches[t]->add(view.value(i), view.flds[i].vlen, q38, q32);
+    }
+}
+
+void FixTop::save(FixCheckpoint& ck)
+{
+    // counts and window, then per tag the sketch cells in use and the heap in heap order
+
+    ck.clear();
+    ck.line("counts");
+    ck.add(nmsgs);
+    ck.add(nbad);
+    ck.add(tnext);
+    ck.add(stime, strlen(stime));
+
+    for (int t=0;t<(int)sketches.size();t++)
+    {
+        TopSketch& S = *sketches[t];
+        ck.line("sketch");
+        ck.add(S.tag);
+        ck.add(S.nvalues);
+
+        for (int k=0;k<(int)S.counts.size();k++)
+        {
+            if (!S.counts[k])
+                continue;
+            ck.line("cell");
+            ck.add(k);
+            ck.add(S.counts[k]);
+            ck.add(S.qty38[k]);
+            ck.add(S.qty32[k]);
+        }
+
+        for (int i=0;i<(int)S.heap.size();i++)
+        {
+            const TopEntry& e = S.entries[S.heap[i]];
+            ck.line("value");
+            ck.add(e.value);
+            ck.add(e.count);
+        }
+    }
+}
+
+bool FixTop::restore(FixCheckpoint& ck)
+{
+    TopSketch* S = NULL;
+    while (ck.next_line())
+    {
+        if (ck.is("counts"))
+        {
+            nmsgs = ck.get_int(1);
+            nbad  = ck.get_int(2);
+            tnext = ck.get_int(3);
+
+            int n = min((int)ck.get(4).length(), (int)sizeof(stime)-1);
+            memcpy(stime, ck.get(4).data(), n);
+            stime[n] = 0;
+        }
+        else if (ck.is("sketch"))
+        {
+            S = NULL;
+            for (int t=0;t<(int)sketches.size();t++)
+                if (sketches[t]->tag==ck.get_int(1))
+                    S = sketches[t];
+            if (!S)
+                return false;
+            S->clear();
+            S->nvalues = ck.get_int(2);
+        }
+        else if (ck.is("cell") && S)
+        {
+            int k = ck.get_int(1);
+            if (k<0 || k>=(int)S->counts.size())
+                return false;
+            S->counts[k] = ck.get_int(2);
+            S->qty38[k]  = ck.get_int(3);
+            S->qty32[k]  = ck.get_int(4);
+        }
+        else if (ck.is("value") && S && (int)S->heap.size()<S->capacity)
+        {
+            // back at the same heap positions, so ties break as they would have
+
+            int ie = S->heap.size();
+            const string& v = ck.get(1);
+
+            TopEntry& e = S->entries[ie];
+            e.value = v;
+            e.hash  = value_hash(v.data(), v.length());
+            e.count = ck.get_int(2);
+            e.hpos  = ie;
+            S->heap.push_back(ie);
+            S->table[S->lookup(e.hash, v.data(), v.length())] = ie+1;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+void FixTop::run(int fd, int delims, FixCheckpoint* ck)
+{
+    FixFramer framer;
+    framer.delims = delims;
+    framer.base = ck ? ck->offset : 0;
+    while (!framer.beof)
+    {
+        {
+            FIX_STAGE(STAGE_READ);
+            char* p = framer.space();
+            int r = read(fd, p, framer.avail());
+            if (r<0 && errno==EINTR)
+                continue;
+            if (r<=0)
+                framer.beof = true;
+            else
+                framer.commit(r);
+            FIX_COUNT(COUNT_BYTES_IN, r>0 ? r : 0);
+        }
+
+        const char* p;
+        int len;
+        long long off;
+        while (true)
+        {
+            {
+                FIX_STAGE(STAGE_FIND);
+                if (!framer.next(p, len, off))
+                    break;
+            }
+            FIX_COUNT(COUNT_MSGS, 1);
+            FIX_COUNT(COUNT_MSG_BYTES, len);
+            msg(p, len);
+
+            if (ck && ck->tick())
+            {
+                save(*ck);
+                ck->save(off+framer.rawlen, out);
+            }
+        }
+    }
+
+    report(stime[0] ? stime : "all");
+    out.flush();
+}
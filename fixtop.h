@@ -0,0 +1,94 @@
+//
+//  fixtop.h - heavy hitters : the most frequent values of chosen tags [eg. Symbol 55, Account 1, SenderCompID 49],
+//  with their summed OrderQty 38 and LastQty 32, in fixed memory whatever the number of distinct values
+//
+//      per tag, count-min sketches [DEPTH rows of WIDTH counters] estimate the msg count and the qty sums of any value -
+//      never under, over by at most about e/WIDTH of the window total - and a min heap of the values with the highest
+//      estimated counts keeps the candidates, looked up through a small open addressing table
+//
+//      a value not on the heap takes the place of its least frequent one once its estimate is higher
+//
+//      one line per value, most frequent first, for the window [SendingTime interval] or the whole input -
+//
+//          time tag name rank value count orderqty lastqty
+//
+#ifndef _FIXTOP_H_
+#define _FIXTOP_H_
+
+#include "fixcore.h"
+#include "fixfmt.h"
+
+
+struct FixCheckpoint;
+
+
+struct TopEntry
+{
+    string          value;
+    unsigned long long hash;
+    long long       count;              // estimate when last seen
+    int             hpos;               // index in the heap
+};
+
+
+struct TopSketch
+{
+    enum { DEPTH = 4, WIDTH = 1<<14, QTYPLACES = 4 };
+
+    int                 tag;
+    string              name;
+    int                 capacity;       // values tracked on the heap
+
+    vector<long long>   counts;         // DEPTH x WIDTH, by sketch row
+    vector<long long>   qty38;          // .. at QTYPLACES
+    vector<long long>   qty32;
+
+    vector<TopEntry>    entries;        // heap slots
+    vector<int>         heap;           // entries by count, least first
+    vector<int>         table;          // entry+1 by value hash, 0 empty [linear probing, at most half full]
+
+    long long           nvalues;        // values counted in the window
+
+    TopSketch(int t, const char* nm, int cap);
+
+    void    clear();
+    void    add(const char* v, int n, long long q38, long long q32);
+    long long estimate(const vector<long long>& sketch, unsigned long long h) const;
+
+    // internal
+
+    int     lookup(unsigned long long h, const char* v, int n) const;      // table slot of the value, or the empty slot for it
+    void    unlink(int slot);                                               // delete from the table, moving up the probe chain
+    void    sift_down(int i);
+    void    sift_up(int i);
+};
+
+
+struct FixTop
+{
+    MessageGenerator&       MG;
+    OutBuf&                 out;
+    int                     ntop;       // values written per tag
+    long long               interval;   // ns of SendingTime per window, 0 for the whole input
+
+    vector<TopSketch*>      sketches;   // one per tag
+    FixMessageView          view;
+    long long               tnext;      // end of the window [SendingTime ns]
+    char                    stime[32];  // label of the window - SendingTime of its first msg
+
+    long long               nmsgs;
+    long long               nbad;       // bad msgs skipped
+
+    FixTop(MessageGenerator& mg, OutBuf& o, int n, long long ival);
+    ~FixTop();
+
+    bool    add_tag(const char* sztag);                             // tag number or field name
+    void    report(const char* label);                              // top values of each tag, then clear them
+    void    msg(const char* p, int len);
+    void    run(int fd, int delims, FixCheckpoint* ck=NULL);        // msgs from fd, the last report at the end
+
+    void    save(FixCheckpoint& ck);                                // state for a checkpoint [fixcheckpoint.h]
+    bool    restore(FixCheckpoint& ck);                             // .. back from one, false if it doesnt parse
+};
+
+#endif //_FIXTOP_H_
@@ -3,6 +3,10 @@
 //
 //
 #include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <cstring>
 #include <cassert>
 #include <vector>
@@ -14,6 +18,16 @@
 
 #include <libxml/parser.h>
 #include "fixcore.h"
+#include "fixfmt.h"
+#include "fixpcap.h"
+#include "fixproxy.h"
+#include "fixpipe.h"
+#include "fixrewrite.h"
+#include "fixbook.h"
+#include "fixreload.h"
+#include "fixtop.h"
+#include "fixcut.h"
+#include "fixcheckpoint.h"
 
 
 ///
@@ -51,12 +65,11 @@ void test_gen_sell(MessageGenerator& MG)
     FixReader fix(sfix.c_str(), sfix.length());
 
 
-    XNode* xheader  = MG.load_expanded(MG.ndheader);
-    XNode* xmsgs    = MG.load_expanded(MG.ndmsgs);
-    XNode* xtrailer = MG.load_expanded(MG.ndtrailer);
+    MG.expand_specs();
 
-    xheader->atts["name"]="StandardHeader";
-    xtrailer->atts["name"]="StandardTrailer";
+    XNode* xheader  = MG.xheader;
+    XNode* xmsgs    = MG.xmsgs;
+    XNode* xtrailer = MG.xtrailer;
 
     //
 
@@ -96,17 +109,251 @@ void test_spec_next_fld(MessageGenerator& fixgen, string stype)
 }
 
 
-int trace_expanded(MessageGenerator& MG)
+static void time_label(char* buf, int n, long long secs, long nsecs)
+{
+    // YYYYMMDD-HH:MM:SS.nnnnnnnnn utc
+
+    struct tm tm;
+    time_t t = secs;
+    gmtime_r(&t, &tm);
+    int len = strftime(buf, n, "%Y%m%d-%H:%M:%S", &tm);
+    snprintf(buf+len, n-len, ".%09ld", nsecs);
+}
+
+
+struct TraceRun : FixMsgHandler, ProxyMsgHandler, PipeMsgHandler
+{
+    // per msg work shared by the stdin, pipelined, pcap and proxy inputs : check, trace to the sink, time it
+    // the spec is picked up afresh between msgs, so a reload takes effect at the next msg
+
+    SpecReader          spec;
+    MessageGenerator*   MG;
+    TraceSink&          sink;
+    OutBuf&             out;
+    TraceContext        ctx;
+    LatencyStats*       latency;
+    bool                bverbose;               // msg_bad reports to stdout
+    bool                bvalues;                // trace field values, not just errors
+    long long           ntraced;                // good msgs, as the sink numbers them
+
+    TraceRun(FixSpecHolder& specs, TraceSink& s, OutBuf& o, LatencyStats* lat, bool verbose, bool values)
+        : spec(specs)
+        , MG(spec.snap->MG)
+        , sink(s)
+        , out(o)
+        , ctx(*MG)
+        , latency(lat)
+        , bverbose(verbose)
+        , bvalues(values)
+        , ntraced(0)
+    {
+    }
+
+    void save(FixCheckpoint& ck)
+    {
+        ck.clear();
+        ck.line("traced");
+        ck.add(ntraced);
+    }
+
+    bool restore(FixCheckpoint& ck)
+    {
+        while (ck.next_line())
+        {
+            if (!ck.is("traced"))
+                return false;
+            ntraced = ck.get_int(1);
+            sink.skip_msgs(ntraced);
+        }
+        return true;
+    }
+
+    void refresh()
+    {
+        // rebind to a reloaded spec - the one before is freed once every reader has moved on
+
+        if (!spec.refresh())
+            return;
+
+        MG = spec.snap->MG;
+        ctx.size_for(*MG);
+        sink.spec_changed(*MG);
+    }
+
+    int msg(const char* p, int len, long long offset)
+    {
+        // trace one msg at p, returns its length or 0 if its not a good msg
+
+        unsigned long long t0 = latency ? fix_nanos() : 0;
+
+        refresh();
+
+        int bad;
+        {
+            FIX_STAGE(STAGE_CHECK);
+            bad = MG->msg_bad(p, len, bverbose);
+        }
+        if (bad)
+            return 0;
+
+        FIX_COUNT(COUNT_MSGS, 1);
+        FIX_COUNT(COUNT_MSG_BYTES, len);
+        ntraced++;
+
+        int npos = MG->trace_msg(p, len, sink, ctx, bvalues);
+
+        if (latency)
+            latency->add(fix_nanos()-t0, offset, ctx.msgtype, npos);
+
+        return npos>0 ? npos : 0;
+    }
+
+    virtual void pipe_msg(const char* p, int len, long long offset)
+    {
+        msg(p, len, offset);
+    }
+
+    virtual void finish()
+    {
+        out.flush();
+    }
+
+    virtual void fix_msg(const char* sz, int len, const PcapPacket& pkt, const TcpFlowKey& flow)
+    {
+        // label the msg with capture time [utc, ns] and tcp flow
+
+        char stime[64];
+        time_label(stime, sizeof(stime), pkt.ts_sec, pkt.ts_nsec);
+
+        sink.msg_info("time", stime);
+        sink.msg_info("flow", flow.label().c_str());
+
+        msg(sz, len, pkt.offset);
+    }
+
+    virtual void proxy_msg(const ProxyMsg& m)
+    {
+        // label with the time the proxy read it and its direction
+
+        char stime[64];
+        time_label(stime, sizeof(stime), m.ts_sec, m.ts_nsec);
+
+        sink.msg_info("time", stime);
+        sink.msg_info("flow", m.flow);
+
+        msg(m.data.data(), m.data.length(), m.offset);
+    }
+
+    virtual void proxy_idle()
+    {
+        // live output : dont sit on a part filled buffer, nor on a replaced spec
+
+        out.flush();
+        fflush(stdout);
+        refresh();
+    }
+};
+
+
+static int delims_option(mapss& options)
+{
+    // delimiters accepted in text input, besides SOH [rendered msgs are normalized before tracing]
+
+    int delims = FIXDELIM_SOH;
+    if (0==options["delim"].compare("|"))
+        delims |= FIXDELIM_PIPE;
+    else if (0==options["delim"].compare("^A"))
+        delims |= FIXDELIM_CARET;
+    else if (0==options["delim"].compare("any"))
+        delims = FIXDELIM_ANY;
+    return delims;
+}
+
+
+static FixCheckpoint* checkpoint_option(mapss& options)
+{
+    // checkpoint every N msgs to --checkpoint=file, and with --resume pick up where it was [seek stdin, cut stdout back]
+    // the run is known by the options that shape its output, a resume must be the same run
+
+    if (options["checkpoint"].empty())
+        return NULL;
+
+    string smode;
+    for (mapss::iterator p=options.begin(); p!=options.end(); ++p)
+    {
+        const string& k = p->first;
+        if (p->second.empty() || k=="checkpoint" || k=="checkpoint-every" || k=="resume" || k=="input" || k=="stats-timing" || k=="latency")
+            continue;
+        if (!smode.empty())
+            smode.push_back(' ');
+        smode += k + "=" + p->second;
+    }
+
+    FixCheckpoint* ck = new FixCheckpoint(options["checkpoint"].c_str(), atoll(options["checkpoint-every"].c_str()), smode);
+    if (!options["resume"].empty())
+    {
+        if (ck->load())
+            ck->resume(0);
+        else
+            fprintf(stderr, "No checkpoint [%s], starting from the beginning\n", ck->file.c_str());
+    }
+    return ck;
+}
+
+static void checkpoint_restored(FixCheckpoint* ck, bool bok)
+{
+    if (!bok)
+        fprintf(stderr, "Checkpoint state doesnt parse [%s]\n", ck->file.c_str()), exit(-1);
+}
+
+int rewrite_log(MessageGenerator& MG, mapss& options)
+{
+    // stdin to stdout with fields masked / dropped / renumbered by the rules, instead of tracing
+
+    OutBuf out(stdout);
+    FixRewriter rw(MG, out);
+    if (!rw.load(options["rewrite"].c_str()))
+        exit(-1);
+    rw.bpassbad = !options["rewrite-pass-bad"].empty();
+
+    FixCheckpoint* ck = checkpoint_option(options);
+    if (ck)
+        checkpoint_restored(ck, rw.restore(*ck));
+
+    fix_stats_start();                          // the run, not the setup
+    rw.run(0, delims_option(options), ck);
+    fflush(stdout);
+
+    if (ck)
+    {
+        ck->done();
+        delete ck;
+    }
+
+    fprintf(stderr, "fixtr rewrite : %lld msgs, %lld rewritten", rw.nmsgs, rw.nrewritten);
+    if (rw.nbad)
+        fprintf(stderr, ", %lld bad msgs %s [BodyLength, CheckSum or fields]", rw.nbad, rw.bpassbad ? "copied as is" : "dropped");
+    fprintf(stderr, "\n");
+
+    if (!options["stats-timing"].empty())
+        fix_stats_report(stderr);
+
+    // not all of the log came through rewritten
+
+    return rw.nbad ? 1 : 0;
+}
+
+
+int trace_expanded(MessageGenerator& MG, mapss& options)
 {
     // for each of - header, trailer, and each msg type
     //      run through the nested components and expend into the full list of fields [to support misordering of fields]
 
-    XNode* xheader  = MG.load_expanded(MG.ndheader);
-    XNode* xtrailer = MG.load_expanded(MG.ndtrailer);
-    XNode* xmsgs    = MG.load_expanded(MG.ndmsgs);
+    MG.expand_specs();
 
-    xheader->atts["name"]="StandardHeader";
-    xtrailer->atts["name"]="StandardTrailer";
+    XNode* xheader  = MG.xheader;
+    XNode* xtrailer = MG.xtrailer;
+    XNode* xmsgs    = MG.xmsgs;
 
     // validate
 
@@ -169,71 +416,274 @@ int trace_expanded(MessageGenerator& MG)
     if (true)
     {
         // read lines from stdin and trace any fix messages we recognize embedded in the text input
+        // output as human readable text, or one record per msg [json] / per field [csv]
+
+        // validate mode reports errors only, with seen bitsets [no per msg allocation]
+
+        bool bvalidate = !options["validate"].empty();
+
+        // the spec as a snapshot readers pick up between msgs, rebuilt in the background on SIGHUP [fixreload.h]
 
-        string sline;
-        int npos=0;
-        while(!cin.eof()) 
+        FixSpecHolder specs(options["spec"].c_str(), new SpecSnapshot(MG.ndfix, &MG, false));
+        specs.bverbose = true;
+        specs.on_sighup();
+
+        OutBuf out(stdout);
+
+        TextTraceSink   text(MG);
+        ErrorTextSink   errtext;
+        JsonTraceSink   json(out, bvalidate);
+        CsvTraceSink    csv(out);
+
+        TraceSink* sink = bvalidate ? (TraceSink*)&errtext : (TraceSink*)&text;
+        if (0==options["format"].compare("json"))
+            sink = &json;
+        else if (0==options["format"].compare("csv"))
+            sink = &csv;
+
+        bool bverbose = (sink==&text || sink==&errtext);
+
+        // per msg latency histograms, if asked for
+
+        LatencyStats* latency = NULL;
+        if (!options["latency"].empty())
+            latency = new LatencyStats(atoi(options["latency"].c_str()));
+
+        TraceRun run(specs, *sink, out, latency, bverbose, !bvalidate);
+        run.ctx.bstrict = !options["strict"].empty();
+
+        int delims = delims_option(options);
+
+        // pick up from a checkpoint, if asked [stdin only]
+
+        FixCheckpoint* ck = checkpoint_option(options);
+        if (ck)
+            checkpoint_restored(ck, run.restore(*ck));
+
+        // setup done [spec loaded and expanded, sinks made] : stats time the run from here
+
+        fix_stats_start();
+
+        if (!options["pcap"].empty())
+        {
+            // tcp payloads from a capture file, framed by BodyLength
+
+            pcap_trace_file(options["pcap"].c_str(), run, stderr);
+        }
+        else if (!options["proxy"].empty())
+        {
+            // forward client <=> server, trace a copy of each msg on a second thread
+
+            proxy_trace(options["proxy"].c_str(), run, stderr);
+        }
+        else if (!options["pipeline"].empty())
         {
-            getline(cin, sline); 
-            
-            const char* p = sline.c_str();
-            while(NULL!=(p = strstr(p, "8=FIX")))
+            // reader, framer, tracer and writer each on their own thread
+
+            FixPipeline pipeline(0, stdout, run);
+            pipeline.delims = delims;
+            out.pipe = &pipeline;
+            pipeline.run();
+            out.pipe = NULL;
+        }
+        else
+        {
+            // raw stream, msgs framed by BodyLength whatever the read or line boundaries [text between msgs skipped]
+
+            FixFramer framer;
+            framer.delims = delims;
+            framer.base = ck ? ck->offset : 0;
+            while (!framer.beof)
             {
-                int len = strlen(p);
+                {
+                    FIX_STAGE(STAGE_READ);
+                    char* p = framer.space();
+                    int r = read(0, p, framer.avail());
+                    if (r<0 && errno==EINTR)
+                        continue;
+                    if (r<=0)
+                        framer.beof = true;
+                    else
+                        framer.commit(r);
+                    FIX_COUNT(COUNT_BYTES_IN, r>0 ? r : 0);
+                }
 
-                if (MG.msg_bad(p, len))
+                const char* p;
+                int len;
+                long long off;
+                while (true)
                 {
-                    p+=5;
-                    continue;
+                    {
+                        FIX_STAGE(STAGE_FIND);
+                        if (!framer.next(p, len, off))
+                            break;
+                    }
+                    run.msg(p, len, off);
+
+                    if (ck && ck->tick())
+                    {
+                        run.save(*ck);
+                        ck->save(off+framer.rawlen, out);
+                    }
                 }
+            }
+        }
 
-                trace_raw_fix(p, "\nMSG = ");
+        out.flush();
 
-                FixReader fix(p, len);
+        if (ck)
+        {
+            ck->done();
+            delete ck;
+        }
 
-                printf("\nheader\n");
-                MG.trace_fix_xspec(fix, xheader);
+        if (latency)
+        {
+            latency->report(stderr);
+            delete latency;
+        }
+    }
 
-                if (!fix.msgtype.empty())
-                {
-                    XNode* xbody = xmsgs->lookup(fix.msgtype.c_str());
+    if (!options["stats-timing"].empty())
+        fix_stats_report(stderr);
 
-                    printf("\n%s\n", xbody->att("name"));
-                    MG.trace_fix_xspec(fix, xbody);
+    return 0;
+}
 
-                    printf("\ntrailer\n");
-                    MG.trace_fix_xspec(fix, xtrailer);
-                }
+int book_log(MessageGenerator& MG, mapss& options)
+{
+    // order books from the W / X msgs on stdin, snapshots to stdout instead of the trace
 
-                npos = fix.npos;
+    OutBuf out(stdout);
+    FixBooks books(MG, out, atoi(options["book"].c_str()), atoll(options["book-interval"].c_str())*1000000);
 
-                if (npos>0)
-                    p+=npos;
-                else
-                    p+=5;
-            } 
-        }
+    FixCheckpoint* ck = checkpoint_option(options);
+    if (ck)
+        checkpoint_restored(ck, books.restore(*ck));
+
+    fix_stats_start();                          // the run, not the setup
+    books.run(0, delims_option(options), ck);
+    fflush(stdout);
+
+    if (ck)
+    {
+        ck->done();
+        delete ck;
     }
-    // cleanup
 
-    delete xheader;
-    delete xtrailer;
-    delete xmsgs;
+    fprintf(stderr, "fixtr book : %lld W/X msgs, %lld entries, %d symbols", books.nmsgs, books.nentries, (int)books.books.size());
+    if (books.nbad)
+        fprintf(stderr, ", %lld bad msgs skipped", books.nbad);
+    fprintf(stderr, "\n");
+
+    if (!options["stats-timing"].empty())
+        fix_stats_report(stderr);
 
     return 0;
 }
 
 ///
 
+int top_log(MessageGenerator& MG, mapss& options)
+{
+    // most frequent values of the chosen tags on stdin, per window of SendingTime or for the whole input
+
+    OutBuf out(stdout);
+    FixTop top(MG, out, atoi(options["top-n"].c_str()), atoll(options["top-interval"].c_str())*1000000);
+
+    string stags = options["top"];
+    for (size_t a=0; a<stags.length(); )
+    {
+        size_t b = stags.find(',', a);
+        if (b==string::npos)
+            b = stags.length();
+
+        string stag = stags.substr(a, b-a);
+        if (!top.add_tag(stag.c_str()))
+            fprintf(stderr,"Bad option --top, no field [%s]\n", stag.c_str()), exit(-1);
+        a = b+1;
+    }
+
+    FixCheckpoint* ck = checkpoint_option(options);
+    if (ck)
+        checkpoint_restored(ck, top.restore(*ck));
+
+    fix_stats_start();                          // the run, not the setup
+    top.run(0, delims_option(options), ck);
+    fflush(stdout);
+
+    if (ck)
+    {
+        ck->done();
+        delete ck;
+    }
+
+    fprintf(stderr, "fixtr top : %lld msgs, %d tags", top.nmsgs, (int)top.sketches.size());
+    if (top.nbad)
+        fprintf(stderr, ", %lld bad msgs skipped", top.nbad);
+    fprintf(stderr, "\n");
+
+    if (!options["stats-timing"].empty())
+        fix_stats_report(stderr);
+
+    return 0;
+}
+
+int cut_log(MessageGenerator& MG, mapss& options)
+{
+    // the chosen tags of each msg on stdin as tab separated rows, instead of the trace
+
+    OutBuf out(stdout);
+    FixCut cut(MG, out);
+
+    string stags = options["cut"];
+    for (size_t a=0; a<stags.length(); )
+    {
+        size_t b = stags.find(',', a);
+        if (b==string::npos)
+            b = stags.length();
+
+        string stag = stags.substr(a, b-a);
+        if (!cut.add_tag(stag.c_str()))
+            fprintf(stderr,"Bad option --cut, no field [%s] or given twice\n", stag.c_str()), exit(-1);
+        a = b+1;
+    }
+
+    if (!options["cut-group"].empty() && !cut.set_group(options["cut-group"].c_str()))
+        fprintf(stderr,"Bad option --cut-group, no group [%s] in the spec\n", options["cut-group"].c_str()), exit(-1);
+
+    FixCheckpoint* ck = checkpoint_option(options);
+    if (ck)
+        checkpoint_restored(ck, cut.restore(*ck));
+
+    fix_stats_start();                          // the run, not the setup
+    cut.run(0, delims_option(options), ck);
+    fflush(stdout);
+
+    if (ck)
+    {
+        ck->done();
+        delete ck;
+    }
+
+    fprintf(stderr, "fixtr cut : %lld msgs, %lld rows\n", cut.nmsgs, cut.nrows);
+
+    if (!options["stats-timing"].empty())
+        fix_stats_report(stderr);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) 
 {
     // handle args
 
     const char* szfile = "./spec/FIX44.xml";
 
-    if (argc==2)
+    mapss options;
+    for (int i=1;i<argc;i++)
     {
-        const char* szopt=argv[1];
+        const char* szopt=argv[i];
 
         if (0==strncmp(szopt, "-S", 2))
         {
@@ -244,15 +694,155 @@ int main(int argc, char *argv[])
             else
             {
                 fprintf(stderr,"Bad option -S\n"), exit(-1);
-                fprintf(stderr,"USAGE: fixtr {-S=./spec/FIXnn.xml} < fix_messages.fix\n");
-                exit(-1);
             }
         }
-    }
-    else if (argc>2)
-    {
-        fprintf(stderr,"USAGE: fixtr {-S=./spec/FIXnn.xml} < fix_messages.fix\n");
-        exit(-1);
+        else if (0==strncmp(szopt, "--format=", 9))
+        {
+            options["format"] = szopt+9;
+            if (options["format"].compare("text") && options["format"].compare("json") && options["format"].compare("csv"))
+                fprintf(stderr,"Bad option --format, use text json or csv\n"), exit(-1);
+        }
+        else if (0==strcmp(szopt, "--validate"))
+        {
+            options["validate"] = "Y";
+        }
+        else if (0==strcmp(szopt, "--strict"))
+        {
+            options["strict"] = "Y";
+        }
+        else if (0==strcmp(szopt, "--stats-timing"))
+        {
+            options["stats-timing"] = "Y";
+        }
+        else if (0==strcmp(szopt, "--latency"))
+        {
+            options["latency"] = "10";
+        }
+        else if (0==strncmp(szopt, "--latency=", 10) && atoi(szopt+10)>0)
+        {
+            options["latency"] = szopt+10;
+        }
+        else if (0==strncmp(szopt, "--delim=", 8))
+        {
+            options["delim"] = szopt+8;
+            if (options["delim"].compare("|") && options["delim"].compare("^A") && options["delim"].compare("any"))
+                fprintf(stderr,"Bad option --delim, use | ^A or any\n"), exit(-1);
+        }
+        else if (0==strcmp(szopt, "--pipeline"))
+        {
+            options["pipeline"] = "Y";
+        }
+        else if (0==strncmp(szopt, "--pcap=", 7) && strlen(szopt)>7)
+        {
+            options["pcap"] = szopt+7;
+        }
+        else if (0==strncmp(szopt, "--proxy=", 8) && strlen(szopt)>8)
+        {
+            options["proxy"] = szopt+8;
+        }
+        else if (0==strcmp(szopt, "--proxy") && i+1<argc)
+        {
+            options["proxy"] = argv[++i];
+        }
+        else if (0==strcmp(szopt, "--book"))
+        {
+            options["book"] = "1";
+        }
+        else if (0==strncmp(szopt, "--book=", 7) && atoi(szopt+7)>0)
+        {
+            options["book"] = szopt+7;
+        }
+        else if (0==strncmp(szopt, "--book-interval=", 16) && atoi(szopt+16)>0)
+        {
+            options["book-interval"] = szopt+16;
+            if (options["book"].empty())
+                options["book"] = "1";
+        }
+        else if (0==strcmp(szopt, "--top"))
+        {
+            options["top"] = "55,1,49";
+        }
+        else if (0==strncmp(szopt, "--top=", 6) && strlen(szopt)>6)
+        {
+            options["top"] = szopt+6;
+        }
+        else if (0==strncmp(szopt, "--top-n=", 8) && atoi(szopt+8)>0)
+        {
+            options["top-n"] = szopt+8;
+        }
+        else if (0==strncmp(szopt, "--top-interval=", 15) && atoi(szopt+15)>0)
+        {
+            options["top-interval"] = szopt+15;
+            if (options["top"].empty())
+                options["top"] = "55,1,49";
+        }
+        else if (0==strncmp(szopt, "--rewrite=", 10) && strlen(szopt)>10)
+        {
+            options["rewrite"] = szopt+10;
+        }
+        else if (0==strcmp(szopt, "--rewrite") && i+1<argc)
+        {
+            options["rewrite"] = argv[++i];
+        }
+        else if (0==strcmp(szopt, "--rewrite-pass-bad"))
+        {
+            options["rewrite-pass-bad"] = "Y";
+        }
+        else if (0==strncmp(szopt, "--cut=", 6) && strlen(szopt)>6)
+        {
+            options["cut"] = szopt+6;
+        }
+        else if (0==strcmp(szopt, "--cut") && i+1<argc)
+        {
+            options["cut"] = argv[++i];
+        }
+        else if (0==strncmp(szopt, "--cut-group=", 12) && strlen(szopt)>12)
+        {
+            options["cut-group"] = szopt+12;
+        }
+        else if (0==strncmp(szopt, "--checkpoint=", 13) && strlen(szopt)>13)
+        {
+            options["checkpoint"] = szopt+13;
+        }
+        else if (0==strncmp(szopt, "--checkpoint-every=", 19) && atoll(szopt+19)>0)
+        {
+            options["checkpoint-every"] = szopt+19;
+        }
+        else if (0==strcmp(szopt, "--resume"))
+        {
+            options["resume"] = "Y";
+        }
+        else if (0==strncmp(szopt, "--input=", 8) && strlen(szopt)>8)
+        {
+            options["input"] = szopt+8;
+        }
+        else
+        {
+            fprintf(stderr,"USAGE: fixtr {-S=./spec/FIXnn.xml} < fix_messages.fix\n");
+            fprintf(stderr,"  option --format=text|json|csv : output format [default text]\n");
+            fprintf(stderr,"  option --validate             : report errors only\n");
+            fprintf(stderr,"  option --strict               : also check values against the field type and enums\n");
+            fprintf(stderr,"  option --stats-timing         : per stage timing report on exit [build with make STATS=1]\n");
+            fprintf(stderr,"  option --latency{=N}          : per msg latency percentiles by msg type and size, and the N slowest msgs\n");
+            fprintf(stderr,"  option --delim=|  --delim=^A  : also take msgs from logs that render SOH as | or ^A [--delim=any for both]\n");
+            fprintf(stderr,"  option --pipeline             : read, frame, trace and write stdin on separate threads\n");
+            fprintf(stderr,"  option --pcap=file.pcap       : read fix over tcp from a pcap or pcapng capture instead of stdin\n");
+            fprintf(stderr,"  option --proxy [host:]port=>host:port : forward tcp, tracing the fix msgs going each way\n");
+            fprintf(stderr,"  option --rewrite rules.txt    : copy stdin to stdout, masking / dropping / renumbering fields by the rules [see fixrewrite.h]\n");
+            fprintf(stderr,"  option --rewrite-pass-bad     : .. msgs that dont check out copied as is, rather than dropped [exit 1 if any]\n");
+            fprintf(stderr,"  option --book{=N}             : order books from W / X msgs, top of book [or N levels] for each book a msg changes\n");
+            fprintf(stderr,"  option --book-interval=ms     : .. or for books changed in each interval of SendingTime\n");
+            fprintf(stderr,"  option --top{=55,1,49}        : most frequent values of the tags [numbers or names], with summed OrderQty and LastQty\n");
+            fprintf(stderr,"  option --top-n=N              : .. the top N of each [default 10]\n");
+            fprintf(stderr,"  option --top-interval=ms      : .. for each interval of SendingTime\n");
+            fprintf(stderr,"  option --cut 52,35,11         : the tags [numbers or names] of each msg as tab separated rows, no trace\n");
+            fprintf(stderr,"  option --cut-group=NoXxx      : .. a row per repeat of the group, its tags from the repeat\n");
+            fprintf(stderr,"  option --input=file.log       : read the file instead of stdin\n");
+            fprintf(stderr,"  option --checkpoint=file      : checkpoint input offset and state every 1000000 msgs, removed when done [see fixcheckpoint.h]\n");
+            fprintf(stderr,"  option --checkpoint-every=N   : .. every N msgs\n");
+            fprintf(stderr,"  option --resume               : .. carry on from the checkpoint, input seeked to it, output cut back to it [>> output]\n");
+            exit(-1);
+        }
     }
 
     if (access(szfile, R_OK))
@@ -261,6 +851,23 @@ int main(int argc, char *argv[])
         exit(-1);
     }
 
+    // a file in place of stdin, so it can be seeked on resume
+
+    if (!options["input"].empty())
+    {
+        int fd = open(options["input"].c_str(), O_RDONLY);
+        if (fd<0 || dup2(fd, 0)<0)
+            fprintf(stderr,"Cant read file [%s]\n", options["input"].c_str()), exit(-1);
+        close(fd);
+    }
+
+    if (!options["checkpoint"].empty() && (!options["pipeline"].empty() || !options["pcap"].empty() || !options["proxy"].empty()))
+        fprintf(stderr,"Bad option --checkpoint, only for stdin or --input [not --pipeline --pcap --proxy]\n"), exit(-1);
+    if (!options["resume"].empty() && options["checkpoint"].empty())
+        fprintf(stderr,"Bad option --resume, needs --checkpoint=file\n"), exit(-1);
+    if (options["checkpoint-every"].empty())
+        options["checkpoint-every"] = "1000000";
+
     // parse the spec
 
     XNode* ndfix = parse_fix_spec_xml(szfile); 
@@ -278,9 +885,34 @@ int main(int argc, char *argv[])
         test_gen_sell(fixgen); 
 
 
+    options["spec"] = szfile;
+
+    // rewrite a log by rules
+    if (!options["rewrite"].empty())
+        return rewrite_log(fixgen, options);
+
+    // or build order books from market data
+
+    if (!options["book"].empty())
+        return book_log(fixgen, options);
+
+    // or cut tags from each msg
+
+    if (!options["cut"].empty())
+        return cut_log(fixgen, options);
+
+    // or find the heavy hitters of some tags
+
+    if (!options["top"].empty())
+    {
+        if (options["top-n"].empty())
+            options["top-n"] = "10";
+        return top_log(fixgen, options);
+    }
+
     // expand the spec [replacing components inline], and use spec to summarize inbound fix messages as we see them
 
-    trace_expanded(fixgen);
+    trace_expanded(fixgen, options);
 
 }
 